@@ -1,4 +1,5 @@
 #include <mccl/algorithm/decoding.hpp>
+#include <mccl/core/matrix_algorithms.hpp>
 
 MCCL_BEGIN_NAMESPACE
 
@@ -19,6 +20,21 @@ bool check_SD_solution(const cmat_view& H, const cvec_view& S, unsigned int w, c
     return tmp.is_equal(S);
 }
 
+std::vector<bool> check_SD_solutions(const cmat_view& H, const cvec_view& S, unsigned int w, const cmat_view& E)
+{
+    if (S.columns() != H.rows())
+        throw std::runtime_error("check_SD_solutions(): H and S do not have matching dimensions");
+    if (E.columns() != H.columns())
+        throw std::runtime_error("check_SD_solutions(): H and E do not have matching dimensions");
+    mat HT = m_transpose(H);
+    mat syndromes(E.rows(), H.rows());
+    m_mul(syndromes, E, HT);
+    std::vector<bool> ok(E.rows());
+    for (size_t i = 0; i < E.rows(); ++i)
+        ok[i] = hammingweight(E[i]) <= w && syndromes[i].is_equal(S);
+    return ok;
+}
+
 bool syndrome_decoding_problem::check_solution(const cvec_view& E) const
 {
     return check_SD_solution(H, S, w, E);
@@ -7,6 +7,8 @@
 #include <mccl/core/matrix.hpp>
 #include <mccl/tools/statistics.hpp>
 
+#include <vector>
+
 MCCL_BEGIN_NAMESPACE
 
 class syndrome_decoding_API;
@@ -24,6 +26,9 @@ struct syndrome_decoding_problem
 };
 
 bool check_SD_solution(const cmat_view& H, const cvec_view& S, unsigned int w, const cvec_view& E);
+// check many candidate solutions at once, given as the rows of E: all syndromes are computed as E * H^T
+// returns for each row of E whether it is a solution
+std::vector<bool> check_SD_solutions(const cmat_view& H, const cvec_view& S, unsigned int w, const cmat_view& E);
 
 
 // virtual base class: interface to find a single solution for syndrome decoding
@@ -125,6 +130,9 @@ public:
     virtual void load_config(const configmap_t& configmap) = 0;
     virtual void save_config(configmap_t& configmap) = 0;
 
+    // seed the random generator of the subISD (if it uses one), call before initialize for deterministic behaviour
+    virtual void seed(uint64_t) {}
+
     // deterministic initialization for given parity check matrix H and target syndrome s
     virtual void initialize(const cmat_view& H12T_padded, size_t H2T_columns, const cvec_view& S, unsigned int w, callback_t callback, void* ptr = nullptr) = 0;
 
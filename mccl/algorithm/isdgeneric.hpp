@@ -8,6 +8,8 @@
 #include <mccl/core/matrix_isdform.hpp>
 #include <mccl/tools/statistics.hpp>
 
+#include <atomic>
+
 MCCL_BEGIN_NAMESPACE
 
 struct ISD_generic_config_t
@@ -84,7 +86,7 @@ public:
     typedef block_tag<bit_alignment,_masked> this_block_tag;
 
     ISD_generic(subISDT_t& sI)
-        : subISDT(&sI), config(ISD_generic_config_default), stats("ISD-generic")
+        : subISDT(&sI), stop_flag(nullptr), config(ISD_generic_config_default), stats("ISD-generic")
     {
         n = k = w = 0;
     }
@@ -105,29 +107,13 @@ public:
     // deterministic initialization for given parity check matrix H0 and target syndrome s0
     void initialize(const cmat_view& _H, const cvec_view& _S, unsigned int _w)
     {
-        stats.cnt_initialize.inc();
-        // set parameters according to current config
-        l = config.l;
-        u = config.u;
-        update_type = config.updatetype;
-
-        n = _H.columns();
-        k = n - _H.rows();
-        w = _w;
-        Horg.reset(_H);
-        Sorg.reset(_S);
-        HST.reset(_H, _S, l);
+        _initialize(_H, _S, _w, true);
+    }
 
-        C.resize(HST.S().columns());
-        
-        blocks_per_row = HST.H12T().row_blocks();
-        block_stride = HST.H12T().block_stride();
-        H12T_blockptr = HST.H12T().block_ptr();
-        S_blockptr = HST.S().block_ptr();
-        C_blockptr = C.block_ptr();
-        
-        sol.clear();
-        solution = vec();
+    // initialization for an ISD form that is only loaded by load_ISD_form: HST is allocated but not computed
+    void initialize_noreset(const cmat_view& _H, const cvec_view& _S, unsigned int _w)
+    {
+        _initialize(_H, _S, _w, false);
     }
 
     // probabilistic preparation of loop invariant
@@ -141,14 +127,27 @@ public:
     // perform one loop iteration, return true if successful and store result in e
     bool loop_next()
     {
-        stats.cnt_loop_next.inc();
         // swap u rows in HST & bring in echelon form
         HST.update(u, update_type);
+        return loop_next_noupdate();
+    }
+
+    // perform one loop iteration on the current ISD form without updating it
+    bool loop_next_noupdate()
+    {
+        stats.cnt_loop_next.inc();
         // find all subISD solutions
         subISDT->solve();
         return !sol.empty();
     }
 
+    // load H12T, S and permutation from an ISD form for the same instance that was updated elsewhere
+    // (e.g. by a producer thread), to be followed by loop_next_noupdate()
+    void load_ISD_form(const HST_ISD_form_t<_bit_alignment,_masked>& form)
+    {
+        HST.copy_ISD_part(form);
+    }
+
     // run loop until a solution is found
     void solve()
     {
@@ -170,6 +169,25 @@ public:
         return stats;
     };
 
+    // move the pending counters into the samples, after a parallel driver merged them
+    void refresh_stats()
+    {
+        stats.refresh();
+    }
+
+    // seed the random generators used for the column permutations and by the subISD, call before initialize
+    void seed(uint64_t s)
+    {
+        HST.seed(s);
+        subISDT->seed(derive_seed(s, 0));
+    }
+
+    // optional shared flag: when set, the callback aborts the subISD enumeration
+    void set_stop_flag(const std::atomic<bool>* flag)
+    {
+        stop_flag = flag;
+    }
+
 
 
     bool check_solution()
@@ -185,52 +203,18 @@ public:
     inline bool callback(const uint32_t* begin, const uint32_t* end, unsigned int w1partial)
     {
             stats.cnt_callback.inc();
+            if (stop_flag != nullptr && stop_flag->load(std::memory_order_relaxed))
+                return false;
             // weight of solution consists of w2 (=end-begin) + w1partial (given) + w1rest (computed below)
             size_t wsol = w1partial + (end - begin);
             if (wsol > w)
                 return true;
 
+            // compute C = S + sum of selected H12T rows with early abort when its weight exceeds the remaining weight
             wsol = end - begin;
-            if (begin == end)
-            {
-                // case selection size 0
-                auto Sptr = S_blockptr;
-                auto Cptr = C_blockptr;
-                for (unsigned i = 0; i < blocks_per_row; ++i,++Sptr,++Cptr)
-                {
-                    wsol += hammingweight( *Cptr = *Sptr );
-                    if (wsol > w)
-                        return true;
-                }
-            } else if (begin == end-1)
-            {
-                // case selection size 1
-                auto Sptr = S_blockptr;
-                auto Cptr = C_blockptr;
-                auto HTrowptr = H12T_blockptr + block_stride*(*begin);
-                for (unsigned i = 0; i < blocks_per_row; ++i,++Cptr,++Sptr,++HTrowptr)
-                {
-                    wsol += hammingweight( *Cptr = *Sptr ^ *HTrowptr );
-                    if (wsol > w)
-                        return true;
-                }
-            } else {
-                // case selection size >= 2
-                auto Cptr = C_blockptr;
-                auto Sptr = S_blockptr;
-                for (unsigned i = 0; i < blocks_per_row; ++i,++Cptr,++Sptr)
-                {
-                    const uint32_t* p = begin;
-                    *Cptr = *Sptr ^ *(H12T_blockptr + block_stride*(*p) + i);
-                    for (++p; p != end-1; ++p)
-                    {
-                        *Cptr = *Cptr ^ *(H12T_blockptr + block_stride*(*p) + i);
-                    }
-                    wsol += hammingweight( *Cptr = *Cptr ^ *(H12T_blockptr + block_stride*(*p) + i) );
-                    if (wsol > w)
-                        return true;
-                }
-            }
+            wsol += simd_kernels.combine_hw(C_wordptr, S_wordptr, H12T_wordptr, word_stride, begin, end, words_per_row, w - wsol);
+            if (wsol > w)
+                return true;
 
             // this should be a correct solution at this point
             if (benchmark)
@@ -260,7 +244,40 @@ public:
     
     
 private:
+    void _initialize(const cmat_view& _H, const cvec_view& _S, unsigned int _w, bool reset)
+    {
+        if (stats.cnt_initialize.pending() != 0)
+            stats.refresh();
+        stats.cnt_initialize.inc();
+        // set parameters according to current config
+        l = config.l;
+        u = config.u;
+        update_type = config.updatetype;
+
+        n = _H.columns();
+        k = n - _H.rows();
+        w = _w;
+        Horg.reset(_H);
+        Sorg.reset(_S);
+        if (reset)
+            HST.reset(_H, _S, l);
+        else
+            HST.setup(_H, l);
+
+        C.resize(HST.S().columns());
+        
+        words_per_row = HST.H12T().row_words();
+        word_stride = HST.H12T().word_stride();
+        H12T_wordptr = HST.H12T().word_ptr();
+        S_wordptr = HST.S().word_ptr();
+        C_wordptr = C.word_ptr();
+        
+        sol.clear();
+        solution = vec();
+    }
+
     subISDT_t* subISDT;
+    const std::atomic<bool>* stop_flag;
 
     // original parity check matrix H^T and syndrome S
     cmat_view Horg;
@@ -275,11 +292,11 @@ private:
     // temporary vector to compute sum of syndrome and H columns
     vec_t<this_block_tag> C;
     
-    // block pointers to H12T, S and C
-    size_t block_stride, blocks_per_row;
-    const this_block_t* H12T_blockptr;
-    const this_block_t* S_blockptr;
-    this_block_t* C_blockptr;
+    // word pointers to H12T, S and C
+    size_t word_stride, words_per_row;
+    const uint64_t* H12T_wordptr;
+    const uint64_t* S_wordptr;
+    uint64_t* C_wordptr;
     
     
     // parameters
@@ -0,0 +1,15 @@
+#include <mccl/algorithm/isdgeneric_parallel.hpp>
+
+MCCL_BEGIN_NAMESPACE
+
+template class ISD_generic_parallel<subISDT_API,64>;
+template class ISD_generic_parallel<subISDT_API,128>;
+template class ISD_generic_parallel<subISDT_API,256>;
+template class ISD_generic_parallel<subISDT_API,512>;
+
+template class ISD_generic_pipeline<subISDT_API,64>;
+template class ISD_generic_pipeline<subISDT_API,128>;
+template class ISD_generic_pipeline<subISDT_API,256>;
+template class ISD_generic_pipeline<subISDT_API,512>;
+
+MCCL_END_NAMESPACE
@@ -0,0 +1,459 @@
+// multi-threaded drivers for ISD_generic:
+// - ISD_generic_parallel: independent ISD instances per thread racing for a solution
+// - ISD_generic_pipeline: one producer thread updating the ISD form, consumer threads running subISDs on snapshots
+
+#ifndef MCCL_ALGORITHM_ISDGENERIC_PARALLEL_HPP
+#define MCCL_ALGORITHM_ISDGENERIC_PARALLEL_HPP
+
+#include <mccl/config/config.hpp>
+#include <mccl/algorithm/decoding.hpp>
+#include <mccl/algorithm/isdgeneric.hpp>
+#include <mccl/core/random.hpp>
+#include <mccl/tools/statistics.hpp>
+#include <mccl/tools/numa.hpp>
+#include <mccl/contrib/thread_pool.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+MCCL_BEGIN_NAMESPACE
+
+// runs one ISD_generic instance per subISD object given, each on its own thread
+// every worker maintains its own HST_ISD_form_t with a random generator seeded from a distinct seed
+// the first worker to find a solution publishes it and raises a shared stop flag,
+// which aborts the subISD enumeration of all other workers through the ISD_generic callback
+// with a thread placement set, worker i only runs on threads bound to the CPUs of its node,
+// in particular for initialize, so its ISD form and subISD data (and subISD threads) are on its local node
+// pool threads are bound once and then preferably get workers of the same node (see worker_claims)
+template<typename subISDT_t = subISDT_API, size_t _bit_alignment = 256, bool _masked = false>
+class ISD_generic_parallel
+    final : public syndrome_decoding_API
+{
+public:
+    typedef ISD_generic<subISDT_t, _bit_alignment, _masked> ISD_t;
+
+    // one subISD object per thread, the subISD objects must outlive this object
+    ISD_generic_parallel(const std::vector<subISDT_t*>& subISDs)
+        : stats("ISD-generic-parallel")
+    {
+        if (subISDs.empty())
+            throw std::runtime_error("ISD_generic_parallel: need at least one subISD");
+        for (auto subISDptr : subISDs)
+        {
+            workers.emplace_back(new ISD_t(*subISDptr));
+            workers.back()->set_stop_flag(&stop_flag);
+        }
+        subISDTs = subISDs;
+        threadpool.resize(workers.size() - 1);
+    }
+
+    size_t threads() const { return workers.size(); }
+
+    // set seed from which all worker seeds are derived
+    void seed(uint64_t s)
+    {
+        rndgen.seed(s);
+    }
+
+    // set thread placement, worker i uses placement.pin(i)
+    void set_placement(const thread_placement& p)
+    {
+        placement = p;
+    }
+
+    void load_config(const configmap_t& configmap)
+    {
+        for (auto& w : workers)
+            w->load_config(configmap);
+    }
+    void save_config(configmap_t& configmap)
+    {
+        workers.front()->save_config(configmap);
+    }
+
+    void initialize(const cmat_view& H, const cvec_view& S, unsigned int w)
+    {
+        stop_flag = false;
+        solution = vec();
+        // derive distinct seeds before starting threads for reproducibility
+        for (auto& wrk : workers)
+            wrk->seed(rndgen());
+        run_workers([&](ISD_t& wrk){ wrk.initialize(H, S, w); });
+    }
+
+    void prepare_loop(bool benchmark = false)
+    {
+        stop_flag = false;
+        run_workers([&](ISD_t& wrk){ wrk.prepare_loop(benchmark); });
+    }
+
+    // perform one loop iteration on every worker, return true if a solution was found
+    bool loop_next()
+    {
+        stop_flag = false;
+        run_workers([&](ISD_t& wrk){
+            if (wrk.loop_next())
+                publish_solution(wrk);
+        });
+        return stop_flag;
+    }
+
+    // run all workers until one of them finds a solution
+    void solve()
+    {
+        stats.cnt_solve.inc();
+        stop_flag = false;
+        run_workers([&](ISD_t& wrk){
+            wrk.prepare_loop();
+            while (!stop_flag.load(std::memory_order_relaxed))
+            {
+                if (wrk.loop_next())
+                    publish_solution(wrk);
+            }
+        });
+        // merge only the counts since the previous solve
+        for (auto& wrk : workers)
+        {
+            stats.merge(wrk->get_stats(), false);
+            wrk->refresh_stats();
+        }
+        stats.refresh();
+    }
+
+    cvec_view get_solution() const
+    {
+        return cvec_view(solution);
+    }
+
+    // merged statistics of all ISD_generic workers
+    decoding_statistics get_stats() const
+    {
+        return stats;
+    }
+
+    // merged statistics of all subISD objects
+    decoding_statistics get_subISD_stats() const
+    {
+        decoding_statistics ret = subISDTs.front()->get_stats();
+        for (size_t i = 1; i < subISDTs.size(); ++i)
+            ret.merge(subISDTs[i]->get_stats());
+        return ret;
+    }
+
+private:
+    // first worker to report a solution wins
+    void publish_solution(ISD_t& wrk)
+    {
+        std::lock_guard<std::mutex> lock(solution_mutex);
+        if (stop_flag.load())
+            return;
+        solution = vec(wrk.get_solution());
+        stop_flag = true;
+    }
+
+    // run f on all workers in parallel, rethrow the first exception caught
+    template<typename F>
+    void run_workers(F&& f)
+    {
+        std::exception_ptr eptr;
+        std::mutex eptr_mutex;
+        worker_claims claims(placement, workers.size());
+        threadpool.run([&](int, int)
+            {
+                try
+                {
+                    size_t worker = claims.claim();
+                    placement.pin(worker);
+                    f(*workers[worker]);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(eptr_mutex);
+                    if (!eptr)
+                        eptr = std::current_exception();
+                    stop_flag = true;
+                }
+            }, int(workers.size()));
+        if (eptr)
+            std::rethrow_exception(eptr);
+    }
+
+    std::vector< std::unique_ptr<ISD_t> > workers;
+    std::vector< subISDT_t* > subISDTs;
+    thread_pool::thread_pool threadpool;
+    thread_placement placement;
+    mccl_base_random_generator rndgen;
+
+    std::atomic<bool> stop_flag;
+    std::mutex solution_mutex;
+    vec solution;
+
+    decoding_statistics stats;
+};
+
+
+// runs one producer thread that performs the ISD form updates and
+// one consumer thread per given subISD object that runs the subISD on snapshots of the ISD form
+// after each update the producer copies the ISD part (H12T, S & permutation) into the ISD form of a waiting consumer,
+// the consumers' own ISD forms are only allocated and never echelonized
+// useful when the subISD iteration is (much) more expensive than the update
+// with a thread placement set, consumer i uses placement.pin(i) and the producer uses placement.pin(consumers)
+template<typename subISDT_t = subISDT_API, size_t _bit_alignment = 256, bool _masked = false>
+class ISD_generic_pipeline
+    final : public syndrome_decoding_API
+{
+public:
+    typedef ISD_generic<subISDT_t, _bit_alignment, _masked> ISD_t;
+    typedef HST_ISD_form_t<_bit_alignment, _masked> HST_t;
+
+    // one subISD object per consumer thread, the subISD objects must outlive this object
+    ISD_generic_pipeline(const std::vector<subISDT_t*>& subISDs)
+        : config(ISD_generic_config_default), stats("ISD-generic-pipeline")
+    {
+        if (subISDs.empty())
+            throw std::runtime_error("ISD_generic_pipeline: need at least one subISD");
+        for (auto subISDptr : subISDs)
+        {
+            consumers.emplace_back(new ISD_t(*subISDptr));
+            consumers.back()->set_stop_flag(&stop_flag);
+        }
+        threadpool.resize(consumers.size());
+    }
+
+    // number of threads including the producer
+    size_t threads() const { return consumers.size() + 1; }
+
+    // set seed from which all seeds are derived
+    void seed(uint64_t s)
+    {
+        rndgen.seed(s);
+    }
+
+    void set_placement(const thread_placement& p)
+    {
+        placement = p;
+    }
+
+    void load_config(const configmap_t& configmap)
+    {
+        mccl::load_config(config, configmap);
+        for (auto& c : consumers)
+            c->load_config(configmap);
+    }
+    void save_config(configmap_t& configmap)
+    {
+        mccl::save_config(config, configmap);
+    }
+
+    void initialize(const cmat_view& H, const cvec_view& S, unsigned int w)
+    {
+        stop_flag = false;
+        solution = vec();
+        producer.seed(rndgen());
+        for (auto& c : consumers)
+            c->seed(rndgen());
+        // consumers only allocate their ISD form, in parallel so its memory is local to the consumer
+        run_workers([&](size_t worker)
+            {
+                if (worker < consumers.size())
+                    consumers[worker]->initialize_noreset(H, S, w);
+                else
+                    producer.reset(H, S, config.l);
+            });
+    }
+
+    // every consumer prepares its subISD on its own node, the producer has nothing to prepare
+    void prepare_loop(bool benchmark = false)
+    {
+        run_workers([&](size_t worker)
+            {
+                if (worker < consumers.size())
+                    consumers[worker]->prepare_loop(benchmark);
+            });
+    }
+
+    // process one snapshot per consumer, return true if a solution was found
+    bool loop_next()
+    {
+        run_pipeline(consumers.size());
+        return stop_flag;
+    }
+
+    void solve()
+    {
+        stats.cnt_solve.inc();
+        prepare_loop();
+        run_pipeline(0);
+        // merge only the counts since the previous solve
+        for (auto& c : consumers)
+        {
+            stats.merge(c->get_stats(), false);
+            c->refresh_stats();
+        }
+        stats.refresh();
+    }
+
+    cvec_view get_solution() const
+    {
+        return cvec_view(solution);
+    }
+
+    decoding_statistics get_stats() const
+    {
+        return stats;
+    }
+
+private:
+    // run producer & consumers until a solution is found or max_snapshots have been processed (0 = unlimited)
+    void run_pipeline(size_t max_snapshots)
+    {
+        stop_flag = false;
+        waiting.clear();
+        loaded.assign(consumers.size(), 0);
+        producer_done = false;
+        run_workers([&](size_t worker)
+            {
+                if (worker < consumers.size())
+                    consume(worker);
+                else
+                    produce(max_snapshots);
+            });
+    }
+
+    // run f(worker) for the consumers 0,...,consumers.size()-1 and the producer consumers.size() in parallel,
+    // each on a thread pinned to the node of its worker
+    // an exception stops the pipeline, the first exception caught is rethrown
+    template<typename F>
+    void run_workers(F&& f)
+    {
+        std::exception_ptr eptr;
+        std::mutex eptr_mutex;
+        worker_claims claims(placement, threads());
+        threadpool.run([&](int, int)
+            {
+                try
+                {
+                    size_t worker = claims.claim();
+                    placement.pin(worker);
+                    f(worker);
+                }
+                catch (...)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(eptr_mutex);
+                        if (!eptr)
+                            eptr = std::current_exception();
+                    }
+                    set_stop();
+                }
+            }, int(threads()));
+        if (eptr)
+            std::rethrow_exception(eptr);
+    }
+
+    void produce(size_t max_snapshots)
+    {
+        for (size_t cnt = 0; max_snapshots == 0 || cnt < max_snapshots; ++cnt)
+        {
+            producer.update(config.u, config.updatetype);
+            size_t c;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                consumer_waiting.wait(lock, [this](){ return stop_flag.load() || !waiting.empty(); });
+                if (stop_flag)
+                    break;
+                c = waiting.front();
+                waiting.pop_front();
+            }
+            // consumer c is idle until loaded[c] is set, so its ISD form can be written directly
+            consumers[c]->load_ISD_form(producer);
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                loaded[c] = 1;
+            }
+            form_loaded.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            producer_done = true;
+        }
+        form_loaded.notify_all();
+    }
+
+    void consume(size_t c)
+    {
+        ISD_t& consumer = *consumers[c];
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                waiting.push_back(c);
+            }
+            consumer_waiting.notify_one();
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                form_loaded.wait(lock, [this,c](){ return stop_flag.load() || producer_done || loaded[c]; });
+                if (stop_flag || !loaded[c])
+                    return;
+                loaded[c] = 0;
+            }
+            if (consumer.loop_next_noupdate())
+            {
+                publish_solution(consumer);
+                return;
+            }
+        }
+    }
+
+    void publish_solution(ISD_t& consumer)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (stop_flag)
+                return;
+            solution = vec(consumer.get_solution());
+            stop_flag = true;
+        }
+        consumer_waiting.notify_all();
+        form_loaded.notify_all();
+    }
+
+    void set_stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stop_flag = true;
+        }
+        consumer_waiting.notify_all();
+        form_loaded.notify_all();
+    }
+
+    ISD_generic_config_t config;
+
+    HST_t producer;
+    std::vector< std::unique_ptr<ISD_t> > consumers;
+    // consumers waiting for an ISD form, loaded[c] is set when consumer c has received one
+    std::deque<size_t> waiting;
+    std::vector<char> loaded;
+    bool producer_done;
+    std::mutex queue_mutex;
+    std::condition_variable consumer_waiting, form_loaded;
+
+    thread_pool::thread_pool threadpool;
+    thread_placement placement;
+    mccl_base_random_generator rndgen;
+
+    std::atomic<bool> stop_flag;
+    vec solution;
+
+    decoding_statistics stats;
+};
+
+MCCL_END_NAMESPACE
+
+#endif
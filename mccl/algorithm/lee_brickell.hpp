@@ -70,7 +70,7 @@ public:
     // API member function
     void initialize(const cmat_view& _H12T, size_t _H2Tcolumns, const cvec_view& _S, unsigned int w, callback_t _callback, void* _ptr) final
     {
-        if (stats.cnt_initialize._counter != 0)
+        if (stats.cnt_initialize.pending() != 0)
             stats.refresh();
         stats.cnt_initialize.inc();
         // copy parameters from current config
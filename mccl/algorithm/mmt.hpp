@@ -7,9 +7,14 @@
 #include <mccl/tools/unordered_multimap.hpp>
 #include <mccl/tools/bitfield.hpp>
 #include <mccl/tools/enumerate.hpp>
+#include <mccl/tools/sort_merge_join.hpp>
+#include <mccl/tools/packed_indices.hpp>
+#include <mccl/contrib/thread_pool.hpp>
 
-#include <unordered_map>
-#include <type_traits>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <memory>
 
 MCCL_BEGIN_NAMESPACE
 
@@ -24,20 +29,28 @@ struct mmt_config_t
         "\t\tPartition columns of H2 into two sets.\n"
 	"\t\tCompare p/2-columns sums from both sides.\n"
 	"\t\tReturn pairs that sum up to S2.\n"
+        "\tWith subthreads > 1 all phases are split over the threads by the first selected column:\n"
+        "\tthe base list is inserted concurrently in the l1 hashmap,\n"
+        "\tthe intermediate list is inserted concurrently in a fixed capacity hashmap.\n"
+        "\tWith sortmerge the intermediate and final lists are sorted and merged instead of matched with a hashmap.\n"
+        "\tThe l1 hashmap buckets are sized from the expected load unless bucketsize is given,\n"
+        "\tand grow when an element does not fit.\n"
         ;
 
     unsigned int p = 4;
     unsigned int l1 = 6;
-	unsigned int bucketsize = 10;
+    unsigned int bucketsize = 0;
+    unsigned int subthreads = 1;
+    bool sortmerge = false;
 
     template<typename Container>
     void process(Container& c)
     {
         c(p, "p", 4, "subISDT parameter p");
         c(l1, "l1", 6, "subISDT parameter l1");
-
-		// TODO one can compute this directly. 
-        c(bucketsize, "bucketsize", 10, "subISDT parameter bucketsize");
+        c(bucketsize, "bucketsize", 0, "Initial bucket size of the l1 hashmap (0 = from expected load)");
+        c(subthreads, "subthreads", 1, "Number of threads used within one subISDT iteration");
+        c(sortmerge, "sortmerge", false, "Match the intermediate list with a sort-merge join instead of a hashmap");
     }
 };
 
@@ -45,102 +58,94 @@ struct mmt_config_t
 // at construction of subISDT_mmt the current global default values will be loaded
 extern mmt_config_t mmt_config_default;
 
+// flat hash table of the base list on its lowest l1 bits: the key is the bucket index
+// all nrbuckets buckets of bucketsize elements are stored in one array
+// elements that do not fit in their full bucket are dropped and counted, so the caller can grow the buckets and refill
+// inserts in different buckets may be done concurrently, insert_concurrent may also be used for the same bucket
 template<
         typename keyType,
         typename valueType>
 class SimpleHashMap {
-    using data_type          = valueType;
-    using index_type         = size_t;
-
 public:
-    typedef keyType 	T;
-
-    typedef size_t 		LoadType;
-    typedef size_t 		IndexType;
-
-    // size per bucket
-    const size_t bucketsize;
-
-    // number of buckets
-    const size_t nrbuckets;
-
-    // total number of elements in the HM
-    const size_t total_size = bucketsize * nrbuckets;
+    typedef keyType     key_type;
+    typedef valueType   value_type;
+    typedef uint32_t    load_type;
 
-    using load_type = uint16_t;
+    SimpleHashMap()
+        : _bucketsize(0), _nrbuckets(0), _dropped(0)
+    {}
 
-	SimpleHashMap() = delete;
-    /// constructor. Zero initializing everything
-    SimpleHashMap(const size_t bucketsize, const size_t nrbuckets) noexcept :
-		bucketsize(bucketsize), nrbuckets(nrbuckets){
-    	__internal_hashmap_array.resize(total_size);
-    	__internal_load_array.resize(nrbuckets);
+    // resize to nrbuckets buckets of bucketsize elements and clear
+    void resize(size_t bucketsize, size_t nrbuckets)
+    {
+        if (bucketsize > size_t(~load_type(0)))
+            throw std::runtime_error("SimpleHashMap::resize(): bucketsize too large");
+        _bucketsize = bucketsize;
+        _nrbuckets = nrbuckets;
+        _data.resize(bucketsize * nrbuckets);
+        _load.resize(nrbuckets);
+        clear();
+    }
 
-	}
+    size_t bucketsize() const { return _bucketsize; }
+    size_t nrbuckets() const { return _nrbuckets; }
+    // number of elements dropped since the last clear
+    size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
 
-    /// \param e key element (hashed down = index within the internal array)
+    /// \param e key element (= bucket index)
     /// \param value element to insert
-    /// \param tid (ignored) can be anything
-    void insert(const keyType &e,
-                          const valueType value,
-                          const uint32_t tid) noexcept {
-        (void)tid;
-        insert(e, value);
-    }
-
-    /// \param e element to insert
-    /// \return nothing
-    void insert(const keyType &e, const valueType value) noexcept {
-        // hash down the element to the index
+    /// \return false if the bucket was full and the element has been dropped
+    bool insert(const keyType &e, const valueType &value) noexcept {
         const size_t index = e;
-        size_t load = __internal_load_array[index];
-
-        // early exit, if it's already full
-        if (load == bucketsize) {
-           return ;
+        const load_type load = _load[index];
+        if (load == _bucketsize) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
         }
+        _load[index] = load + 1;
+        _data[index*_bucketsize + load] = value;
+        return true;
+    }
 
-
-        // just some debugging checks
-        __internal_load_array[index] += 1;
-
-        /// NOTE: this store never needs to be atomic, as the position was
-        /// computed atomically.
-        if constexpr (std::is_array<data_type>::value) {
-            memcpy(__internal_hashmap_array[index*bucketsize + load], value, sizeof(data_type));
-        } else {
-            __internal_hashmap_array[index*bucketsize + load] = value;
+    /// insert that may be called concurrently for any bucket
+    /// a full bucket may be left with a load above bucketsize: if dropped() != 0 the map must be cleared before use
+    /// \return false if the bucket was full and the element has been dropped
+    bool insert_concurrent(const keyType &e, const valueType &value) noexcept {
+        const size_t index = e;
+        load_type load = __atomic_load_n(&_load[index], __ATOMIC_RELAXED);
+        if (load < _bucketsize)
+            load = __atomic_fetch_add(&_load[index], load_type(1), __ATOMIC_RELAXED);
+        if (load >= _bucketsize) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
         }
-
+        _data[index*_bucketsize + load] = value;
+        return true;
     }
 
-    /// \param e Element to hash down.
-    /// \return the position within the internal const_array of `e`
-    inline index_type find(const keyType &e) const noexcept {
-        const index_type index = e;
-        // return the index instead of the actual element, to
-        // reduce the size of the returned element.
-        return index*nrbuckets;
+    /// \return the position within the internal data array of the bucket of `e`
+    size_t find(const keyType &e) const noexcept {
+        return size_t(e) * _bucketsize;
     }
-
-    inline index_type find(const keyType &e, index_type &__load) const noexcept {
-        const index_type index = e;
-        __load = __internal_load_array[index];
-        // return the index instead of the actual element, to
-        // reduce the size of the returned element.
-        return index*nrbuckets;
+    size_t find(const keyType &e, size_t &load) const noexcept {
+        load = _load[size_t(e)];
+        return size_t(e) * _bucketsize;
     }
 
-    /// NOTE: can be called with only a single thread
-    /// overwrites the internal data const_array
-    /// with zero initialized elements.
+    // the elements in the bucket of `e`
+    const value_type* begin(const keyType &e) const noexcept { return _data.data() + find(e); }
+    const value_type* end(const keyType &e) const noexcept { return begin(e) + _load[size_t(e)]; }
+
     void clear() noexcept {
-        memset(__internal_load_array.data(), 0, nrbuckets*sizeof(load_type));
+        std::fill(_load.begin(), _load.end(), load_type(0));
+        _dropped = 0;
     }
 
-    // internal const_array
-    alignas(1024) std::vector<data_type> __internal_hashmap_array;
-    alignas(1024) std::vector<load_type> __internal_load_array;
+private:
+    size_t _bucketsize, _nrbuckets;
+    std::vector<value_type> _data;
+    std::vector<load_type> _load;
+    std::atomic<size_t> _dropped;
 };
 
 
@@ -149,9 +154,13 @@ class subISDT_mmt
     final : public subISDT_API
 {
 public:
+    typedef enumerate_chunk_t<uint32_t> chunk_t;
+
     using subISDT_API::callback_t;
-    using HMType = SimpleHashMap<uint64_t, 
-		  std::pair<uint32_t, uint32_t>>;
+    // l1 hashmap values: base list value and packed indices
+    using HMType = SimpleHashMap<uint64_t, std::pair<uint64_t, uint64_t>>;
+    typedef HMType::value_type HMValueType;
+    typedef sort_merge_join<uint64_t, uint64_t> sort_merge_join_t;
 
     // API member function
     ~subISDT_mmt() final
@@ -164,9 +173,9 @@ public:
             std::cerr << "prepare : " << cpu_prepareloop.total() << std::endl;
             std::cerr << "nextloop: " << cpu_loopnext.total() - cpu_callback.total() << std::endl;
             std::cerr << "callback: " << cpu_callback.total() << std::endl;
+            std::cerr << "hashmap grows: " << hashmap_grows << std::endl;
+            std::cerr << "Ihashmap grows: " << Ihashmap_grows << std::endl;
         }
-
-		delete hashmap;
     }
     
     subISDT_mmt()
@@ -182,6 +191,12 @@ public:
         mccl::save_config(config, configmap);
     }
 
+    // API member function
+    void seed(uint64_t s) final
+    {
+        rnd.seed(s);
+    }
+
     // API member function
     void initialize(const cmat_view& _H12T,
                     size_t _H2Tcolumns,
@@ -189,7 +204,7 @@ public:
                     unsigned int w,
                     callback_t _callback,
                     void* _ptr) final {
-        if (stats.cnt_initialize._counter != 0) {
+        if (stats.cnt_initialize.pending() != 0) {
             stats.refresh();
         }
         stats.cnt_initialize.inc();
@@ -206,6 +221,8 @@ public:
         // set attack parameters
         p1 = p/4;
         l1 = config.l1;
+        threads = std::max<unsigned>(1, config.subthreads);
+        sortmerge = config.sortmerge;
         rows = H12T.rows();
         rows1 = rows/2; rows2 = rows - rows1;
 
@@ -218,22 +235,47 @@ public:
             throw std::runtime_error("subISDT_mmt::initialize: MMT does not support l < 6 (since we use bitfield)");
         if (words > 1)
             throw std::runtime_error("subISDT_mmt::initialize: MMT does not support l > 64 (yet)");
-        if ( p1 > 3)
-            throw std::runtime_error("subISDT_mmt::initialize: MMT does not support p > 3 (yet)");
-        if (rows1 >= 65535 || rows2 >= 65535)
-            throw std::runtime_error("subISDT_mmt::initialize: MMT does not support rows1 or rows2 >= 65535");
+        if ( p1 > 4)
+            throw std::runtime_error("subISDT_mmt::initialize: MMT does not support p > 16 (yet)");
+        if (!index_packer::fits(rows, 2*p1))
+            throw std::runtime_error("subISDT_mmt::initialize: MMT cannot pack p/2 indices < rows in 64 bits");
         if (l1 >= columns)
             throw std::runtime_error("subISDT_mmt::initialize: MMT does not support l1 >= l");
 
         firstwordmask = detail::lastwordmask(columns);
         l1mask = detail::lastwordmask(l1);
-        helpermask = detail::lastwordmask(16*p1);
-		
-		hashmap_bucketsize = config.bucketsize;
-        hashmap = new HMType{hashmap_bucketsize, 1u << l1};
-
-        // TODO: compute a reasonable reserve size
-        // hashmap.reserve(...);
+        // base list elements pack p1 indices, intermediate and final list elements concatenate two of them
+        packer1.reset(rows, p1);
+        packer2.reset(rows, 2*p1);
+
+        // the base list of N0 elements is spread over 2^l1 buckets, a bucket has a Poisson distributed load:
+        // use a margin of 6 standard deviations, buckets grow if an element is dropped nonetheless
+        const double N0 = double(enumerate_t<uint32_t>::count_selections(rows2, p1) - 1);
+        const double N1 = double(enumerate_t<uint32_t>::count_selections(rows1, p1) - 1);
+        const double load = std::ldexp(N0, -int(l1));
+        size_t bucketsize = config.bucketsize;
+        if (bucketsize == 0)
+            bucketsize = size_t(std::ceil(load + 6 * std::sqrt(load))) + 8;
+        hashmap.resize(bucketsize, size_t(1) << l1);
+        hashmap_grows = 0;
+        // every one of the N1 other base list elements matches about load elements
+        Ihashmap.clear();
+        CIhashmap.clear();
+        if (threads > 1 && !sortmerge)
+            CIhashmap.reserve(size_t(N1 * load) + 1);
+        else if (!sortmerge)
+            Ihashmap.reserve(size_t(N1 * load) + 1);
+        Ihashmap_grows = 0;
+        join.set_key_bits(unsigned(columns - l1));
+
+        if (threads > 1)
+        {
+            thread_data.resize(threads);
+            chunks0 = enumerate_t<uint32_t>::split(rows2, p1, threads * chunks_per_thread);
+            chunks1 = enumerate_t<uint32_t>::split(rows1, p1, threads * chunks_per_thread);
+            if (!threadpool || threadpool->size() != threads-1)
+                threadpool.reset(new thread_pool::thread_pool(threads-1));
+        }
     }
 
     // API member function
@@ -255,12 +297,11 @@ public:
         for (unsigned i = 0; i < rows; ++i)
             firstwords[i] = (*H12T.word_ptr(i)) & firstwordmask;
         Sval = (*S.word_ptr()) & firstwordmask;
-        // TODO rand sucks
-        iTl = rand() & l1mask;
+        iTl = rnd() & l1mask;
         iTr = (Sval ^ iTl);
         
-        hashmap->clear();
         Ihashmap.clear();
+        join.clear();
     }
 
     // API member function
@@ -269,13 +310,19 @@ public:
         stats.cnt_loop_next.inc();
         MCCL_CPUCYCLE_STATISTIC_BLOCK(cpu_loopnext);
 
+        if (threads > 1)
+            return loop_next_parallel();
+
         // fill the first hashmap
-        enumerate.enumerate(firstwords.data()+0, firstwords.data()+rows2, p1,
-            [this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
-            {
-                hashmap->insert(val&l1mask,
-                                std::pair<uint32_t, uint32_t>(val, pack_indices(idxbegin, idxend)));
-            });
+        do
+        {
+            hashmap.clear();
+            enumerate.enumerate(firstwords.data()+0, firstwords.data()+rows2, p1,
+                [this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                {
+                    hashmap.insert(val & l1mask, HMValueType(val, pack_indices(idxbegin, idxend)));
+                });
+        } while (grow_hashmap());
 
         // fill the intermediate list
         enumerate.enumerate(firstwords.data()+rows2, firstwords.data()+rows, p1,
@@ -288,23 +335,30 @@ public:
                 for (auto it2 = idxbegin; it2 != idxend; ++it2,++it) {
                     *it = *it2 + rows2;
                 }
-                const uint64_t tmp = pack_indices(idx, it) << (p1*16);
-
-                const size_t hashmap_offset = val2*hashmap_bucketsize;
-                const size_t left_load = hashmap->__internal_load_array[val2];
-                for (auto iter = hashmap->__internal_hashmap_array.begin() + hashmap_offset;
-                     iter != hashmap->__internal_hashmap_array.begin() + hashmap_offset + left_load;
-                     iter++) {
+                const uint64_t tmp = pack_indices(idx, it) << packer1.total_bits();
 
+                for (auto iter = hashmap.begin(val2); iter != hashmap.end(val2); ++iter) {
                     const uint64_t val3 = val ^ iter->first;
-                    const uint64_t tmp2 = tmp ^ (iter->second & helpermask);
-                    Ihashmap.emplace(val3 >> l1, tmp2);
+                    const uint64_t tmp2 = tmp ^ iter->second;
+                    if (sortmerge)
+                        join.push_left(val3 >> l1, tmp2);
+                    else
+                        Ihashmap.queue_insert(val3 >> l1, tmp2);
                 }
             });
+        if (!sortmerge)
+            Ihashmap.finalize_insert();
 
         // find collisions on the right side of the tree
+        // the lookups are queued, so the hashmap buckets are prefetched, and the right indices are passed packed
+        bool stopped = false;
+        auto process_match = [this,&stopped](uintptr_t right_packed, uint64_t, uint64_t left_packed)
+            {
+                if (!stopped && !process_pair(idx+0, right_packed, left_packed))
+                    stopped = true;
+            };
         enumerate.enumerate(firstwords.data()+rows2, firstwords.data()+rows, p1,
-            [this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+            [&,this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
             {
                 val ^= iTr;
                 const uint64_t val2 = val & l1mask;
@@ -313,65 +367,234 @@ public:
                 for (auto it2 = idxbegin; it2 != idxend; ++it2,++it) {
                     *it = *it2 + rows2;
                 }
+                const uint64_t tmp = pack_indices(idx, it) << packer1.total_bits();
+
+                for (auto iter = hashmap.begin(val2); iter != hashmap.end(val2); ++iter) {
+                    const uint64_t val3 = (val ^ iter->first) >> l1;
+                    const uint64_t tmp2 = tmp ^ iter->second;
+                    if (sortmerge)
+                        join.push_right(val3, tmp2);
+                    else
+                        Ihashmap.queue_match(val3, uintptr_t(tmp2), process_match);
+                }
+                return !stopped;
+            });
+        if (sortmerge)
+            match_sortmerge();
+        else if (!stopped)
+            Ihashmap.finalize_match(process_match);
+        return false;
+    }
 
-                const size_t hashmap_offset = val2*hashmap_bucketsize;
-                const size_t left_load = hashmap->__internal_load_array[val2];
-                for (auto iter = hashmap->__internal_hashmap_array.begin() + hashmap_offset;
-                     iter != hashmap->__internal_hashmap_array.begin() + hashmap_offset + left_load;
-                     iter++) {
-
-                    uint64_t val3 = val^iter->first;
-                    val3 >>= l1;
-                    auto *it2 = unpack_indices(iter->second, it, 1);
+    // the l1 hashmap dropped elements: grow its buckets by half, so it can be refilled
+    bool grow_hashmap()
+    {
+        if (hashmap.dropped() == 0)
+            return false;
+        ++hashmap_grows;
+        hashmap.resize(hashmap.bucketsize() + hashmap.bucketsize()/2 + 1, hashmap.nrbuckets());
+        return true;
+    }
 
-                    auto range = Ihashmap.equal_range(val3);
-                    for (auto valit = range.first; valit != range.second; ++valit){
-                        uint64_t packed_indices = valit->second;
-                        auto *it3 = unpack_indices(packed_indices, it2, 2);
+    // CIhashmap is full and the intermediate list phase has been stopped:
+    // double its capacity, so it can be refilled
+    bool grow_Ihashmap()
+    {
+        if (!stop)
+            return false;
+        stop = false;
+        ++Ihashmap_grows;
+        CIhashmap._reserve(2 * CIhashmap.bucket_count() / CIhashmap.bucket_size);
+        return true;
+    }
 
-                        MCCL_CPUCYCLE_STATISTIC_BLOCK(cpu_callback);
-                        if (!(*callback)(ptr, idx+0, it3, 0)) {
-                            return false;
-                        }
-                    }
-                }
+    // pass the solution given by the packed indices of a final list element and an intermediate list element
+    // to the callback, using buffer buf
+    bool process_pair(uint32_t* buf, uint64_t right_packed, uint64_t left_packed)
+    {
+        uint32_t* it = packer2.unpack(right_packed, buf);
+        it = packer2.unpack(left_packed, it);
+        MCCL_CPUCYCLE_STATISTIC_BLOCK(cpu_callback);
+        return (*callback)(ptr, buf, it, 0);
+    }
 
-                return true;
+    // sort-merge join of the intermediate list (left) and the final list (right) on the l - l1 upper bits
+    // list values hold the packed indices of both base list elements
+    void match_sortmerge()
+    {
+        join.sort(threads > 1 ? threadpool.get() : nullptr);
+        join.match([this](uint64_t left_packed, uint64_t right_packed)
+            {
+                return process_pair(idx+0, right_packed, left_packed);
             });
-        return false;
     }
 
-    static uint64_t pack_indices(const uint32_t* begin, const uint32_t* end)
+    // multi-threaded version of loop_next:
+    // - all phases are split into balanced enumeration chunks that threads grab dynamically
+    // - base list elements are inserted concurrently into the l1 hashmap
+    // - intermediate list elements are inserted concurrently into CIhashmap
+    // - the final phase only reads CIhashmap, matches are buffered per thread and passed to the callback
+    //   in batches under a mutex, see flush_matches
+    // - with sortmerge the lists are stored in per-thread lists instead, whose pages are moved into the join afterwards
+    bool loop_next_parallel()
     {
-        uint64_t x = ~uint64_t(0);
-        for (; begin != end; ++begin)
+        stop = false;
+        const uint64_t* left = firstwords.data();
+        const uint64_t* right = firstwords.data()+rows2;
+
+        // fill the first hashmap
+        do
         {
-            x <<= 16;
-            x |= uint64_t(*begin);
+            hashmap.clear();
+            parallel_for_chunks(chunks0,
+                [&,this](thread_data_t& td, const chunk_t& chunk)
+                {
+                    return td.enumerate.enumerate_chunk(left, left+rows2, p1, chunk,
+                        [&,this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                        {
+                            hashmap.insert_concurrent(val & l1mask, HMValueType(val, pack_indices(idxbegin, idxend)));
+                        });
+                });
+        } while (grow_hashmap());
+
+        // fill the intermediate list
+        do
+        {
+            CIhashmap.clear();
+            parallel_for_chunks(chunks1,
+                [&,this](thread_data_t& td, const chunk_t& chunk)
+                {
+                    return td.enumerate.enumerate_chunk(right, right+rows1, p1, chunk,
+                        [&,this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                        {
+                            val ^= iTl;
+                            const uint64_t val2 = val & l1mask;
+
+                            auto it = td.idx;
+                            for (auto it2 = idxbegin; it2 != idxend; ++it2,++it)
+                                *it = *it2 + rows2;
+                            const uint64_t tmp = pack_indices(td.idx, it) << packer1.total_bits();
+
+                            for (auto iter = hashmap.begin(val2); iter != hashmap.end(val2); ++iter)
+                            {
+                                const uint64_t val3 = (val ^ iter->first) >> l1;
+                                if (sortmerge)
+                                    td.left.push_back(sort_merge_join_t::item_t{val3, tmp ^ iter->second});
+                                else if (!CIhashmap.insert(val3, tmp ^ iter->second))
+                                    return false;
+                            }
+                            return true;
+                        });
+                });
+        } while (grow_Ihashmap());
+        if (sortmerge)
+            for (auto& td : thread_data)
+                join.left().merge_unstable(std::move(td.left));
+
+        // find collisions on the right side of the tree
+        parallel_for_chunks(chunks1,
+            [&,this](thread_data_t& td, const chunk_t& chunk)
+            {
+                return td.enumerate.enumerate_chunk(right, right+rows1, p1, chunk,
+                    [&,this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                    {
+                        val ^= iTr;
+                        const uint64_t val2 = val & l1mask;
+
+                        uint32_t* it = td.idx;
+                        for (auto it2 = idxbegin; it2 != idxend; ++it2,++it)
+                            *it = *it2 + rows2;
+                        const uint64_t tmp = pack_indices(td.idx, it) << packer1.total_bits();
+
+                        for (auto iter = hashmap.begin(val2); iter != hashmap.end(val2); ++iter)
+                        {
+                            const uint64_t val3 = (val^iter->first) >> l1;
+                            const uint64_t tmp2 = tmp ^ iter->second;
+                            if (sortmerge)
+                            {
+                                td.right.push_back(sort_merge_join_t::item_t{val3, tmp2});
+                                continue;
+                            }
+                            CIhashmap.match(val3, [&](uint64_t left_packed)
+                                {
+                                    td.matches.emplace_back(tmp2, left_packed);
+                                });
+                        }
+                        return td.matches.size() < match_batch || flush_matches(td);
+                    }) && flush_matches(td);
+            });
+        if (sortmerge)
+        {
+            for (auto& td : thread_data)
+                join.right().merge_unstable(std::move(td.right));
+            match_sortmerge();
         }
-        return x;
+        return false;
     }
 
-    uint32_t* unpack_indices(uint64_t x, uint32_t* first, const uint32_t nr)
+    // call f(thread_data, chunk) for all chunks, threads grab the next chunk when done with the previous one
+    // f returns false to stop all threads
+    template<typename F>
+    void parallel_for_chunks(const std::vector<chunk_t>& chunks, F&& f)
     {
-        for (size_t i = 0; i < nr; ++i)
-        {
-            uint32_t y = uint32_t(x & 0xFFFF);
-            if (y == 0xFFFF)
-                break;
-            *first = y;
-            ++first;
-            x >>= 16;
-        }
-        return first;
+        std::atomic<size_t> next_chunk(0);
+        threadpool->run([&,this](int thread_id, int)
+            {
+                auto& td = thread_data[thread_id];
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    size_t c = next_chunk.fetch_add(1, std::memory_order_relaxed);
+                    if (c >= chunks.size())
+                        return;
+                    if (!f(td, chunks[c]))
+                    {
+                        stop = true;
+                        return;
+                    }
+                }
+            }, threads);
     }
 
+    uint64_t pack_indices(const uint32_t* begin, const uint32_t* end) const
+    {
+        return packer1.pack(begin, end);
+    }
 
     decoding_statistics get_stats() const { return stats; };
 
 
 private:
+    // number of enumeration chunks per thread, more chunks give better load balancing
+    static const size_t chunks_per_thread = 8;
+    // number of buffered final phase matches after which a thread takes callback_mutex
+    static const size_t match_batch = 256;
 
+    // per-thread enumeration state, buffered final phase matches and sortmerge lists
+    struct thread_data_t
+    {
+        enumerate_t<uint32_t> enumerate;
+        uint32_t idx[16];
+        std::vector< std::pair<uint64_t,uint64_t> > matches;
+        sort_merge_join_t::list_type left, right;
+    };
+
+    // pass the buffered matches (right packed, left packed) of a thread to the callback under callback_mutex
+    // the first callback that returns false sets stop, after which the remaining matches of all threads are dropped
+    bool flush_matches(thread_data_t& td)
+    {
+        if (td.matches.empty())
+            return !stop;
+        std::lock_guard<std::mutex> lock(callback_mutex);
+        for (auto& m : td.matches)
+        {
+            if (stop)
+                break;
+            if (!process_pair(td.idx+0, m.first, m.second))
+                stop = true;
+        }
+        td.matches.clear();
+        return !stop;
+    }
 
     callback_t callback;
     void* ptr;
@@ -382,7 +605,8 @@ private:
     enumerate_t<uint32_t> enumerate;
 
     std::vector<uint64_t> firstwords;
-    uint64_t firstwordmask, l1mask, helpermask, Sval, iTl, iTr;
+    uint64_t firstwordmask, l1mask, Sval, iTl, iTr;
+    index_packer packer1, packer2;
 
     uint32_t idx[16] = {0};
 
@@ -392,11 +616,23 @@ private:
     decoding_statistics stats;
     cpucycle_statistic cpu_prepareloop, cpu_loopnext, cpu_callback;
 
-    // std::unordered_multimap<uint64_t, uint64_t, StupidHasher, StupidCMP> hashmap;
-    HMType *hashmap;
-    std::unordered_multimap<uint64_t, uint64_t> Ihashmap;
-
-    size_t hashmap_bucketsize;
+    HMType hashmap;
+    size_t hashmap_grows = 0;
+    batch_unordered_multimap<uint64_t, uint64_t> Ihashmap;
+    // intermediate list of the multi-threaded version
+    concurrent_cacheline_unordered_multimap<uint64_t, uint64_t> CIhashmap;
+    size_t Ihashmap_grows = 0;
+    sort_merge_join_t join;
+    bool sortmerge;
+
+    unsigned threads;
+    std::vector<thread_data_t> thread_data;
+    std::vector<chunk_t> chunks0, chunks1;
+    std::unique_ptr<thread_pool::thread_pool> threadpool;
+    std::atomic<bool> stop;
+    std::mutex callback_mutex;
+
+    mccl_base_random_generator rnd;
 };
 
 
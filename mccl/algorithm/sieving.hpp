@@ -5,12 +5,18 @@
 #include <mccl/algorithm/decoding.hpp>
 #include <mccl/algorithm/isdgeneric.hpp>
 #include <mccl/tools/enumerate.hpp>
+#include <mccl/tools/packed_indices.hpp>
+#include <mccl/contrib/thread_pool.hpp>
 #include <unordered_set>
+#include <atomic>
+#include <memory>
 
 MCCL_BEGIN_NAMESPACE
 
-typedef std::array<uint32_t, 4> indexarray_t;
-typedef std::pair<indexarray_t, uint64_t> element_t;
+// element: sorted row indices packed by an index_packer of arity p, and the xor of their firstwords
+typedef std::pair<uint64_t, uint64_t> element_t;
+// maximum number of indices of an element
+static const size_t max_element_weight = 64;
 
 typedef std::array<uint32_t, 2> indexarray_t_center;
 typedef std::pair<indexarray_t_center, uint64_t> center_t;
@@ -24,11 +30,8 @@ struct element_hash_t
 	// we assume that the XOR of the H21T firstwords acts random and for practical purposes acts as identifier for the selection of row indices in e.first
 	return e.second;
 #else
-	// compute a hash value from the indices in e.first
-	std::size_t h = e.first[0];
-	for (unsigned i = 1; i < e.first.size(); ++i)
-		h ^= e.first[i] + 0x9e3779b9 + (seed<<6) + (seed>>2);
-	return h;
+	// compute a hash value from the packed indices in e.first
+	return e.first * 0x9E3779B97F4A7C15ULL;
 #endif	    
     }
 };
@@ -43,10 +46,13 @@ struct sieving_config_t
         "\tParameters: p\n"
         "\tAlgorithm:\n"
         "\t\tReturns all sets of at most p column indices of H2 that sum up to S2\n"
+        "\tWith subthreads > 1 bucketing is split over the threads by center\n"
+        "\tand checking by bucket, using per-thread output lists merged after each round.\n"
         ;
 
     size_t p = 4, alpha = 2, N = 400;
     std::string alg = "GJN";
+    unsigned int subthreads = 1;
 
     template<typename Container>
     void process(Container& c)
@@ -55,6 +61,7 @@ struct sieving_config_t
         c(alpha, "alpha", 2, "subISDT parameter alpha");
         c(N, "N", 400, "subISDT parameter N");
         c(alg, "alg", "GJN", "subISDT algorithm");
+        c(subthreads, "subthreads", 1, "Number of threads used within one subISDT iteration");
     }
 };
 
@@ -63,66 +70,39 @@ struct sieving_config_t
 extern sieving_config_t sieving_config_default;
 
 
-// intersect element x and y and returns the size of intersection 
-size_t intersection_elements(const element_t& x, const element_t& y, size_t w)
+// intersect the sorted indices x[0,x_w) and y[0,y_w) and returns the size of intersection
+inline size_t intersection_indices(const uint32_t* x, size_t x_w, const uint32_t* y, size_t y_w)
 {
     unsigned xi = 0, yi = 0, c = 0;
     while (true)
     {
-        // xi < element_weight AND yi < element_weight
-        if (x.first[xi] == y.first[yi])
-        {
-            ++c; ++xi; ++yi;
-            if (xi == w || yi == w)
-                return c;
-            continue;
-        }
-        if (x.first[xi] < y.first[yi])
-        {
-            ++xi;
-            if (xi == w)
-                return c;
-            continue;
-        }
-        // (x.first[xi] > y.first[yi])
-        ++yi;
-        if (yi == w)
-            return c;
-    }
-}
-
-size_t intersection_elements(const element_t& x, const center_t& y, size_t x_w, size_t y_w)
-{
-    unsigned xi = 0, yi = 0, c = 0;
-    while (true)
-    {
-        // xi < element_weight AND yi < element_weight
-        if (x.first[xi] == y.first[yi])
+        // xi < x_w AND yi < y_w
+        if (x[xi] == y[yi])
         {
             ++c; ++xi; ++yi;
             if (xi == x_w || yi == y_w)
                 return c;
             continue;
         }
-        if (x.first[xi] < y.first[yi])
+        if (x[xi] < y[yi])
         {
             ++xi;
             if (xi == x_w)
                 return c;
             continue;
         }
-        // (x.first[xi] > y.first[yi])
+        // (x[xi] > y[yi])
         ++yi;
         if (yi == y_w)
             return c;
     }
 }
 
-// combine element x and y into element dest: 
-// - assume x and y have element_weight indices
+// combine the sorted indices x and y into dest: 
+// - assume x and y have w indices
 // - returns true if intersection of x and y equals p - alpha
 // - dest contains the indices from x and y that occur exactly once (essentially x XOR y)
-bool combine_elements(const element_t& x, const element_t& y, element_t& dest, size_t w)
+inline bool combine_indices(const uint32_t* x, const uint32_t* y, uint32_t* dest, size_t w)
 {
     unsigned xi = 0, yi = 0, di = 0;
     while (true)
@@ -132,8 +112,7 @@ bool combine_elements(const element_t& x, const element_t& y, element_t& dest, s
             if (yi != di)
                 return false;
             for (; yi < w; ++yi, ++di)
-                dest.first[di] = y.first[yi];
-            dest.second = x.second ^ y.second;
+                dest[di] = y[yi];
             return true;
         }
         if (yi >= w)
@@ -141,45 +120,39 @@ bool combine_elements(const element_t& x, const element_t& y, element_t& dest, s
             if (xi != di)
                 return false;
             for (; xi < w; ++xi, ++di)
-                dest.first[di] = x.first[xi];
-            dest.second = x.second ^ y.second;
+                dest[di] = x[xi];
             return true;
         }
-        if (x.first[xi] == y.first[yi])
+        if (x[xi] == y[yi])
         {
             ++xi; ++yi;
             continue;
         }
-        if (x.first[xi] < y.first[yi])
+        if (x[xi] < y[yi])
         {
             if (di == w)
                 return false;
-            dest.first[di] = x.first[xi];
+            dest[di] = x[xi];
             ++xi; ++di;
             continue;
         }
-        // x.first[xi] > y.first[yi]
+        // x[xi] > y[yi]
         if (di == w)
             return false;
-        dest.first[di] = y.first[yi];
+        dest[di] = y[yi];
         ++yi; ++di;
     }
 }
 
 // sampling N random vectors of weight w:
-// INVARIANT1: element.second = xor_{i=0}^{elementweight-1} firstwords[element.first[i]];
-// INVARIANT2: element.first[0, ..., elementweight - 1] is a sorted array with values in[0, ..., rows - 1]
-void sample_vec(size_t element_weight, size_t rows, size_t output_length, const std::vector<uint64_t>& firstwords, mccl_base_random_generator rnd, database& output)
+// INVARIANT1: element.second = xor_{i=0}^{elementweight-1} firstwords[indices[i]];
+// INVARIANT2: indices[0, ..., elementweight - 1] is a sorted array with values in[0, ..., rows - 1], packed in element.first
+inline void sample_vec(size_t element_weight, size_t rows, size_t output_length, const std::vector<uint64_t>& firstwords, mccl_base_random_generator& rnd, const index_packer& packer, database& output)
 {
     output.clear();
 
-    uint64_t rnd_val;
     element_t element;
-
-    for (auto& i : element.first)
-    {
-        i = 0; i = ~i; // set all row indices to invalid positions
-    }
+    uint32_t indices[max_element_weight];
 
     while (output.size() < output_length)
     {
@@ -187,46 +160,46 @@ void sample_vec(size_t element_weight, size_t rows, size_t output_length, const
         unsigned k = 0;
         while (k < element_weight)
         {
-            element.first[k] = rnd() % rows;
+            indices[k] = rnd() % rows;
             // try both pieces of code
 #if 0
                 // binary search and with a single line of code (to check)
-            unsigned i = std::lower_bound(element.first.begin(), element.first.begin() + k) - element.first.begin();
+            unsigned i = std::lower_bound(indices, indices + k) - indices;
 #else
                 // linear search
             unsigned i = k;
             while (i > 0)
             {
-                if (element.first[i - 1] < element.first[k])
+                if (indices[i - 1] < indices[k])
                     break;
                 --i;
             }
 #endif
-            // PROPERTY: i is largest i such that (i==0) OR (element.first[i-1] < element.first[k])
-            // that means is the smallest i such that element.first[i] >= element.first[k] (otherwise i should be at least 1 larger)
-            // if element.first[i] == element.first[k] then we sample the same index twice and we need to resample element.first[k]
-            if (i < k && element.first[i] == element.first[k])
+            // PROPERTY: i is largest i such that (i==0) OR (indices[i-1] < indices[k])
+            // that means is the smallest i such that indices[i] >= indices[k] (otherwise i should be at least 1 larger)
+            // if indices[i] == indices[k] then we sample the same index twice and we need to resample indices[k]
+            if (i < k && indices[i] == indices[k])
                 continue;
             // update value
-            element.second ^= firstwords[element.first[k]];
+            element.second ^= firstwords[indices[k]];
             // now move k at position i
             if (i < k)
             {
-                auto firstk = element.first[k];
+                auto firstk = indices[k];
                 for (unsigned j = k; j > i; --j)
-                    element.first[j] = element.first[j - 1];
-                element.first[i] = firstk;
+                    indices[j] = indices[j - 1];
+                indices[i] = firstk;
             }
             ++k;
         }
         // already sorted and unique indices now
 #if 0            
         // sort indices
-        std::sort(element.first.begin(), element.first.begin() + element_weight);
+        std::sort(indices, indices + element_weight);
         // if there are any double occurences they appear next to each other
         bool ok = true;
         for (unsigned k = 1; k < element_weight; ++k)
-            if (element.first[k - 1] == element.first[k])
+            if (indices[k - 1] == indices[k])
             {
                 ok = false;
                 break;
@@ -235,6 +208,7 @@ void sample_vec(size_t element_weight, size_t rows, size_t output_length, const
         if (!ok)
             continue;
 #endif
+        element.first = packer.pack(indices, indices + element_weight);
         output.insert(element);
     }
 }
@@ -273,10 +247,16 @@ public:
         mccl::save_config(config, configmap);
     }
 
+    // API member function
+    void seed(uint64_t s) final
+    {
+        rnd.seed(s);
+    }
+
     // API member function
     void initialize(const cmat_view& _H12T, size_t _H2Tcolumns, const cvec_view& _S, unsigned int w, callback_t _callback, void* _ptr) final
     {
-        if (stats.cnt_initialize._counter != 0)
+        if (stats.cnt_initialize.pending() != 0)
             stats.refresh();
         stats.cnt_initialize.inc();
 
@@ -299,16 +279,27 @@ public:
         N = config.N;
         alpha = config.alpha;
         alg = config.alg;
+        threads = std::max<unsigned>(1, config.subthreads);
 
         // checks
         if (columns == 0)
             throw std::runtime_error("subISDT_sieving::initialize: sieving does not support l = 0");
         if (words > 1)
             throw std::runtime_error("subISDT_sieving::initialize(): sieving does not support l > 64");
+        if (!index_packer::fits(rows, p))
+            throw std::runtime_error("subISDT_sieving::initialize(): sieving cannot pack p indices < rows in 64 bits");
+        packer.reset(rows, p);
 
         // SE: Potentially add check configuration.
         firstwordmask = detail::lastwordmask(columns);
         padmask = ~firstwordmask;
+
+        if (threads > 1)
+        {
+            thread_lists.resize(threads);
+            if (!threadpool || threadpool->size() != threads-1)
+                threadpool.reset(new thread_pool::thread_pool(threads-1));
+        }
     }
 
     // API member function
@@ -340,7 +331,7 @@ public:
 
         // sampling N random vectors of weight p
         database listini;
-        sample_vec(p, rows, N, firstwords, rnd, listini);
+        sample_vec(p, rows, N, firstwords, rnd, packer, listini);
 
         // sampling centers
         std::vector<center_t> centers;
@@ -368,12 +359,17 @@ public:
             checking(buckets, Si, Si_mask, listout);
 #else
             element_t element_xy = *listini.begin();
+            uint32_t indices_x[max_element_weight], indices_y[max_element_weight], indices_xy[max_element_weight];
             for (const auto& element_x : listini)
             {
+                packer.unpack(element_x.first, indices_x);
                 for (const auto& element_y : listini)
                 {
-                    if (combine_elements(element_x, element_y, element_xy, p))
+                    packer.unpack(element_y.first, indices_y);
+                    if (combine_indices(indices_x, indices_y, indices_xy, p))
                     {
+                        element_xy.first = packer.pack(indices_xy, indices_xy + p);
+                        element_xy.second = element_x.second ^ element_y.second;
                         if ((element_xy.second & Si_mask) == Si || (element_xy.second & Si_mask) == 0)
                         {
                             listout.insert(element_xy);
@@ -410,8 +406,8 @@ public:
                 unsigned int wH1part = hammingweight(element.second & padmask);
                 MCCL_CPUCYCLE_STATISTIC_BLOCK(cpu_callback);
                 {
-                    const uint32_t* beginptr = &element.first[0];
-                    if (!(*callback)(ptr, beginptr, beginptr + p, 0))
+                    uint32_t indices[max_element_weight];
+                    if (!(*callback)(ptr, indices, packer.unpack(element.first, indices), 0))
                         return false;
                 }
             }
@@ -445,13 +441,21 @@ public:
 
     // routine for determining valid centers
     void find_valid_centers(const element_t& element, const std::vector<center_t>& centers, std::vector<size_t>& valid_centers)
+    {
+        find_valid_centers(element, centers, valid_centers, 0, centers.size());
+    }
+
+    // routine for determining valid centers among centers[cbegin,cend)
+    void find_valid_centers(const element_t& element, const std::vector<center_t>& centers, std::vector<size_t>& valid_centers, size_t cbegin, size_t cend)
     {
         valid_centers.clear();
         if (alg.compare("GJN") == 0)
         {
-            for (unsigned i = 0; i < centers.size(); ++i)
+            uint32_t indices[max_element_weight];
+            packer.unpack(element.first, indices);
+            for (size_t i = cbegin; i < cend; ++i)
             {
-                if(intersection_elements(element, centers[i], p, alpha) == alpha)
+                if(intersection_indices(indices, p, centers[i].first.data(), alpha) == alpha)
                     valid_centers.push_back(i);
             }
         }
@@ -468,6 +472,24 @@ public:
         for (auto& b : buckets)
             b.clear();
 
+        if (threads > 1)
+        {
+            // each thread handles a contiguous range of centers, so each bucket is written by one thread only
+            threadpool->run([&,this](int thread_id, int thread_count)
+                {
+                    size_t cbegin = centers.size() * thread_id / thread_count;
+                    size_t cend = centers.size() * (thread_id + 1) / thread_count;
+                    std::vector<size_t> valid_centers;
+                    for (const auto& element : listin)
+                    {
+                        find_valid_centers(element, centers, valid_centers, cbegin, cend);
+                        for (const auto& vc : valid_centers)
+                            buckets[vc].push_back(element);
+                    }
+                }, threads);
+            return;
+        }
+
         std::vector<size_t> valid_centers;
         for (const auto& element : listin)
         {
@@ -482,17 +504,27 @@ public:
     // checking routine
     void checking(const std::vector<std::vector<element_t>>& buckets, uint64_t Si, uint64_t Si_mask, database& listout)
     {
+        if (threads > 1)
+        {
+            checking_parallel(buckets, Si, Si_mask, listout);
+            return;
+        }
         element_t element_new;
+        uint32_t indices_j[max_element_weight], indices_k[max_element_weight], indices_new[max_element_weight];
         for (const auto& bucket : buckets)
         {
             if (bucket.size() == 0)
                 continue;
             for (size_t j = 0; j < bucket.size() - 1; ++j)
             {
+                packer.unpack(bucket[j].first, indices_j);
                 for (size_t k = j + 1; k < bucket.size(); ++k)
                 {
-                    if (combine_elements(bucket[j], bucket[k], element_new, p))
+                    packer.unpack(bucket[k].first, indices_k);
+                    if (combine_indices(indices_j, indices_k, indices_new, p))
                     {
+                        element_new.first = packer.pack(indices_new, indices_new + p);
+                        element_new.second = bucket[j].second ^ bucket[k].second;
                         if (listout.count(element_new) > 0)
                             continue;
                         if ((element_new.second & Si_mask) == Si || (element_new.second & Si_mask) == 0)
@@ -503,6 +535,52 @@ public:
         }
     }
 
+    // multi-threaded checking routine:
+    // threads grab chunks of buckets and store new elements in thread-local lists
+    // listout is only read during the parallel phase, the thread-local lists are merged into it afterwards
+    void checking_parallel(const std::vector<std::vector<element_t>>& buckets, uint64_t Si, uint64_t Si_mask, database& listout)
+    {
+        const size_t chunk_size = 16;
+        std::atomic<size_t> next_bucket(0);
+        threadpool->run([&,this](int thread_id, int)
+            {
+                auto& out = thread_lists[thread_id];
+                out.clear();
+                element_t element_new;
+                uint32_t indices_j[max_element_weight], indices_k[max_element_weight], indices_new[max_element_weight];
+                while (true)
+                {
+                    size_t bbegin = next_bucket.fetch_add(chunk_size);
+                    if (bbegin >= buckets.size())
+                        break;
+                    size_t bend = std::min(bbegin + chunk_size, buckets.size());
+                    for (size_t b = bbegin; b < bend; ++b)
+                    {
+                        const auto& bucket = buckets[b];
+                        for (size_t j = 0; j + 1 < bucket.size(); ++j)
+                        {
+                            packer.unpack(bucket[j].first, indices_j);
+                            for (size_t k = j + 1; k < bucket.size(); ++k)
+                            {
+                                packer.unpack(bucket[k].first, indices_k);
+                                if (combine_indices(indices_j, indices_k, indices_new, p))
+                                {
+                                    element_new.first = packer.pack(indices_new, indices_new + p);
+                                    element_new.second = bucket[j].second ^ bucket[k].second;
+                                    if (listout.count(element_new) > 0)
+                                        continue;
+                                    if ((element_new.second & Si_mask) == Si || (element_new.second & Si_mask) == 0)
+                                        out.push_back(element_new);
+                                }
+                            }
+                        }
+                    }
+                }
+            }, threads);
+        for (auto& out : thread_lists)
+            listout.insert(out.begin(), out.end());
+    }
+
     // resampling
     void resample(database& listout, size_t N)
     {
@@ -530,6 +608,7 @@ private:
 
     std::vector<uint64_t> firstwords;
     uint64_t firstwordmask, padmask, Sval;
+    index_packer packer;
 
     enumerate_t<uint32_t> enumerate;
 
@@ -541,6 +620,10 @@ private:
     cpucycle_statistic cpu_prepareloop, cpu_loopnext, cpu_callback;
 
 	mccl_base_random_generator rnd;
+
+    unsigned threads;
+    std::vector< std::vector<element_t> > thread_lists;
+    std::unique_ptr<thread_pool::thread_pool> threadpool;
 };
 
 template<size_t _bit_alignment = 64>
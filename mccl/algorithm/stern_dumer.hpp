@@ -7,8 +7,14 @@
 #include <mccl/tools/unordered_multimap.hpp>
 #include <mccl/tools/bitfield.hpp>
 #include <mccl/tools/enumerate.hpp>
+#include <mccl/tools/sort_merge_join.hpp>
+#include <mccl/tools/packed_indices.hpp>
+#include <mccl/contrib/thread_pool.hpp>
 
-#include <unordered_map>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <memory>
 
 MCCL_BEGIN_NAMESPACE
 
@@ -21,14 +27,20 @@ struct stern_dumer_config_t
         "\tParameters: p\n"
         "\tAlgorithm:\n"
         "\t\tPartition columns of H2 into two sets.\n\t\tCompare p/2-columns sums from both sides.\n\t\tReturn pairs that sum up to S2.\n"
+        "\tWith subthreads > 1 each stage is split over the threads by the first selected column.\n"
+        "\tWith sortmerge both tables are sorted and merged instead of matched with a bitfield and hashmap.\n"
         ;
 
     unsigned int p = 4;
+    unsigned int subthreads = 1;
+    bool sortmerge = false;
 
     template<typename Container>
     void process(Container& c)
     {
         c(p, "p", 4, "subISDT parameter p");
+        c(subthreads, "subthreads", 1, "Number of threads used within one subISDT iteration");
+        c(sortmerge, "sortmerge", false, "Match the tables with a sort-merge join instead of bitfield and hashmap");
     }
 };
 
@@ -42,6 +54,9 @@ class subISDT_stern_dumer
     final : public subISDT_API
 {
 public:
+    typedef enumerate_chunk_t<uint32_t> chunk_t;
+    typedef sort_merge_join<uint64_t, uint64_t> sort_merge_join_t;
+
     using subISDT_API::callback_t;
 
     // API member function
@@ -75,7 +90,7 @@ public:
     // API member function
     void initialize(const cmat_view& _H12T, size_t _H2Tcolumns, const cvec_view& _S, unsigned int w, callback_t _callback, void* _ptr) final
     {
-        if (stats.cnt_initialize._counter != 0)
+        if (stats.cnt_initialize.pending() != 0)
             stats.refresh();
         stats.cnt_initialize.inc();
 
@@ -89,6 +104,8 @@ public:
 
         // copy parameters from current config
         p = config.p;
+        threads = std::max<unsigned>(1, config.subthreads);
+        sortmerge = config.sortmerge;
         // set attack parameters
         p1 = p/2; p2 = p - p1;
         rows = H12T.rows();
@@ -105,16 +122,41 @@ public:
             throw std::runtime_error("subISDT_stern_dumer::initialize: Stern/Dumer does not support l > 64 (yet)");
         if ( p > 8)
             throw std::runtime_error("subISDT_stern_dumer::initialize: Stern/Dumer does not support p > 8 (yet)");
-        if (rows1 >= 65535 || rows2 >= 65535)
-            throw std::runtime_error("subISDT_stern_dumer::initialize: Stern/Dumer does not support rows1 or rows2 >= 65535");
+        if (!index_packer::fits(rows2, p2))
+            throw std::runtime_error("subISDT_stern_dumer::initialize: Stern/Dumer cannot pack p/2 indices < rows/2 in 64 bits");
+        packer.reset(rows2, p2);
 
         firstwordmask = detail::lastwordmask(columns);
         padmask = ~firstwordmask;
         
+        if (sortmerge)
+            join.set_key_bits(unsigned(columns));
+        else
+            init_hashing();
+
+        if (threads > 1)
+        {
+            thread_data.resize(threads);
+            chunks1 = enumerate_t<uint32_t>::split(rows1, p1, threads * chunks_per_thread);
+            chunks2 = enumerate_t<uint32_t>::split(rows2, p2, threads * chunks_per_thread);
+            if (!threadpool || threadpool->size() != threads-1)
+                threadpool.reset(new thread_pool::thread_pool(threads-1));
+        }
+    }
+
+    // size bitfield & hashmap of the hashing version of loop_next
+    void init_hashing()
+    {
         bitfield.resize(columns);
 
-        // TODO: compute a reasonable reserve size
-        // hashmap.reserve(...);
+        // the hashmap stores the right-table values that collide with the left-table in the bitfield:
+        // each of the N2 right values collides with one of the N1 left values with probability about 1 - exp(-N1 / 2^l)
+        // count_selections includes the empty selection, which enumerate_t does not enumerate
+        const double N1 = double(enumerate_t<uint32_t>::count_selections(rows1, p1) - 1);
+        const double N2 = double(enumerate_t<uint32_t>::count_selections(rows2, p2) - 1);
+        const double expected_collisions = N2 * -std::expm1(-N1 / std::ldexp(1.0, int(columns)));
+        hashmap.clear();
+        hashmap.reserve(size_t(expected_collisions) + 1);
     }
 
     // API member function
@@ -137,8 +179,13 @@ public:
             firstwords[i] = (*H12T.word_ptr(i)) & firstwordmask;
         Sval = (*S.word_ptr()) & firstwordmask;
         
-        bitfield.clear();
-        hashmap.clear();
+        if (sortmerge)
+            join.clear();
+        else
+        {
+            bitfield.clear();
+            hashmap.clear();
+        }
     }
 
     // API member function
@@ -147,6 +194,11 @@ public:
         stats.cnt_loop_next.inc();
         MCCL_CPUCYCLE_STATISTIC_BLOCK(cpu_loopnext);
 
+        if (sortmerge)
+            return loop_next_sortmerge();
+        if (threads > 1)
+            return loop_next_parallel();
+
         // stage 1: store left-table in bitfield
         enumerate.enumerate_val(firstwords.data()+rows2, firstwords.data()+rows, p1,
             [this](uint64_t val)
@@ -160,64 +212,227 @@ public:
             {
                 val ^= Sval;
                 if (bitfield.stage2(val))
-                    hashmap.emplace(val, pack_indices(idxbegin,idxend) );
+                    hashmap.queue_insert(val, pack_indices(idxbegin,idxend));
             });
+        hashmap.finalize_insert();
         // stage 3: retrieve matches from left-table and process
+        // the lookups are queued, so the hashmap buckets are prefetched, and the left indices are passed packed
+        bool stopped = false;
+        auto process_match = [this,&stopped](uintptr_t left_packed, uint64_t, uint64_t right_packed)
+            {
+                if (stopped)
+                    return;
+                // note that left-table indices are offset rows2 in firstwords
+                uint32_t* it = unpack_indices(left_packed, idx+0, uint32_t(rows2));
+                it = unpack_indices(right_packed, it);
+                MCCL_CPUCYCLE_STATISTIC_BLOCK(cpu_callback);
+                if (!(*callback)(ptr, idx+0, it, 0))
+                    stopped = true;
+            };
         enumerate.enumerate(firstwords.data()+rows2, firstwords.data()+rows, p1,
-            [this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+            [&,this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
             {
                 if (bitfield.stage3(val))
-                {
-                    uint32_t* it = idx+0;
-                    // note that left-table indices are offset rows2 in firstwords
-                    for (auto it2 = idxbegin; it2 != idxend; ++it2,++it)
-                        *it = *it2 + rows2;
-                    auto range = hashmap.equal_range(val);
-                    for (auto valit = range.first; valit != range.second; ++valit)
-                    {
-                        if (valit->first != val)
-                            throw;
-                        uint64_t packed_indices = valit->second;
-                        auto it2 = unpack_indices(packed_indices, it);
-
-                        MCCL_CPUCYCLE_STATISTIC_BLOCK(cpu_callback);
-                        if (!(*callback)(ptr, idx+0, it2, 0))
-                            return false;
-                    }
-                }
-                return true;
+                    hashmap.queue_match(val, uintptr_t(pack_indices(idxbegin,idxend)), process_match);
+                return !stopped;
             });
+        if (!stopped)
+            hashmap.finalize_match(process_match);
         return false;
     }
     
-    static uint64_t pack_indices(const uint32_t* begin, const uint32_t* end)
+    // multi-threaded version of loop_next:
+    // - the enumeration is split into balanced chunks that threads grab dynamically
+    // - stage 1 & 2 update the bitfield atomically
+    // - stage 2 stores matches in per-thread buffers, that are merged into the hashmap afterwards
+    // - stage 3 only reads bitfield & hashmap with unqueued matches, matches are buffered per thread
+    //   and passed to the callback in batches under a mutex, see flush_matches
+    bool loop_next_parallel()
+    {
+        stop = false;
+        const uint64_t* left = firstwords.data()+rows2;
+        const uint64_t* right = firstwords.data();
+        // stage 1: store left-table in bitfield
+        parallel_for_chunks(chunks1,
+            [&,this](thread_data_t& td, const chunk_t& chunk)
+            {
+                return td.enumerate.enumerate_chunk_val(left, left+rows1, p1, chunk,
+                    [this](uint64_t val)
+                    {
+                        bitfield.stage1_atomic(val);
+                    });
+            });
+        // stage 2: compare right-table with bitfield: store matches
+        for (auto& td : thread_data)
+            td.collisions.clear();
+        parallel_for_chunks(chunks2,
+            [&,this](thread_data_t& td, const chunk_t& chunk)
+            {
+                return td.enumerate.enumerate_chunk(right, right+rows2, p2, chunk,
+                    [&,this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                    {
+                        val ^= Sval;
+                        if (bitfield.stage2_atomic(val))
+                            td.collisions.emplace_back(val, pack_indices(idxbegin,idxend));
+                    });
+            });
+        for (auto& td : thread_data)
+            for (auto& vi : td.collisions)
+                hashmap.queue_insert(vi.first, vi.second);
+        hashmap.finalize_insert();
+        // stage 3: retrieve matches from left-table and process
+        parallel_for_chunks(chunks1,
+            [&,this](thread_data_t& td, const chunk_t& chunk)
+            {
+                return td.enumerate.enumerate_chunk(left, left+rows1, p1, chunk,
+                    [&,this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                    {
+                        if (!bitfield.stage3(val))
+                            return true;
+                        const uint64_t left_packed = pack_indices(idxbegin,idxend);
+                        hashmap.match(val, [&](uint64_t right_packed)
+                            {
+                                td.matches.emplace_back(left_packed, right_packed);
+                            });
+                        return td.matches.size() < match_batch || flush_matches(td);
+                    }) && flush_matches(td);
+            });
+        return false;
+    }
+
+    // sort-merge join version of loop_next:
+    // both tables are stored as (value, packed indices) lists, which are sorted on value and merged
+    // with subthreads > 1 the tables are filled in per-thread lists that are merged before sorting,
+    // and the lists are sorted with the parallel sort
+    bool loop_next_sortmerge()
     {
-        uint64_t x = ~uint64_t(0);
-        for (; begin != end; ++begin)
+        stop = false;
+        join.clear();
+        const uint64_t* left = firstwords.data()+rows2;
+        const uint64_t* right = firstwords.data();
+        if (threads > 1)
         {
-            x <<= 16;
-            x |= uint64_t(*begin);
+            parallel_for_chunks(chunks1,
+                [&,this](thread_data_t& td, const chunk_t& chunk)
+                {
+                    return td.enumerate.enumerate_chunk(left, left+rows1, p1, chunk,
+                        [&](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                        {
+                            td.left.push_back(sort_merge_join_t::item_t{val, pack_indices(idxbegin,idxend)});
+                        });
+                });
+            parallel_for_chunks(chunks2,
+                [&,this](thread_data_t& td, const chunk_t& chunk)
+                {
+                    return td.enumerate.enumerate_chunk(right, right+rows2, p2, chunk,
+                        [&,this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                        {
+                            td.right.push_back(sort_merge_join_t::item_t{val ^ Sval, pack_indices(idxbegin,idxend)});
+                        });
+                });
+            for (auto& td : thread_data)
+            {
+                join.left().merge_unstable(std::move(td.left));
+                join.right().merge_unstable(std::move(td.right));
+            }
         }
-        return x;
+        else
+        {
+            enumerate.enumerate(left, left+rows1, p1,
+                [this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                {
+                    join.push_left(val, pack_indices(idxbegin,idxend));
+                });
+            enumerate.enumerate(right, right+rows2, p2,
+                [this](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+                {
+                    join.push_right(val ^ Sval, pack_indices(idxbegin,idxend));
+                });
+        }
+        join.sort(threads > 1 ? threadpool.get() : nullptr);
+        join.match([this](uint64_t left_packed, uint64_t right_packed)
+            {
+                // note that left-table indices are offset rows2 in firstwords
+                uint32_t* it = unpack_indices(left_packed, idx+0, uint32_t(rows2));
+                it = unpack_indices(right_packed, it);
+                MCCL_CPUCYCLE_STATISTIC_BLOCK(cpu_callback);
+                return (*callback)(ptr, idx+0, it, 0);
+            });
+        return false;
+    }
+
+    // call f(thread_data, chunk) for all chunks, threads grab the next chunk when done with the previous one
+    // f returns false to stop all threads
+    template<typename F>
+    void parallel_for_chunks(const std::vector<chunk_t>& chunks, F&& f)
+    {
+        std::atomic<size_t> next_chunk(0);
+        threadpool->run([&,this](int thread_id, int)
+            {
+                auto& td = thread_data[thread_id];
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    size_t c = next_chunk.fetch_add(1, std::memory_order_relaxed);
+                    if (c >= chunks.size())
+                        return;
+                    if (!f(td, chunks[c]))
+                    {
+                        stop = true;
+                        return;
+                    }
+                }
+            }, threads);
+    }
+
+    uint64_t pack_indices(const uint32_t* begin, const uint32_t* end) const
+    {
+        return packer.pack(begin, end);
     }
     
-    uint32_t* unpack_indices(uint64_t x, uint32_t* first)
+    uint32_t* unpack_indices(uint64_t x, uint32_t* first, uint32_t offset = 0) const
     {
-        for (size_t i = 0; i < 4; ++i)
-        {
-            uint32_t y = uint32_t(x & 0xFFFF);
-            if (y == 0xFFFF)
-                break;
-            *first = y;
-            ++first;
-            x >>= 16;
-        }
-        return first;
+        return packer.unpack(x, first, offset);
     }
 
     decoding_statistics get_stats() const { return stats; };
 
 private:
+    // number of enumeration chunks per thread, more chunks give better load balancing
+    static const size_t chunks_per_thread = 8;
+    // number of buffered stage 3 matches after which a thread takes callback_mutex
+    static const size_t match_batch = 256;
+
+    // per-thread enumeration state, stage 2 collision buffer, stage 3 match buffer and sort-merge tables
+    struct thread_data_t
+    {
+        enumerate_t<uint32_t> enumerate;
+        uint32_t idx[16];
+        std::vector< std::pair<uint64_t,uint64_t> > collisions, matches;
+        sort_merge_join_t::list_type left, right;
+    };
+
+    // pass the buffered stage 3 matches (left packed, right packed) of a thread to the callback under callback_mutex
+    // the first callback that returns false sets stop, after which the remaining matches of all threads are dropped
+    bool flush_matches(thread_data_t& td)
+    {
+        if (td.matches.empty())
+            return !stop;
+        std::lock_guard<std::mutex> lock(callback_mutex);
+        for (auto& m : td.matches)
+        {
+            if (stop)
+                break;
+            // note that left-table indices are offset rows2 in firstwords
+            uint32_t* it = unpack_indices(m.first, td.idx+0, uint32_t(rows2));
+            it = unpack_indices(m.second, it);
+            MCCL_CPUCYCLE_STATISTIC_BLOCK(cpu_callback);
+            if (!(*callback)(ptr, td.idx+0, it, 0))
+                stop = true;
+        }
+        td.matches.clear();
+        return !stop;
+    }
+
     callback_t callback;
     void* ptr;
     cmat_view H12T;
@@ -225,8 +440,12 @@ private:
     size_t columns, words;
     unsigned int wmax;
     
+    // packing of the indices of a table element, wide enough for both tables
+    index_packer packer;
     staged_bitfield<false,false> bitfield;
-    std::unordered_multimap<uint64_t, uint64_t> hashmap;
+    batch_unordered_multimap<uint64_t, uint64_t> hashmap;
+    sort_merge_join_t join;
+    bool sortmerge;
     
     enumerate_t<uint32_t> enumerate;
     uint32_t idx[16];
@@ -235,6 +454,13 @@ private:
     uint64_t firstwordmask, padmask, Sval;
     
     size_t p, p1, p2, rows, rows1, rows2;
+
+    unsigned threads;
+    std::vector<thread_data_t> thread_data;
+    std::vector<chunk_t> chunks1, chunks2;
+    std::unique_ptr<thread_pool::thread_pool> threadpool;
+    std::atomic<bool> stop;
+    std::mutex callback_mutex;
     
     stern_dumer_config_t config;
     decoding_statistics stats;
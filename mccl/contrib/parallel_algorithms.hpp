@@ -129,11 +129,16 @@ namespace parallel_algorithms {
 
 	// basic iterator: an std::size_t integer that behaves as an iterator
 	class range_iterator
-		: public std::iterator<std::random_access_iterator_tag, const std::size_t>
 	{
 		std::size_t _i;
 
 	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef const std::size_t value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const std::size_t* pointer;
+		typedef const std::size_t& reference;
+
 		range_iterator(std::size_t i = 0): _i(i) {}
 
 		bool operator== (const range_iterator& r) const { return _i == r._i; }
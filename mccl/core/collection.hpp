@@ -12,6 +12,7 @@
 #include <array>
 #include <vector>
 #include <deque>
+#include <unordered_map>
 #include <algorithm>
 #include <iterator>
 #include <atomic>
@@ -22,7 +23,7 @@ MCCL_BEGIN_NAMESPACE
 namespace detail
 {
 	// pointers should be allocated through aligned_alloc:
-	void* mccl_aligned_alloc(std::size_t size, std::size_t alignment)
+	inline void* mccl_aligned_alloc(std::size_t size, std::size_t alignment)
 	{
 #if 1
 		return ::aligned_alloc(alignment, size);
@@ -41,8 +42,8 @@ namespace detail
 #endif
 	}
 	
-	// pointers should be freed through aligned_free:
-	void mccl_aligned_free(void* p)
+	// pointers should be freed through mccl_aligned_dealloc:
+	inline void mccl_aligned_dealloc(void* p)
 	{
 		::free( p );
 	}
@@ -109,7 +110,19 @@ namespace detail
 		queue_type _queue;
 	};
 	
+	// index of the NUMA node of the calling thread, selects its free page pool in mccl_page_allocator
+	// set by thread_placement::pin (mccl/tools/numa.hpp), size_t(-1) for threads that were never pinned
+	inline std::size_t& mccl_page_node()
+	{
+		static thread_local std::size_t node = std::size_t(-1);
+		return node;
+	}
+
 	// memory allocator pool for fixed size pages
+	// there is a free page pool per NUMA node: a freed page returns to the pool of the node it was allocated on
+	// and is only reused by threads on that node, regardless of the thread that frees it
+	// a pinned thread touches the pages it allocates, so they are placed on its node
+	// threads that were never pinned share pool 0
 	// do not use page_allocator before static members have been initialized
 	// freeing pages after end of main (i.e. during static deconstructors) leads to undefined behaviour
 	template<std::size_t PageSize = (1<<20)>
@@ -118,63 +131,82 @@ namespace detail
 		typedef mccl_concurrent_queue<void*> queue_type;
 
 		static const std::size_t page_size = PageSize;
+		static const std::size_t max_nodes = 64;
 
 		static constexpr std::size_t page_alignment() { return _page_alignment; }
 		
-		// obtain page from free page pool, otherwise allocate a new one
+		// obtain page from the free page pool of the node of the calling thread, otherwise allocate a new one
 		static void* alloc_page()
 		{
+			const std::size_t pool = current_pool();
 			void* p = nullptr;
-			if (! _helper._queue.try_pop_front(p))
+			if (! _helper._queues[pool].try_pop_front(p))
 			{
-#if 1
-				// allocate per page
 				p = mccl_aligned_alloc(page_size, _page_alignment);
-#else
-				// allocate multiple pages at once
+				// first touch from the pinned thread, its memory policy places the page on its node
+				if (mccl_page_node() != std::size_t(-1))
+					for (std::size_t x = 0; x < page_size; x += _touch_stride)
+						static_cast<volatile char*>(p)[x] = 0;
 				std::lock_guard<std::mutex> lock(_helper._mutex);
-				if (!_helper._queue.try_pop_front(p))
-				{
-					const std::size_t alloc_size = page_size * 32;
-					p = mccl_aligned_alloc(alloc_size, _page_alignment);
-					for (std::size_t x = page_size; x < alloc_size; x += page_size)
-						_helper._queue.emplace_back(p + x);
-				}
-#endif
+				_helper._page_pool[p] = pool;
 			}
 			return p;
 		}
 
-		// free pages go into pool, not actually freed
+		// free pages go into the pool of the node they were allocated on, not actually freed
 		static void free_page(void* p)
 		{
-			_helper._queue.push_back(p);
+			std::size_t pool = 0;
+			{
+				std::lock_guard<std::mutex> lock(_helper._mutex);
+				auto it = _helper._page_pool.find(p);
+				if (it != _helper._page_pool.end())
+					pool = it->second;
+			}
+			_helper._queues[pool].push_back(p);
+		}
+
+		// free page pool used by the calling thread
+		static std::size_t current_pool()
+		{
+			const std::size_t node = mccl_page_node();
+			return (node == std::size_t(-1)) ? 0 : node % max_nodes;
 		}
 		
 	private:
 		static const std::size_t _page_alignment = 64;
+		// smallest OS page size, touching one byte per OS page faults in the whole page
+		static const std::size_t _touch_stride = 4096;
 
 		// freed pages are not returned to heap
-		// but stored in queue for future page allocations instead
+		// but stored in queues for future page allocations instead
 		// only at program end all pages are freed
 		struct _static_helper {
-			// concurrent queue to store freed pages
-			queue_type _queue;
+			// concurrent queue per node to store freed pages
+			std::array<queue_type, max_nodes> _queues;
+			// pool of every allocated page
+			std::unordered_map<void*, std::size_t> _page_pool;
 			std::size_t _alignment = _page_alignment;
 			std::mutex _mutex;
 
-			// free queue at program end
-			~_static_helper()
+			// free queues at program end
+			~_static_helper() noexcept(false)
 			{
-				void* p = nullptr;
-				while (_queue.try_pop_front(p))
-					mccl_aligned_free(p);
-				if (_queue.size() > 0)
-					throw std::runtime_error("page_allocator: could not free all pages in queue");
+				for (auto& queue : _queues)
+				{
+					void* p = nullptr;
+					while (queue.try_pop_front(p))
+						mccl_aligned_dealloc(p);
+					if (queue.size() > 0)
+						throw std::runtime_error("page_allocator: could not free all pages in queue");
+				}
 			}
 		};
 		static _static_helper _helper;
 	};
+
+	template<std::size_t PageSize>
+	typename mccl_page_allocator<PageSize>::_static_helper mccl_page_allocator<PageSize>::_helper;
 	
 }
 
@@ -204,7 +236,7 @@ public:
 
 	typedef Alloc page_allocator_type;
 	static const std::size_t page_size = page_allocator_type::page_size;
-	static const std::size_t page_alignment = page_allocator_type::page_alignment;
+	static const std::size_t page_alignment = page_allocator_type::page_alignment();
 	static const std::size_t alignment_cost = ((page_alignment % alignof(value_type)) == 0) ? 0 : alignof(value_type);
 	static const std::size_t page_capacity = (page_size - alignment_cost) / sizeof(value_type);
 
@@ -685,7 +717,7 @@ private:
 			throw std::runtime_error("page_vector::_alloc_page(): allocation failed");
 		// ensure alignment for value_type
 		std::uintptr_t data = std::uintptr_t(_page);
-		data += sizeof(value_type);
+		data += alignof(value_type) - 1;
 		data -= data % alignof(value_type);
 		// set _data: casts between uintptr_t and value_type* must use intermediate cast to void*
 		_data = static_cast<value_type*>( reinterpret_cast<void*>(data) );
@@ -748,13 +780,13 @@ class collection
 public:
 	// subcontainer types & capacity
 	typedef page_vector<T> subcontainer_type;
-	using typename subcontainer_type::value_type;
-	using typename subcontainer_type::pointer;
-	using typename subcontainer_type::reference;
-	using typename subcontainer_type::const_pointer;
-	using typename subcontainer_type::const_reference;
-	using typename subcontainer_type::size_type;
-	using typename subcontainer_type::difference_type;
+	typedef typename subcontainer_type::value_type value_type;
+	typedef typename subcontainer_type::pointer pointer;
+	typedef typename subcontainer_type::reference reference;
+	typedef typename subcontainer_type::const_pointer const_pointer;
+	typedef typename subcontainer_type::const_reference const_reference;
+	typedef typename subcontainer_type::size_type size_type;
+	typedef typename subcontainer_type::difference_type difference_type;
 	typedef typename subcontainer_type::iterator minor_iterator;
 	typedef typename subcontainer_type::const_iterator const_minor_iterator;
 	static const size_type page_capacity = subcontainer_type::page_capacity;
@@ -769,10 +801,16 @@ public:
 	// end iterator corresponds to values ( this, data().end(), minor_iterator() )
 	template<bool IsConst>
 	class Iterator
-		: public std::iterator<std::random_access_iterator_tag, typename std::conditional<IsConst, const value_type, value_type>::type, difference_type>
 	{
 		friend class collection;
+		template<bool> friend class Iterator;
 	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef typename collection::value_type value_type;
+		typedef typename collection::difference_type difference_type;
+		typedef typename std::conditional<IsConst, typename collection::const_pointer, typename collection::pointer>::type pointer;
+		typedef typename std::conditional<IsConst, typename collection::const_reference, typename collection::reference>::type reference;
+
 		typedef typename std::conditional<IsConst, const collection, collection>::type collection_type;
 		typedef typename std::conditional<IsConst, const_major_iterator, major_iterator>::type major_iterator_type;
 		typedef typename std::conditional<IsConst, const_minor_iterator, minor_iterator>::type minor_iterator_type;
@@ -804,7 +842,7 @@ public:
 		// support conversion from iterator to const_iterator
 		operator Iterator<true>() const
 		{
-			return Iterator<true>(_ptr, _pageit, _elemit);
+			return Iterator<true>(*_ptr, _pageit, _elemit);
 		}
 		
 		template<bool IsConst2>
@@ -893,10 +931,13 @@ public:
 			return (*_ptr)[_to_index() + n];
 		}
 
+		reference operator*() const { return *_elemit; }
+		pointer operator->() const { return &*_elemit; }
+
 	private:
-		difference_type _to_index()
+		difference_type _to_index() const
 		{
-			assert(_ptr != nullptr && _pageit != _ptr->data.end());
+			assert(_ptr != nullptr);
 			if (_pageit == _ptr->data().end())
 				return _ptr->size();
 			return (_elemit - _pageit->begin()) + ((_pageit - _ptr->data().begin()) * difference_type(page_capacity));
@@ -905,9 +946,9 @@ public:
 		void _from_index(difference_type index)
 		{
 			assert(_ptr != nullptr);
-			if (index < 0 || index > _size)
+			if (index < 0 || index > difference_type(_ptr->size()))
 				throw std::out_of_range("collection::Iterator::_from_index: out of range");
-			if (index == _size)
+			if (index == difference_type(_ptr->size()))
 			{
 				_pageit = _ptr->data().end();
 				_elemit = minor_iterator_type();
@@ -930,7 +971,7 @@ public:
 
 		void _decrement()
 		{
-			if (_elemit == _pageit->begin())
+			if (_pageit == _ptr->data().end() || _elemit == _pageit->begin())
 			{
 				--_pageit;
 				_elemit = _pageit->end();
@@ -1220,7 +1261,7 @@ public:
 
 	void push_back(const value_type& value)
 	{
-		if (_data.back().size() == page_capacity)
+		if (_data.empty() || _data.back().size() == page_capacity)
 			_data.emplace_back();
 		_data.back().push_back(value);
 		++_size;
@@ -1228,7 +1269,7 @@ public:
 
 	void push_back(value_type&& value)
 	{
-		if (_data.back().size() == page_capacity)
+		if (_data.empty() || _data.back().size() == page_capacity)
 			_data.emplace_back();
 		_data.back().push_back(std::move(value));
 		++_size;
@@ -1237,7 +1278,7 @@ public:
 	template<typename... Args>
 	void emplace_back(Args&&... args)
 	{
-		if (_data.back().size() == page_capacity)
+		if (_data.empty() || _data.back().size() == page_capacity)
 			_data.emplace_back();
 		_data.back().emplace_back(std::forward<Args>(args)...);
 		++_size;
@@ -1379,7 +1420,7 @@ public:
 	// append other collection to end, but we're allowed to move all its pages
 	void append(collection&& other)
 	{
-		for (auto& p : other._data())
+		for (auto& p : other._data)
 			append( std::move(p) );
 		other._data.clear();
 		other._size = 0;
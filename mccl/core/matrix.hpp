@@ -604,6 +604,8 @@ public:
     MCCL_BASEMAT_MEMBER_FUNC( flipcolumns (size_t c_off, size_t c_cnt)         , detail::m_flipcolumns (ptr(), c_off, c_cnt);    )
 
     MCCL_BASEMAT_MEMBER_FUNC( swapcolumns (size_t c1   , size_t c2   )         , detail::m_swapcolumns (ptr(), c1, c2); )
+    // new column c = old column perm[c]
+    MCCL_BASEMAT_MEMBER_FUNC( permute_columns(const std::vector<size_t>& perm) , detail::m_permute_columns(ptr(), perm.data(), perm.size()); )
     
     // 1-matrix member functions that translate to 2-matrix operations with current object the destination matrix
     // note that a const version is defined only for views, not for owners
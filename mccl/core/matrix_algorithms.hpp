@@ -3,7 +3,14 @@
 
 #include <mccl/config/config.hpp>
 #include <mccl/core/matrix.hpp>
+#include <mccl/core/matrix_echelon.hpp>
 #include <mccl/core/random.hpp>
+#include <mccl/contrib/thread_pool.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+#include <vector>
 
 MCCL_BEGIN_NAMESPACE
 
@@ -108,6 +115,220 @@ inline void fillrandom(const vec_view& v, mccl_base_random_generator& gen)
 }
 
 
+namespace detail
+{
+
+    // straightforward single-threaded implementations: one full pass over all rows per pivot
+    template<typename matrix_t, MCCL_ENABLE_IF_MATRIX(matrix_t)>
+    size_t echelonize_scalar(matrix_t& m, size_t column_start, size_t column_end, size_t pivot_start)
+    {
+        if (column_end > m.columns())
+            column_end = m.columns();
+        for (size_t c = column_start; c < column_end; ++c)
+        {
+            // find pivot for column c
+            size_t p = pivot_start;
+            for (; p < m.rows() && m(p,c) == false; ++p)
+                ;
+            // if no pivot found the continue with next column
+            if (p >= m.rows())
+                continue;
+            // swap row if necessary
+            if (p != pivot_start)
+                m[p].v_swap(m[pivot_start]);
+            // reduce column c
+            auto pivotrow = m[pivot_start];
+            auto mrowit = m.begin();
+            for (size_t r = 0; r < pivot_start; ++r,++mrowit)
+                if (m(r,c))
+                    mrowit.v_xor(pivotrow);
+            // skip pivotrow itself
+            ++mrowit;
+            for (size_t r = pivot_start+1; r < m.rows(); ++r,++mrowit)
+                if (m(r,c))
+                    mrowit.v_xor(pivotrow);
+            // increase pivot_start for next column
+            ++pivot_start;
+        }
+        return pivot_start;
+    }
+
+    template<typename matrix_t, MCCL_ENABLE_IF_MATRIX(matrix_t)>
+    size_t echelonize_col_scalar(matrix_t& m, size_t row_start, size_t row_end, size_t pivot_start)
+    {
+        if (row_end > m.rows())
+            row_end = m.rows();
+        for (size_t r = row_start; r < row_end; ++r)
+        {
+            // find pivot for row r
+            size_t p = pivot_start;
+            for (; p < m.columns() && m(r,p) == false; ++p)
+                ;
+            // if no pivot found the continue with next row
+            if (p >= m.columns())
+                continue;
+            // swap column if necessary
+            if (p != pivot_start)
+                m.swapcolumns(p, pivot_start);
+            // reduce row r with column pivot_start
+            // note: first clear bit pivot_start in row r to prevent row r & column pivot_start to be changed
+            vec_view pivotrow(m[r]);
+            pivotrow.clearbit(pivot_start);
+            auto mrowit = m.begin();
+            for (size_t r2 = 0; r2 < m.rows(); ++r2,++mrowit)
+                if (m(r2,pivot_start))
+                    mrowit.v_xor(pivotrow);
+            // now just set pivotrow to zero except for column pivot_start
+            pivotrow.v_clear();
+            pivotrow.setbit(pivot_start);
+            // increase pivot_start for next row
+            ++pivot_start;
+        }
+        return pivot_start;
+    }
+
+    template<typename matrix_t, MCCL_ENABLE_IF_MATRIX(matrix_t)>
+    size_t echelonize_col_rev_scalar(matrix_t& m, size_t row_start, size_t row_end, size_t pivot_start)
+    {
+        if (row_end > m.rows())
+            row_end = m.rows();
+        if (pivot_start > m.columns())
+            pivot_start = m.columns();
+        for (size_t r = row_start; r < row_end; ++r)
+        {
+            // find pivot for row r
+            size_t p = pivot_start;
+            for (; p > 0 && m(r,p-1) == false; --p)
+                ;
+            // if no pivot found the continue with next row
+            if (p == 0)
+                continue;
+            // operate on column pivot_start-1 and p-1 instead
+            --p; --pivot_start;
+            // swap column if necessary
+            if (p != pivot_start)
+                m.swapcolumns(p, pivot_start);
+            // reduce row r with column pivot_start
+            // note: first clear bit pivot_start in row r to prevent row r & column pivot_start to be changed
+            vec_view pivotrow(m[r]);
+            pivotrow.clearbit(pivot_start);
+            auto mrowit = m.begin();
+            for (size_t r2 = 0; r2 < m.rows(); ++r2,++mrowit)
+                if (m(r2,pivot_start))
+                    mrowit.v_xor(pivotrow);
+            // now just set pivotrow to zero except for column pivot_start
+            pivotrow.v_clear();
+            pivotrow.setbit(pivot_start);
+            // need to decrease pivot_start by 1 for next row, but already done
+        }
+        return pivot_start;
+    }
+
+
+    // blocked column reduction with the same result as echelonize_col_scalar / echelonize_col_rev_scalar:
+    // - rows are processed in batches of 64
+    // - column swaps are applied directly, pivots are applied directly only to the rows of the batch
+    // - the (column reduced) pivot rows are stored and applied to all other rows afterwards, in parallel
+    // - the pivot columns of a batch are consecutive: [ps0, ps0+k) or in reverse [ps0-k, ps0)
+    template<bool reverse, typename matrix_t>
+    size_t echelonize_col_blocked(matrix_t& m, size_t row_start, size_t row_end, size_t pivot_start)
+    {
+        const size_t words = m.row_words();
+        const uint64_t lwm = lastwordmask(m.columns());
+        std::vector<uint64_t> pivotbuf(64 * words);
+        const uint64_t* pivotrows[64];
+        uint64_t pivotwindow[64];
+        for (size_t j = 0; j < 64; ++j)
+            pivotrows[j] = pivotbuf.data() + j * words;
+        for (size_t rb = row_start; rb < row_end; rb += 64)
+        {
+            const size_t re = std::min(rb + 64, row_end);
+            const size_t ps0 = pivot_start;
+            size_t k = 0;
+            for (size_t r = rb; r < re; ++r)
+            {
+                // find pivot for row r
+                size_t p = pivot_start;
+                if (reverse)
+                {
+                    for (; p > 0 && m(r,p-1) == false; --p)
+                        ;
+                    if (p == 0)
+                        continue;
+                    --p; --pivot_start;
+                }
+                else
+                {
+                    for (; p < m.columns() && m(r,p) == false; ++p)
+                        ;
+                    if (p >= m.columns())
+                        continue;
+                }
+                if (p != pivot_start)
+                {
+                    m.swapcolumns(p, pivot_start);
+                    for (size_t j = 0; j < k; ++j)
+                        swap_row_bits(pivotbuf.data() + j * words, p, pivot_start);
+                }
+                // store row r without its pivot bit & apply it to the remaining rows of this batch
+                uint64_t* pivotrow = pivotbuf.data() + k * words;
+                std::copy(m.word_ptr(r), m.word_ptr(r) + words, pivotrow);
+                pivotrow[pivot_start/64] &= ~(uint64_t(1) << (pivot_start%64));
+                for (size_t r2 = r+1; r2 < re; ++r2)
+                    if (m(r2,pivot_start))
+                        xor_row_words(m.word_ptr(r2), pivotrow, words, lwm);
+                vec_view pivotrowview(m[r]);
+                pivotrowview.v_clear();
+                pivotrowview.setbit(pivot_start);
+                ++k;
+                if (!reverse)
+                    ++pivot_start;
+            }
+            if (k == 0)
+                continue;
+            // pivot columns of this batch as a window: pivot j corresponds to window bit j
+            const size_t wc0 = reverse ? pivot_start : ps0;
+            const size_t wc1 = reverse ? ps0 : pivot_start;
+            auto window = [&](const uint64_t* row)
+                {
+                    uint64_t x = get_row_window(row, wc0, wc1);
+                    if (reverse)
+                        x = reverse_bits(x) >> (64 - k);
+                    return x;
+                };
+            for (size_t j = 0; j < k; ++j)
+                pivotwindow[j] = window(pivotrows[j]);
+            // apply pivots to all rows outside the batch
+            // the xor with pivot j depends on the pivot column bit after applying the previous pivots
+            echelonize_xor_rows(m, pivotrows, k, rb, re,
+                [&](size_t r)
+                {
+                    uint64_t x = window(m.word_ptr(r)), sel = 0;
+                    for (size_t j = 0; j < k; ++j)
+                    {
+                        if ((x >> j) & 1)
+                        {
+                            sel |= uint64_t(1) << j;
+                            x ^= pivotwindow[j];
+                        }
+                    }
+                    return sel;
+                });
+        }
+        return pivot_start;
+    }
+
+} // namespace detail
+
+// set the number of threads used by echelonize, echelonize_col, echelonize_col_rev and m_transpose for large matrices
+// default is 1, the threads are shared by all callers: concurrent calls run single-threaded
+inline void set_echelonize_threads(unsigned threads)
+{
+    auto& et = detail::echelonize_threads();
+    std::lock_guard<std::mutex> lock(et.mutex);
+    et.threadpool.resize(threads > 1 ? threads - 1 : 0);
+}
+
 // full row reduction of matrix m over columns [column_start,column_end)
 // pivots may be selected from rows [pivot_start,rows())
 // returns pivotend = pivot_start + nrnewrowpivots
@@ -116,34 +337,9 @@ size_t echelonize(matrix_t& m, size_t column_start = 0, size_t column_end = ~siz
 {
     if (column_end > m.columns())
         column_end = m.columns();
-    for (size_t c = column_start; c < column_end; ++c)
-    {
-        // find pivot for column c
-        size_t p = pivot_start;
-        for (; p < m.rows() && m(p,c) == false; ++p)
-            ;
-        // if no pivot found the continue with next column
-        if (p >= m.rows())
-            continue;
-        // swap row if necessary
-        if (p != pivot_start)
-            m[p].v_swap(m[pivot_start]);
-        // reduce column c
-        auto pivotrow = m[pivot_start];
-        auto mrowit = m.begin();
-        //std::cerr << (mrowit) << std::endl;
-        for (size_t r = 0; r < pivot_start; ++r,++mrowit)
-            if (m(r,c))
-                mrowit.v_xor(pivotrow);
-        // skip pivotrow itself
-        ++mrowit;
-        for (size_t r = pivot_start+1; r < m.rows(); ++r,++mrowit)
-            if (m(r,c))
-                mrowit.v_xor(pivotrow);
-        // increase pivot_start for next column
-        ++pivot_start;
-    }
-    return pivot_start;
+    if (m.rows() >= detail::echelonize_blocked_min_rows)
+        return detail::echelonize_m4ri(m, column_start, column_end, pivot_start);
+    return detail::echelonize_scalar(m, column_start, column_end, pivot_start);
 }
 
 // full row reduction on *transposed* matrix
@@ -155,33 +351,9 @@ size_t echelonize_col(matrix_t& m, size_t row_start = 0, size_t row_end = ~size_
 {
     if (row_end > m.rows())
         row_end = m.rows();
-    for (size_t r = row_start; r < row_end; ++r)
-    {
-        // find pivot for row r
-        size_t p = pivot_start;
-        for (; p < m.columns() && m(r,p) == false; ++p)
-            ;
-        // if no pivot found the continue with next row
-        if (p >= m.columns())
-            continue;
-        // swap column if necessary
-        if (p != pivot_start)
-            m.swapcolumns(p, pivot_start);
-        // reduce row r with column pivot_start
-        // note: first clear bit pivot_start in row r to prevent row r & column pivot_start to be changed
-        vec_view pivotrow(m[r]);
-        pivotrow.clearbit(pivot_start);
-        auto mrowit = m.begin();
-        for (size_t r2 = 0; r2 < m.rows(); ++r2,++mrowit)
-            if (m(r2,pivot_start))
-                mrowit.v_xor(pivotrow);
-        // now just set pivotrow to zero except for column pivot_start
-        pivotrow.v_clear();
-        pivotrow.setbit(pivot_start);
-        // increase pivot_start for next row
-        ++pivot_start;
-    }
-    return pivot_start;
+    if (m.rows() >= detail::echelonize_blocked_min_rows)
+        return detail::echelonize_col_blocked<false>(m, row_start, row_end, pivot_start);
+    return detail::echelonize_col_scalar(m, row_start, row_end, pivot_start);
 }
 
 // full *column* reduction of matrix m over rows [row_start,row_end) with *reverse* column ordering
@@ -194,43 +366,54 @@ size_t echelonize_col_rev(matrix_t& m, size_t row_start = 0, size_t row_end = ~s
         row_end = m.rows();
     if (pivot_start > m.columns())
         pivot_start = m.columns();
-    for (size_t r = row_start; r < row_end; ++r)
-    {
-        // find pivot for row r
-        size_t p = pivot_start;
-        for (; p > 0 && m(r,p-1) == false; --p)
-            ;
-        // if no pivot found the continue with next row
-        if (p == 0)
-            continue;
-        // operate on column pivot_start-1 and p-1 instead
-        --p; --pivot_start;
-        // swap column if necessary
-        if (p != pivot_start)
-            m.swapcolumns(p, pivot_start);
-        // reduce row r with column pivot_start
-        // note: first clear bit pivot_start in row r to prevent row r & column pivot_start to be changed
-        vec_view pivotrow(m[r]);
-        pivotrow.clearbit(pivot_start);
-        auto mrowit = m.begin();
-        for (size_t r2 = 0; r2 < m.rows(); ++r2,++mrowit)
-            if (m(r2,pivot_start))
-                mrowit.v_xor(pivotrow);
-        // now just set pivotrow to zero except for column pivot_start
-        pivotrow.v_clear();
-        pivotrow.setbit(pivot_start);
-        // need to decrease pivot_start by 1 for next row, but already done
-    }
-    return pivot_start;
+    if (m.rows() >= detail::echelonize_blocked_min_rows)
+        return detail::echelonize_col_blocked<true>(m, row_start, row_end, pivot_start);
+    return detail::echelonize_col_rev_scalar(m, row_start, row_end, pivot_start);
 }
 
+// full *column* reduction of matrix m over columns [column_start,column_end) with *reverse* column ordering and row pivoting:
+// column column_end-1-i is reduced with pivot row pivot_start+i, which is selected from rows [pivot_start+i,pivot_end)
+// and becomes a unit vector by adding the pivot column to the other columns, columns without pivot are skipped
+// this is the ISD form of (H|S)^T: a row reduction of (H|S) with column permutation
+// rowswap(r1,r2) is called for every row swap, e.g. to track a permutation
+// returns pivotend = pivot_start + nrnewpivots
+template<typename matrix_t, typename RowSwap, MCCL_ENABLE_IF_MATRIX(matrix_t)>
+size_t echelonize_col_rev_rowswap(matrix_t& m, size_t column_start, size_t column_end, size_t pivot_start, size_t pivot_end, RowSwap&& rowswap)
+{
+    if (column_end > m.columns())
+        column_end = m.columns();
+    if (pivot_end > m.rows())
+        pivot_end = m.rows();
+    if (m.rows() >= detail::echelonize_blocked_min_rows)
+        return detail::echelonize_col_rev_rowswap_m4ri(m, column_start, column_end, pivot_start, pivot_end, rowswap);
+    return detail::echelonize_col_rev_rowswap_scalar(m, column_start, column_end, pivot_start, pivot_end, rowswap);
+}
+
+
+
+// dst ^= A * B over GF(2) using the method of four Russians
+// dst must not overlap A or B, large products use the echelonize threads
+template<typename matrix_t, typename matrix_t2, typename matrix_t3, MCCL_ENABLE_IF_MATRIX(matrix_t), MCCL_ENABLE_IF_MATRIX(matrix_t2), MCCL_ENABLE_IF_MATRIX(matrix_t3)>
+void m_addmul(matrix_t& dst, const matrix_t2& A, const matrix_t3& B)
+{
+    if (A.columns() != B.rows() || dst.rows() != A.rows() || dst.columns() != B.columns())
+        throw std::runtime_error("m_addmul(): matrix dimensions do not match");
+    detail::addmul_m4rm(dst, A, B);
+}
 
+// dst = A * B over GF(2), see m_addmul
+template<typename matrix_t, typename matrix_t2, typename matrix_t3, MCCL_ENABLE_IF_MATRIX(matrix_t), MCCL_ENABLE_IF_MATRIX(matrix_t2), MCCL_ENABLE_IF_MATRIX(matrix_t3)>
+void m_mul(matrix_t& dst, const matrix_t2& A, const matrix_t3& B)
+{
+    dst.m_clear();
+    m_addmul(dst, A, B);
+}
 
 template<typename matrix_t, MCCL_ENABLE_IF_MATRIX(matrix_t)>
 mat dual_matrix(const matrix_t& m)
 {
         mat msf(m);
-        // echelonize msf
+        // echelonize msf into reduced row echelon form
         size_t pr = echelonize(msf);
         // remove zero rows
         msf.resize( pr, msf.columns() );
@@ -246,14 +429,14 @@ mat dual_matrix(const matrix_t& m)
         for (size_t p = 0; p < rows; ++p)
         {
                 // find msf column = msfT row with single bit set at position p
+                // in reduced row echelon form this is the first column >= p with bit p set
                 size_t c = p;
-                for (; c < columns; ++c)
-                        if (hammingweight(msfT[c]) == 1 && msfT(c,p) == true)
-                                break;
+                for (; c < columns && msfT(c,p) == false; ++c)
+                        ;
+                if (c == columns || hammingweight(msfT[c]) != 1)
+                        throw std::runtime_error("dual_matrix(): internal error 1");
                 if (c == p)
                         continue;
-                if (c == columns)
-                        throw std::runtime_error("dual_matrix(): internal error 1");
                 // swap columns
                 columnswaps.emplace_back(p, c);
                 tmp = msfT[p] ^ msfT[c];
@@ -268,13 +451,12 @@ mat dual_matrix(const matrix_t& m)
         // write I_(n-k)
         for (size_t r = 0; r < dual.rows(); ++r)
                 dual.setbit(r, rows + r, true);
-        // undo column swaps
-        while (!columnswaps.empty())
-        {
-                auto pc = columnswaps.back();
-                columnswaps.pop_back();
-                dual.swapcolumns(pc.first, pc.second);
-        }
+        // undo column swaps, applied in reverse order as one permutation
+        std::vector<size_t> perm(columns);
+        std::iota(perm.begin(), perm.end(), 0);
+        for (auto it = columnswaps.rbegin(); it != columnswaps.rend(); ++it)
+                std::swap(perm[it->first], perm[it->second]);
+        dual.permute_columns(perm);
         return dual;
 }
 
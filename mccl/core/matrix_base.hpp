@@ -3,6 +3,8 @@
 
 #include <mccl/config/config.hpp>
 
+#include <mccl/core/simd_kernels.hpp>
+
 #include <stdexcept>
 #include <cstdint>
 #include <array>
@@ -422,6 +424,19 @@ inline bool operator!=(const  m_ptr& m1, const  m_ptr& m2) { return !(m1 == m2);
 
 
 
+namespace detail {
+
+// hammingweight of a block of size words, multi-word blocks use the dispatched simd_kernels.hw
+template<size_t size>
+inline size_t block_hammingweight(const uint64_t* v)
+{
+	if (size > 1)
+		return simd_kernels.hw(v, size);
+	return mccl::hammingweight(v[0]);
+}
+
+} // namespace detail
+
 template<size_t Bits>
 struct alignas(Bits/8) uint64_block_t
 {
@@ -445,7 +460,7 @@ struct alignas(Bits/8) uint64_block_t
     void flip_bit(size_t c)        { v[c/64] ^= uint64_t(1)<<(c%64); }
     void clear_bit(size_t c)       { v[c/64] &= ~(uint64_t(1)<<(c%64)); }
     void set_bit(size_t c, bool b) { v[c/64] &= ~(uint64_t(1)<<(c%64)); v[c/64] |= uint64_t(b ? 1 : 0)<<(c%64); }
-    size_t hammingweight() const   { size_t w = 0; for (size_t i = 0; i < size; ++i) w += mccl::hammingweight(v[i]); return w; }
+    size_t hammingweight() const   { return detail::block_hammingweight<size>(v.data()); }
     bool parity() const            { uint64_t x = 0; for (size_t i = 0; i < size; ++i) x ^= v[i]; return mccl::hammingweight(x)%2; }
 };
 template<size_t bits> size_t hammingweight(const uint64_block_t<bits>& x) { return x.hammingweight(); }
@@ -0,0 +1,483 @@
+#ifndef MCCL_CORE_MATRIX_ECHELON_HPP
+#define MCCL_CORE_MATRIX_ECHELON_HPP
+
+#include <mccl/config/config.hpp>
+#include <mccl/core/matrix.hpp>
+#include <mccl/contrib/thread_pool.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+MCCL_BEGIN_NAMESPACE
+
+/*
+   Echelonization kernels using the method of four Russians (M4RI):
+   - columns are processed in blocks of up to 64, the block columns of all rows are extracted into one word per row
+   - pivots of a block are found and reduced on these words only
+   - all other rows are reduced with tables of all combinations of 8 pivot rows,
+     so every row needs only one table lookup and xor per 8 pivots, see echelonize_xor_rows
+   The same tables give the matrix multiplication of four Russians (M4RM), see addmul_m4rm.
+   The public interface is in matrix_algorithms.hpp.
+*/
+
+namespace detail
+{
+
+    // matrices with at least this many rows are echelonized with the blocked algorithms
+    const size_t echelonize_blocked_min_rows = 128;
+    // number of words of a row processed at once, so that the tables of a batch (8 x 256 x 64 bytes) stay in L2 cache
+    const size_t echelonize_chunk_words = 8;
+
+    // thread pool used by the blocked algorithms, see set_echelonize_threads
+    struct echelonize_threads_t
+    {
+        std::mutex mutex;
+        thread_pool::thread_pool threadpool;
+    };
+    inline echelonize_threads_t& echelonize_threads()
+    {
+        static echelonize_threads_t et;
+        return et;
+    }
+
+    // call f(row_begin, row_end) for a partition of [0,rows) over all threads
+    // if the thread pool is in use by another thread or rows < min_rows, then f is simply called for the whole range
+    template<typename F>
+    void echelonize_parallel_rows(size_t rows, F&& f, size_t min_rows = echelonize_blocked_min_rows)
+    {
+        auto& et = echelonize_threads();
+        std::unique_lock<std::mutex> lock(et.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || et.threadpool.size() == 0 || rows < min_rows)
+        {
+            f(size_t(0), rows);
+            return;
+        }
+        et.threadpool.run([&](int thread_id, int thread_count)
+            {
+                f((rows * thread_id) / thread_count, (rows * (thread_id+1)) / thread_count);
+            });
+    }
+
+    // return bits [c0,c1) of a row as a word, c1-c0 <= 64
+    inline uint64_t get_row_window(const uint64_t* row, size_t c0, size_t c1)
+    {
+        const size_t w = c0 / 64, s = c0 % 64, n = c1 - c0;
+        if (n == 0)
+            return 0;
+        uint64_t x = row[w] >> s;
+        if (s != 0 && s + n > 64)
+            x |= row[w+1] << (64 - s);
+        return (n == 64) ? x : (x & ((uint64_t(1) << n) - 1));
+    }
+
+    inline uint64_t reverse_bits(uint64_t x)
+    {
+        x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+        x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+        x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        x = ((x >> 8) & 0x00FF00FF00FF00FFULL) | ((x & 0x00FF00FF00FF00FFULL) << 8);
+        x = ((x >> 16) & 0x0000FFFF0000FFFFULL) | ((x & 0x0000FFFF0000FFFFULL) << 16);
+        return (x >> 32) | (x << 32);
+    }
+
+    inline void swap_row_bits(uint64_t* row, size_t c1, size_t c2)
+    {
+        const uint64_t b1 = (row[c1/64] >> (c1%64)) & 1, b2 = (row[c2/64] >> (c2%64)) & 1;
+        if (b1 != b2)
+        {
+            row[c1/64] ^= uint64_t(1) << (c1%64);
+            row[c2/64] ^= uint64_t(1) << (c2%64);
+        }
+    }
+
+    // dst = a ^ b for a full chunk, the fixed size allows the compiler to vectorize
+    inline void xor_chunk(uint64_t* dst, const uint64_t* a, const uint64_t* b)
+    {
+        uint64_t tmp[echelonize_chunk_words];
+        for (size_t w = 0; w < echelonize_chunk_words; ++w)
+            tmp[w] = a[w] ^ b[w];
+        for (size_t w = 0; w < echelonize_chunk_words; ++w)
+            dst[w] = tmp[w];
+    }
+
+    // for all rows r of m outside [skip_begin,skip_end): xor row r with src[j] for all bits j set in select(r)
+    // select is evaluated before row r is modified, src contains k <= 64 rows
+    // uses the method of four Russians: for each group of 8 src rows a table of all 256 combinations is made
+    // in Gray code order, so every row needs only one xor per group and all groups are applied in one pass
+    // rows are processed in chunks of words to keep the tables in L2 cache and are divided over the echelonize threads
+    // words before word_start are skipped, the src rows must be zero there
+    template<typename matrix_t, typename Select>
+    void echelonize_xor_rows(matrix_t& m, const uint64_t* const* src, size_t k, size_t skip_begin, size_t skip_end, Select&& select, size_t word_start = 0)
+    {
+        const size_t words = m.row_words();
+        const uint64_t lwm = lastwordmask(m.columns());
+        const size_t groups = (k + 7) / 8;
+        echelonize_parallel_rows(m.rows(), [&](size_t rbegin, size_t rend)
+            {
+                std::vector<uint64_t> sel(rend - rbegin);
+                uint64_t any = 0;
+                for (size_t r = rbegin; r < rend; ++r)
+                {
+                    sel[r - rbegin] = (r >= skip_begin && r < skip_end) ? 0 : select(r);
+                    any |= sel[r - rbegin];
+                }
+                if (any == 0)
+                    return;
+                // entry 0 of every table remains zero, tables of unused groups are never read at other entries
+                std::vector<uint64_t> table(8 * 256 * echelonize_chunk_words, 0);
+                for (size_t w0 = word_start; w0 < words; w0 += echelonize_chunk_words)
+                {
+                    const size_t cw = std::min(echelonize_chunk_words, words - w0);
+                    const bool lastchunk = (w0 + cw == words);
+                    for (size_t g = 0; g < groups; ++g)
+                    {
+                        if (((any >> (8*g)) & 0xFF) == 0)
+                            continue;
+                        // table[i] = xor of src[8g+j] for all bits j set in i
+                        const size_t gk = std::min<size_t>(8, k - 8*g);
+                        uint64_t* tg = table.data() + g * 256 * echelonize_chunk_words;
+                        for (size_t i = 1; i < (size_t(1) << gk); ++i)
+                        {
+                            const uint64_t* prev = tg + ((i-1) ^ ((i-1) >> 1)) * echelonize_chunk_words;
+                            const uint64_t* srcrow = src[8*g + __builtin_ctzll(i)] + w0;
+                            uint64_t* dst = tg + (i ^ (i >> 1)) * echelonize_chunk_words;
+                            if (cw == echelonize_chunk_words)
+                                xor_chunk(dst, prev, srcrow);
+                            else
+                                for (size_t w = 0; w < cw; ++w)
+                                    dst[w] = prev[w] ^ srcrow[w];
+                            if (lastchunk)
+                                dst[cw-1] = prev[cw-1] ^ (srcrow[cw-1] & lwm);
+                        }
+                    }
+                    for (size_t r = rbegin; r < rend; ++r)
+                    {
+                        const uint64_t s = sel[r - rbegin];
+                        if (s == 0)
+                            continue;
+                        // always use all 8 tables, the zero entry of unused tables is cheap to read,
+                        // and the fixed number of tables allows the compiler to keep the row chunk in registers
+                        const uint64_t* t[8];
+                        for (size_t g = 0; g < 8; ++g)
+                            t[g] = table.data() + (g * 256 + ((s >> (8*g)) & 0xFF)) * echelonize_chunk_words;
+                        uint64_t* row = m.word_ptr(r) + w0;
+                        if (cw == echelonize_chunk_words)
+                        {
+                            uint64_t x[echelonize_chunk_words];
+                            for (size_t w = 0; w < echelonize_chunk_words; ++w)
+                                x[w] = t[0][w] ^ t[1][w] ^ t[2][w] ^ t[3][w] ^ t[4][w] ^ t[5][w] ^ t[6][w] ^ t[7][w];
+                            for (size_t w = 0; w < echelonize_chunk_words; ++w)
+                                row[w] ^= x[w];
+                        }
+                        else
+                            for (size_t w = 0; w < cw; ++w)
+                                row[w] ^= t[0][w] ^ t[1][w] ^ t[2][w] ^ t[3][w] ^ t[4][w] ^ t[5][w] ^ t[6][w] ^ t[7][w];
+                    }
+                }
+            });
+    }
+
+    // dst ^= A * B with the method of four Russians (M4RM):
+    // for each block of 64 rows of B all rows of dst are updated by echelonize_xor_rows,
+    // selecting the rows of the block by the corresponding word of the row of A
+    // the tables of echelonize_xor_rows cover a chunk of words of the rows of B, so the product is tiled to stay in L2 cache
+    template<typename matrix_t, typename matrix_t2, typename matrix_t3>
+    void addmul_m4rm(matrix_t& dst, const matrix_t2& A, const matrix_t3& B)
+    {
+        const uint64_t* src[64];
+        for (size_t k0 = 0; k0 < B.rows(); k0 += 64)
+        {
+            const size_t k = std::min<size_t>(64, B.rows() - k0);
+            const uint64_t mask = (k == 64) ? ~uint64_t(0) : ((uint64_t(1) << k) - 1);
+            for (size_t j = 0; j < k; ++j)
+                src[j] = B.word_ptr(k0 + j);
+            echelonize_xor_rows(dst, src, k, 0, 0,
+                [&](size_t r) { return A.word_ptr(r)[k0/64] & mask; });
+        }
+    }
+
+    inline void xor_row_words(uint64_t* dst, const uint64_t* src, size_t words, uint64_t lwm)
+    {
+        for (size_t w = 0; w + 1 < words; ++w)
+            dst[w] ^= src[w];
+        dst[words-1] ^= src[words-1] & lwm;
+    }
+
+
+    // extracts up to 64 consecutive columns [column_start,column_end) of all rows of a matrix into one word per row
+    // bit i of a word is column column_start+i, or column column_end-1-i in reverse mode
+    struct columns_extractor
+    {
+        std::vector<uint64_t> rows;
+        size_t column_start = 0, column_end = 0;
+        bool reverse = false;
+
+        size_t columns() const { return column_end - column_start; }
+        // matrix column of word bit i
+        size_t column(size_t i) const { return reverse ? column_end - 1 - i : column_start + i; }
+
+        uint64_t extract(const uint64_t* row) const
+        {
+            uint64_t x = get_row_window(row, column_start, column_end);
+            if (reverse && columns() != 0)
+                x = reverse_bits(x) >> (64 - columns());
+            return x;
+        }
+
+        template<typename matrix_t>
+        void extract_columns(const matrix_t& m, size_t _column_start, size_t _column_end, bool _reverse = false)
+        {
+            if (_column_end - _column_start > 64)
+                throw std::runtime_error("columns_extractor::extract_columns(): more than 64 columns");
+            column_start = _column_start;
+            column_end = _column_end;
+            reverse = _reverse;
+            rows.resize(m.rows());
+            for (size_t r = 0; r < m.rows(); ++r)
+                rows[r] = extract(m.word_ptr(r));
+        }
+    };
+
+    // row reduction of a block of at most 64 columns given as one word per row (see columns_extractor)
+    // selects the same pivots as echelonize_scalar: pivot rows are pivotstart, ..., pivotstart+pivots-1
+    // the reduction is done on a copy of the words, the matrix rows are transformed afterwards:
+    // - first apply rowswaps in order
+    // - then new pivot row i = sum of pivot rows j for all bits j set in U[i]
+    // after which the pivot rows are reduced among themselves, i.e. pivot row i has only pivotbit[i] set of activebitmask
+    struct local_rowreduce
+    {
+        static const unsigned maxbits = 64;
+
+        size_t pivotstart = 0;
+        unsigned pivots = 0;
+        std::vector< std::pair<size_t,size_t> > rowswaps;
+        uint64_t U[maxbits];
+        unsigned pivotbit[maxbits];
+        uint64_t activebitmask = 0;
+
+        // words: one word per row, rows [pivotrow_min,rows) are swapped like the matrix rows
+        void rowreduce(uint64_t* words, size_t rows, size_t pivotrow_min, unsigned bits)
+        {
+            if (bits > maxbits)
+                throw std::runtime_error("local_rowreduce::rowreduce(): bits > 64");
+            pivotstart = pivotrow_min;
+            pivots = 0;
+            rowswaps.clear();
+            activebitmask = 0;
+            if (pivotrow_min >= rows)
+                return;
+            const size_t n = rows - pivotrow_min;
+            work.assign(words + pivotrow_min, words + rows);
+            // comb[i]: sum of the original pivot rows that have been added to row i, for pivot rows this is U[i]
+            comb.assign(n, 0);
+            for (unsigned bit = 0; bit < bits && pivots < n; ++bit)
+            {
+                const uint64_t bitval = uint64_t(1) << bit;
+                const size_t p = pivots;
+                size_t r = p;
+                for (; r < n && (work[r] & bitval) == 0; ++r)
+                    ;
+                if (r == n)
+                    continue;
+                if (r != p)
+                {
+                    rowswaps.emplace_back(pivotstart + p, pivotstart + r);
+                    std::swap(words[pivotstart + p], words[pivotstart + r]);
+                    std::swap(work[p], work[r]);
+                    std::swap(comb[p], comb[r]);
+                }
+                // reduce previous pivots and all remaining rows without branches, as the bits are unpredictable
+                // the pivot row reduces itself to zero, so restore it afterwards
+                const uint64_t pw = work[p], pc = comb[p] ^ (uint64_t(1) << p);
+                for (size_t i = 0; i < n; ++i)
+                {
+                    const uint64_t mask = -((work[i] >> bit) & 1);
+                    work[i] ^= pw & mask;
+                    comb[i] ^= pc & mask;
+                }
+                work[p] = pw;
+                comb[p] = pc;
+                pivotbit[p] = bit;
+                activebitmask |= bitval;
+                ++pivots;
+            }
+            for (unsigned i = 0; i < pivots; ++i)
+                U[i] = comb[i];
+        }
+
+        // apply U to the (already swapped) pivot rows of m, buf must hold pivots rows of m.row_words() words
+        // words before word_start are skipped, the pivot rows must be zero there
+        template<typename matrix_t>
+        void apply_pivotstransformation(matrix_t& m, uint64_t* buf, size_t word_start = 0) const
+        {
+            const size_t words = m.row_words() - word_start;
+            const uint64_t lwm = lastwordmask(m.columns());
+            for (unsigned i = 0; i < pivots; ++i)
+                std::copy(m.word_ptr(pivotstart + i) + word_start, m.word_ptr(pivotstart + i) + word_start + words, buf + i * words);
+            for (unsigned i = 0; i < pivots; ++i)
+            {
+                uint64_t* row = m.word_ptr(pivotstart + i) + word_start;
+                const uint64_t lastword = row[words-1];
+                std::fill(row, row + words, 0);
+                for (uint64_t u = U[i]; u != 0; u &= u - 1)
+                {
+                    const uint64_t* src = buf + __builtin_ctzll(u) * words;
+                    for (size_t w = 0; w < words; ++w)
+                        row[w] ^= src[w];
+                }
+                row[words-1] = (row[words-1] & lwm) | (lastword & ~lwm);
+            }
+        }
+
+    private:
+        std::vector<uint64_t> work, comb;
+    };
+
+    // full row reduction with the same result as echelonize_scalar:
+    // - the pivots of a block of 64 columns are found and reduced among themselves with local_rowreduce
+    // - all other rows are reduced with the pivot rows selected by their bits in the pivot columns:
+    //   the source rows are indexed by block column, with zero rows for columns without pivot
+    // - if column_start = 0 then the pivot rows are zero before the block,
+    //   as all rows below the previous pivots are zero in the previous non-pivot columns
+    template<typename matrix_t>
+    size_t echelonize_m4ri(matrix_t& m, size_t column_start, size_t column_end, size_t pivot_start)
+    {
+        const size_t rows = m.rows(), words = m.row_words();
+        std::vector<uint64_t> pivotbuf(64 * words), zerorow(words, 0);
+        const uint64_t* src[64];
+        columns_extractor ce;
+        local_rowreduce lr;
+        for (size_t c0 = column_start; c0 < column_end && pivot_start < rows; c0 += 64)
+        {
+            const size_t c1 = std::min(c0 + 64, column_end);
+            const size_t word_start = (column_start == 0) ? c0 / 64 : 0;
+            ce.extract_columns(m, c0, c1);
+            lr.rowreduce(ce.rows.data(), rows, pivot_start, unsigned(c1 - c0));
+            if (lr.pivots == 0)
+                continue;
+            for (auto& rs : lr.rowswaps)
+                m[rs.first].v_swap(m[rs.second]);
+            lr.apply_pivotstransformation(m, pivotbuf.data(), word_start);
+            const size_t ps0 = pivot_start;
+            pivot_start += lr.pivots;
+            std::fill(src, src + 64, zerorow.data());
+            for (unsigned i = 0; i < lr.pivots; ++i)
+                src[lr.pivotbit[i]] = m.word_ptr(ps0 + i);
+            const uint64_t activebitmask = lr.activebitmask;
+            echelonize_xor_rows(m, src, c1 - c0, ps0, pivot_start,
+                [&](size_t r) { return ce.rows[r] & activebitmask; }, word_start);
+        }
+        return pivot_start;
+    }
+
+    // reference implementation of echelonize_col_rev_rowswap: one full pass over all rows per pivot
+    template<typename matrix_t, typename RowSwap>
+    size_t echelonize_col_rev_rowswap_scalar(matrix_t& m, size_t column_start, size_t column_end, size_t pivot_start, size_t pivot_end, RowSwap&& rowswap)
+    {
+        for (size_t c = column_end; c > column_start && pivot_start < pivot_end; )
+        {
+            --c;
+            // find pivot row for column c
+            size_t p = pivot_start;
+            for (; p < pivot_end && m(p,c) == false; ++p)
+                ;
+            if (p >= pivot_end)
+                continue;
+            if (p != pivot_start)
+            {
+                m[p].v_swap(m[pivot_start]);
+                rowswap(p, pivot_start);
+            }
+            // add column c to all other columns set in the pivot row
+            vec_view pivotrow(m[pivot_start]);
+            pivotrow.clearbit(c);
+            auto mrowit = m.begin();
+            for (size_t r = 0; r < m.rows(); ++r,++mrowit)
+                if (m(r,c))
+                    mrowit.v_xor(pivotrow);
+            pivotrow.v_clear();
+            pivotrow.setbit(c);
+            ++pivot_start;
+        }
+        return pivot_start;
+    }
+
+    // same result as echelonize_col_rev_rowswap_scalar:
+    // - columns are processed in blocks of 64 from high to low, the block columns of all rows are extracted in reverse
+    // - pivots are found on the extracted words, which are updated for every pivot, and which pivots a row
+    //   needs is recorded as a bitmask, the pivot rows are only updated with the previous pivots of the block
+    // - all other rows are updated with the recorded pivot rows at once
+    template<typename matrix_t, typename RowSwap>
+    size_t echelonize_col_rev_rowswap_m4ri(matrix_t& m, size_t column_start, size_t column_end, size_t pivot_start, size_t pivot_end, RowSwap&& rowswap)
+    {
+        const size_t rows = m.rows(), words = m.row_words();
+        const uint64_t lwm = lastwordmask(m.columns());
+        std::vector<uint64_t> pivotbuf(64 * words), sel(rows);
+        const uint64_t* pivotrows[64];
+        size_t pivotcol[64];
+        columns_extractor ce;
+        for (size_t c1 = column_end; c1 > column_start && pivot_start < pivot_end; )
+        {
+            const size_t c0 = (c1 - column_start > 64) ? c1 - 64 : column_start;
+            ce.extract_columns(m, c0, c1, true);
+            std::fill(sel.begin(), sel.end(), 0);
+            const size_t ps0 = pivot_start;
+            size_t k = 0;
+            for (size_t i = 0; i < ce.columns() && pivot_start < pivot_end; ++i)
+            {
+                const uint64_t bit = uint64_t(1) << i;
+                size_t p = pivot_start;
+                for (; p < pivot_end && (ce.rows[p] & bit) == 0; ++p)
+                    ;
+                if (p >= pivot_end)
+                    continue;
+                if (p != pivot_start)
+                {
+                    m[p].v_swap(m[pivot_start]);
+                    std::swap(ce.rows[p], ce.rows[pivot_start]);
+                    std::swap(sel[p], sel[pivot_start]);
+                    rowswap(p, pivot_start);
+                }
+                // pivot row after the previous pivots of this block, without its pivot bit
+                uint64_t* pivotrow = pivotbuf.data() + k * words;
+                std::copy(m.word_ptr(pivot_start), m.word_ptr(pivot_start) + words, pivotrow);
+                for (uint64_t s = sel[pivot_start]; s != 0; s &= s - 1)
+                    xor_row_words(pivotrow, pivotrows[__builtin_ctzll(s)], words, lwm);
+                pivotcol[k] = ce.column(i);
+                pivotrow[pivotcol[k]/64] &= ~(uint64_t(1) << (pivotcol[k]%64));
+                pivotrows[k] = pivotrow;
+                // the pivot row itself becomes a unit vector, all rows with bit i set get the pivot row added
+                const uint64_t pivotword = ce.rows[pivot_start] & ~bit, selbit = uint64_t(1) << k;
+                ce.rows[pivot_start] = 0;
+                for (size_t r = 0; r < rows; ++r)
+                {
+                    const uint64_t mask = -((ce.rows[r] >> i) & 1);
+                    ce.rows[r] ^= pivotword & mask;
+                    sel[r] |= selbit & mask;
+                }
+                ++k;
+                ++pivot_start;
+            }
+            c1 = c0;
+            if (k == 0)
+                continue;
+            echelonize_xor_rows(m, pivotrows, k, ps0, pivot_start,
+                [&](size_t r) { return sel[r]; });
+            for (size_t j = 0; j < k; ++j)
+            {
+                vec_view pivotrowview(m[ps0 + j]);
+                pivotrowview.v_clear();
+                pivotrowview.setbit(pivotcol[j]);
+            }
+        }
+        return pivot_start;
+    }
+
+} // namespace detail
+
+MCCL_END_NAMESPACE
+
+#endif
@@ -3,7 +3,9 @@
 
 #include <mccl/config/config.hpp>
 #include <mccl/core/matrix.hpp>
+#include <mccl/core/matrix_algorithms.hpp>
 #include <mccl/core/random.hpp>
+#include <mccl/core/simd_kernels.hpp>
 
 #include <algorithm>
 #include <numeric>
@@ -40,7 +42,7 @@ public:
     typedef block_tag<bit_alignment, _masked> this_block_tag;
     typedef block_tag<bit_alignment, true> this_block_tag_masked;
     
-    HST_ISD_form_t() {}
+    HST_ISD_form_t(): H2T_columns(0) {}
     HST_ISD_form_t(const cmat_view& H_, const cvec_view& S_, size_t l_) { reset(H_, S_, l_); }
     
     void reset(const cmat_view& H_, const cvec_view& S_, size_t l_)
@@ -49,64 +51,45 @@ public:
     	assert( S_.columns() == H_.rows() );
     	
     	// setup HST
-    	size_t HTrows = H_.columns(), HTcols = H_.rows();
-    	HT_columns = HTcols;
-    	H2T_columns = l_;
-    	H1T_columns = HTcols - l_;
-    	echelon_rows = HTcols - l_;
-    	ISD_rows = HTrows - echelon_rows;
-    	max_update_rows = size_t( float(echelon_rows) * float(ISD_rows) / float(echelon_rows+ISD_rows) );
-
-    	HST.resize(HTrows + 1, HTcols);
-    	HST.m_clear();
-
-    	// create views
-    	_HT        .reset(HST.submatrix(0, HTrows));
-    	_H12T      .reset(HST.submatrix(echelon_rows, ISD_rows));
-    	_S         .reset(HST[HTrows].subvector());
-
-	_H2T      .reset(HST.submatrix(echelon_rows, ISD_rows, H2T_columns));
-	_S2       .reset(_S.subvector(H2T_columns));
+    	_setup(H_.columns(), H_.rows(), l_);
 
     	// copy H and S into HST using block_tag<bits,true> to force clearing out trailing bits
     	_HT.as(block_tag<bit_alignment,true>()).transpose(H_);
     	_S.as(block_tag<bit_alignment,true>()).v_copy(S_);
 
-    	// setup HT row perm
-    	perm.resize(HTrows);
-    	std::iota(perm.begin(), perm.end(), 0);
+    	// randomize: random permutation of the rows of HT
+    	for (size_t r = _HT.rows() - 1; r > 0; --r)
+    	{
+    		size_t r2 = rndgen() % (r + 1);
+    		std::swap(perm[r], perm[r2]);
+    		HST[r].v_swap(HST[r2]);
+    	}
+    	// bring into ISD form: echelon row e gets pivot column HT_columns - e - 1
+    	echelon_start = echelonize_col_rev_rowswap(HST, H2T_columns, HT_columns, 0, _HT.rows(),
+    		[this](size_t r1, size_t r2) { std::swap(perm[r1], perm[r2]); });
+    	if (echelon_start != echelon_rows)
+    		throw std::runtime_error("HST_ISD_form_t::reset(): cannot bring HT in ISD form");
+    }
 
-    	// setup HT echelon row perm: used to pick u random echelon rows
-    	echelon_perm.resize(echelon_rows);
-    	std::iota(echelon_perm.begin(), echelon_perm.end(), 0);
-    	cur_echelon_row = 0;
+    // only allocate HST for H and l_, the ISD form is not valid until a copy_ISD_part
+    void setup(const cmat_view& H_, size_t l_)
+    {
+    	assert( l_ < H_.rows() );
+    	_setup(H_.columns(), H_.rows(), l_);
+    }
 
-    	// setup HT ISD row perm: used to pick u random ISD rows
-    	ISD_perm.resize(ISD_rows);
-    	std::iota(ISD_perm.begin(), ISD_perm.end(), 0);
-    	cur_ISD_row = 0; rnd_ISD_row = 0;
+    // set seed of internal random generator, call before reset for deterministic behaviour
+    void seed(uint64_t s) { rndgen.seed(s); }
 
-    	// randomize & bring into ISD form
-    	for (echelon_start = 0; echelon_start < echelon_rows; ++echelon_start)
-    	{
-    		size_t pivotcol = HT_columns - echelon_start - 1;
-    		// start at a random remaining row and scan rows for bit set at column pivotcol
-    		size_t r = echelon_start + (rndgen() % (_HT.rows() - echelon_start));
-    		for (; r < _HT.rows() && _HT(r,pivotcol)==false; ++r)
-    			;
-		// wrap around once
-		if (r == _HT.rows())
-		{
-			r = echelon_start;
-	    		for (; r < _HT.rows() && _HT(r,pivotcol)==false; ++r)
-    				;
-		}
-		// check for failure
-		if (r == _HT.rows())
-			std::runtime_error("HST_ISD_form_t::reset(): cannot bring HT in ISD form");
-		// perform swap and reduction
-		swap_echelon(echelon_start, r - echelon_rows);
-	}
+    // copy the ISD part (H12T, S and permutation) of another ISD form over the same H, S and l
+    // used to hand a snapshot of the current iteration to another thread
+    // note: the echelon part is not copied, so this object must not be updated afterwards
+    void copy_ISD_part(const HST_ISD_form_t& src)
+    {
+    	if (HST.rows() != src.HST.rows() || HST.columns() != src.HST.columns() || H2T_columns != src.H2T_columns)
+    		_setup(src.HST.rows() - 1, src.HT_columns, src.H2T_columns);
+    	HST.submatrix(echelon_rows, ISD_rows + 1).m_copy(src.HST.submatrix(echelon_rows, ISD_rows + 1));
+    	perm = src.perm;
     }
 
     const std::vector<uint32_t>& permutation() const { return perm; }
@@ -139,10 +122,10 @@ public:
 	size_t pivotcol = HT_columns - echelon_idx - 1;
 	auto pivotrow = HST[echelon_idx];
 	pivotrow.clearbit(pivotcol);
-	auto HSTrowit = HST.begin() + echelon_start;
-	for (size_t r2 = echelon_start; r2 < HST.rows(); ++r2,++HSTrowit)
-		if (HST(r2,pivotcol))
-			HSTrowit.v_xor(pivotrow);
+	// the pivot row itself is skipped as its pivot bit is cleared
+	const uint64_t* src = HST.word_ptr(echelon_idx);
+	simd_kernels.xor_rows_if_bits(HST.word_ptr(echelon_start), HST.word_stride(), HST.rows() - echelon_start,
+		&src, &pivotcol, 1, HST.row_words());
 	pivotrow.v_clear();
 	pivotrow.setbit(pivotcol);
     }
@@ -157,19 +140,19 @@ public:
     	//   must have bit set at pivot column
     	//   start at random position and then do linear search
     	size_t ISD_idx = rndgen() % ISD_rows;
-	for (; ISD_idx < ISD_rows && HST(echelon_rows + ISD_idx,pivotcol)==false; ++ISD_idx)
+	for (; ISD_idx < ISD_rows && ISD_bit(ISD_idx,pivotcol)==false; ++ISD_idx)
 		;
 	// wrap around
 	if (ISD_idx >= ISD_rows) // unlikely
 	{
 		ISD_idx = 0;
-		for (; ISD_idx < ISD_rows && HST(echelon_rows + ISD_idx,pivotcol)==false; ++ISD_idx)
+		for (; ISD_idx < ISD_rows && ISD_bit(ISD_idx,pivotcol)==false; ++ISD_idx)
 			;
 	}
 	// oh oh if we wrap around twice
 	if (ISD_idx >= ISD_rows) // unlikely
 		throw std::runtime_error("HST_ISD_form_t::update1(): cannot find pivot");
-	swap_echelon(echelon_idx, ISD_idx);
+	add_pivot(echelon_idx, ISD_idx);
     }
     // update 1 echelon row
     void update1_ISDseq(size_t echelon_idx)
@@ -181,10 +164,10 @@ public:
     	while (true)
     	{
 		cur_ISD_row = (cur_ISD_row + 1) % ISD_rows;
-		if (HST(echelon_rows + cur_ISD_row,pivotcol))
+		if (ISD_bit(cur_ISD_row,pivotcol))
 			break;
     	}
-	swap_echelon(echelon_idx, cur_ISD_row);
+	add_pivot(echelon_idx, cur_ISD_row);
     }
 
     // update 1 echelon row, choose ISD row from next one in a maintained random permutation
@@ -210,7 +193,7 @@ public:
 				std::swap(ISD_perm[ISD_idx], ISD_perm[ ISD_idx + (rndgen() % (ISD_rows - ISD_idx))]);
 				++rnd_ISD_row;
 			}
-			if (HST(echelon_rows + ISD_perm[ISD_idx], pivotcol)==true)
+			if (ISD_bit(ISD_perm[ISD_idx], pivotcol)==true)
 				break;
 		}
 		if (ISD_idx < ISD_perm.size())
@@ -224,7 +207,7 @@ public:
 	std::swap(ISD_perm[cur_ISD_row], ISD_perm[ISD_idx]);
 	ISD_idx = ISD_perm[cur_ISD_row];
 	++cur_ISD_row;
-	swap_echelon(echelon_idx, ISD_idx);
+	add_pivot(echelon_idx, ISD_idx);
     }
 
 
@@ -346,9 +329,214 @@ public:
 		default:
 			throw std::runtime_error("HST_ISD_form_t::update(): unknown update type");
     	}
+    	flush_pivots();
+    }
+
+    // number of pivots that update() applies to the remaining rows in a single pass, at most max_batch_pivots
+    // 0 = auto (default), 1 = no batching: every pivot is applied by swap_echelon
+    void set_update_batch(size_t b)
+    {
+    	if (b > max_batch_pivots)
+    		throw std::runtime_error("HST_ISD_form_t::set_update_batch(): batch size too large");
+    	update_batch = b;
+    	if (HST.rows() != 0)
+    		_set_batch_pivots();
     }
 
 private:
+    /*
+       Batched updates:
+       swap_echelon(e,i) leaves the echelon rows and ISD row i unchanged (up to the permutation)
+       and adds R' = (ISD row i without its pivot bit) to every other row with the pivot bit set.
+       update() collects up to batch_pivots such pivots and applies them in a single pass over HST:
+       - the pivot rows R_j' are computed within a small pivot block when the pivot is chosen
+       - pivot bits of ISD rows are read as if the pending pivots had been applied (ISD_bit)
+       - the combined transformation of a row only depends on its bits in the pivot columns,
+         so all 2^m combinations are put in a table built with one row xor per entry in Gray code order
+       - every row is then xored with a single table entry, the pivot ISD rows are fixed afterwards
+    */
+    static const size_t max_batch_pivots = 8;
+
+    bool ISD_bit(size_t ISD_idx, size_t col) const
+    {
+    	const uint64_t* row = HST.word_ptr(echelon_rows + ISD_idx);
+    	if (pending_pivots == 0)
+    		return (row[col/64] >> (col%64)) & 1;
+	// a pending pivot row is R_k up to its own pivot and then takes part in the subsequent pivots
+	size_t first = 0, extra_col = ~size_t(0);
+	for (size_t k = 0; k < pending_pivots; ++k)
+		if (pending_ISD[k] == ISD_idx)
+		{
+			row = pivot_rows.word_ptr(k);
+			first = k + 1;
+			extra_col = pending_col[k];
+		}
+	// the pivots in [first,end) that have been selected so far modify the bits of the row
+	unsigned sel = 0;
+	auto bit = [&](size_t c, size_t end)
+		{
+			unsigned x = unsigned((row[c/64] >> (c%64)) & 1) ^ unsigned(c == extra_col);
+			for (size_t i = first; i < end; ++i)
+				if ((sel >> i) & 1)
+					x ^= unsigned((pivot_src[i][c/64] >> (c%64)) & 1);
+			return x;
+		};
+	for (size_t j = first; j < pending_pivots; ++j)
+		sel |= bit(pending_col[j], j) << j;
+	return bit(col, pending_pivots);
+    }
+
+    // swap_echelon or add to the batch of pending pivots
+    void add_pivot(size_t echelon_idx, size_t ISD_idx)
+    {
+    	if (batch_pivots <= 1)
+    	{
+    		swap_echelon(echelon_idx, ISD_idx);
+    		return;
+    	}
+    	if (pending_pivots == batch_pivots || std::find(pending_ISD, pending_ISD + pending_pivots, ISD_idx) != pending_ISD + pending_pivots)
+    		flush_pivots();
+	const size_t k = pending_pivots, pivotcol = HT_columns - echelon_idx - 1;
+	std::swap(perm[echelon_idx], perm[echelon_rows + ISD_idx]);
+	// R_k: the current ISD row after the pending pivots
+	uint64_t* R = pivot_rows.word_ptr(k);
+	std::copy(HST.word_ptr(echelon_rows + ISD_idx), HST.word_ptr(echelon_rows + ISD_idx) + HST.row_words(), R);
+	if (k > 0)
+		simd_kernels.xor_rows_if_bits(R, pivot_rows.word_stride(), 1, pivot_src, pending_col, k, HST.row_words());
+	R[pivotcol/64] &= ~(uint64_t(1) << (pivotcol%64));
+	pivot_src[k] = R;
+	pending_col[k] = pivotcol;
+	pending_ISD[k] = ISD_idx;
+	++pending_pivots;
+    }
+
+    void flush_pivots()
+    {
+    	const size_t m = pending_pivots;
+    	if (m == 0)
+    		return;
+    	pending_pivots = 0;
+	// the key of a row consists of its bits in the pivot columns, pivot j is at bit keypos[j]
+	// usually the pivot columns are consecutive and lie within one word, then the key is obtained by a single shift
+	size_t lo = *std::min_element(pending_col, pending_col + m), keypos[max_batch_pivots];
+	unsigned keybits = 0;
+	bool oneword = true;
+	for (size_t j = 0; j < m; ++j)
+	{
+		keypos[j] = pending_col[j] - lo;
+		oneword = oneword && (keypos[j] < 8) && (pending_col[j]/64 == lo/64) && !((keybits >> keypos[j]) & 1);
+		keybits |= 1u << std::min<size_t>(keypos[j], 31);
+	}
+	if (!oneword)
+		for (size_t j = 0; j < m; ++j)
+			keypos[j] = j;
+	// keymask[j]: the change of the key when pivot j is added to the selection
+	unsigned keymask[max_batch_pivots];
+	for (size_t j = 0; j < m; ++j)
+	{
+		keymask[j] = 1u << keypos[j];
+		for (size_t i = j + 1; i < m; ++i)
+			keymask[j] |= unsigned((pivot_src[j][pending_col[i]/64] >> (pending_col[i]%64)) & 1) << keypos[i];
+	}
+	// Gray code table: entry g is the sum of a selection of pivot rows, key_index maps the key of a row to its entry
+	const size_t blocks = HST.row_blocks();
+	std::fill(pivot_table.word_ptr(0), pivot_table.word_ptr(0) + pivot_table.row_words(), uint64_t(0));
+	unsigned key = 0;
+	key_index[0] = 0;
+	for (size_t g = 1; g < (size_t(1) << m); ++g)
+	{
+		const size_t j = __builtin_ctzll(g);
+		auto* dst = pivot_table.block_ptr(g);
+		auto* prv = pivot_table.block_ptr(g - 1);
+		auto* src = pivot_rows.block_ptr(j);
+		for (size_t b = 0; b < blocks; ++b)
+			dst[b] = prv[b] ^ src[b];
+		key ^= keymask[j];
+		key_index[key] = uint8_t(g);
+	}
+	// single pass over the ISD rows and S
+	const size_t keyword = lo / 64, keyshift = lo % 64;
+	for (size_t r = echelon_rows; r < HST.rows(); ++r)
+	{
+		const uint64_t* row = HST.word_ptr(r);
+		if (oneword)
+			key = unsigned(row[keyword] >> keyshift) & keybits;
+		else
+		{
+			key = 0;
+			for (size_t j = 0; j < m; ++j)
+				key |= unsigned((row[pending_col[j]/64] >> (pending_col[j]%64)) & 1) << j;
+		}
+		auto* dst = HST.block_ptr(r);
+		auto* src = pivot_table.block_ptr(key_index[key]);
+		for (size_t b = 0; b < blocks; ++b)
+			dst[b] ^= src[b];
+	}
+	// the pivot ISD rows skip their own pivot: R_k followed by the subsequent pivots
+	for (size_t k = 0; k < m; ++k)
+	{
+		uint64_t* row = HST.word_ptr(echelon_rows + pending_ISD[k]);
+		std::copy(pivot_src[k], pivot_src[k] + HST.row_words(), row);
+		row[pending_col[k]/64] |= uint64_t(1) << (pending_col[k]%64);
+		if (k + 1 < m)
+			simd_kernels.xor_rows_if_bits(row, HST.word_stride(), 1, pivot_src + k + 1, pending_col + k + 1, m - k - 1, HST.row_words());
+	}
+    }
+
+    // the table has 2^batch_pivots entries, so only use large batches when there are many more rows
+    void _set_batch_pivots()
+    {
+    	batch_pivots = update_batch;
+    	if (batch_pivots == 0)
+    		for (batch_pivots = max_batch_pivots; batch_pivots > 1 && (size_t(2) << batch_pivots) > ISD_rows + 1; --batch_pivots)
+    			;
+    	pending_pivots = 0;
+    	if (batch_pivots <= 1)
+    		return;
+	pivot_rows.resize(max_batch_pivots, HT_columns);
+	pivot_table.resize(size_t(1) << batch_pivots, HT_columns);
+	pivot_rows.m_clear();
+	pivot_table.m_clear();
+    }
+
+    // allocate HST, create views and reset permutations for HT: HTrows x HTcols and H2T: HTrows x l_
+    void _setup(size_t HTrows, size_t HTcols, size_t l_)
+    {
+    	HT_columns = HTcols;
+    	H2T_columns = l_;
+    	H1T_columns = HTcols - l_;
+    	echelon_rows = HTcols - l_;
+    	ISD_rows = HTrows - echelon_rows;
+    	max_update_rows = size_t( float(echelon_rows) * float(ISD_rows) / float(echelon_rows+ISD_rows) );
+
+    	HST.resize(HTrows + 1, HTcols);
+    	HST.m_clear();
+
+    	// create views
+    	_HT        .reset(HST.submatrix(0, HTrows));
+    	_H12T      .reset(HST.submatrix(echelon_rows, ISD_rows));
+    	_S         .reset(HST[HTrows].subvector());
+
+	_H2T      .reset(HST.submatrix(echelon_rows, ISD_rows, H2T_columns));
+	_S2       .reset(_S.subvector(H2T_columns));
+
+    	// setup HT row perm
+    	perm.resize(HTrows);
+    	std::iota(perm.begin(), perm.end(), 0);
+
+    	// setup HT echelon row perm: used to pick u random echelon rows
+    	echelon_perm.resize(echelon_rows);
+    	std::iota(echelon_perm.begin(), echelon_perm.end(), 0);
+    	cur_echelon_row = 0;
+
+    	// setup HT ISD row perm: used to pick u random ISD rows
+    	ISD_perm.resize(ISD_rows);
+    	std::iota(ISD_perm.begin(), ISD_perm.end(), 0);
+    	cur_ISD_row = 0; rnd_ISD_row = 0;
+
+    	_set_batch_pivots();
+    }
+
     mat_t<this_block_tag> HST;
 
     mat_view_t<this_block_tag> _HT, _H12T;
@@ -362,6 +550,12 @@ private:
     size_t echelon_rows, ISD_rows, max_update_rows, echelon_start, cur_echelon_row, cur_ISD_row, rnd_ISD_row;
     std::vector<uint32_t> echelon_perm, ISD_perm;
 
+    size_t update_batch = 0, batch_pivots = 0, pending_pivots = 0;
+    size_t pending_col[max_batch_pivots], pending_ISD[max_batch_pivots];
+    const uint64_t* pivot_src[max_batch_pivots];
+    uint8_t key_index[size_t(1) << max_batch_pivots];
+    mat_t<this_block_tag> pivot_rows, pivot_table;
+
     mccl_base_random_generator rndgen;
 };
 
@@ -1,7 +1,10 @@
 #include <mccl/config/config.hpp>
 #include <mccl/core/matrix_ops.hpp>
+#include <mccl/core/matrix_echelon.hpp>
+#include <mccl/core/simd_kernels.hpp>
 
 #include <cassert>
+#include <vector>
 
 MCCL_BEGIN_NAMESPACE
 
@@ -209,9 +212,8 @@ size_t m_hw(const cm_ptr& m)
 	for (size_t r = 0; r < m.rows; ++r)
 	{
 		auto first1 = m.data(r), last1 = m.data(r) + words - 1;
-		for (; first1 != last1; ++first1)
-			hw += hammingweight(*first1);
-		hw += hammingweight((*first1) & lwm);
+		hw += simd_kernels.hw(first1, words - 1);
+		hw += hammingweight((*last1) & lwm);
 	}
 	return hw;
 }
@@ -245,6 +247,38 @@ void m_swapcolumns(const m_ptr& m, size_t c1, size_t c2)
 	}
 }
 
+// the rows are processed in strips of 64 rows: a strip is transposed so that every column is one word,
+// the words are permuted and the result is transposed back
+// so a full permutation costs a few passes over the matrix instead of one pass per column swap
+void m_permute_columns(const m_ptr& m, const size_t* perm, size_t perm_size)
+{
+	if (perm_size != m.columns)
+		throw std::out_of_range("m_permute_columns: permutation size does not match");
+	for (size_t c = 0; c < m.columns; ++c)
+		if (perm[c] >= m.columns)
+			throw std::out_of_range("m_permute_columns: column out of range");
+	if (m.columns == 0 || m.rows == 0)
+		return;
+	const size_t words = (m.columns + 63)/64;
+	std::vector<uint64_t> strip(64 * words, 0), T(64 * words), TP(64 * words);
+	for (size_t r = 0; r < m.rows; r += 64)
+	{
+		const size_t rows = std::min<size_t>(64, m.rows - r);
+		for (size_t i = 0; i < rows; ++i)
+			std::copy(m.data(r + i), m.data(r + i) + words, strip.data() + i * words);
+		for (size_t w = 0; w < words; ++w)
+			simd_kernels.transpose64(T.data() + 64 * w, 1, strip.data() + w, words);
+		for (size_t c = 0; c < m.columns; ++c)
+			TP[c] = T[perm[c]];
+		// the padding bits of the last word are kept
+		std::copy(T.begin() + m.columns, T.end(), TP.begin() + m.columns);
+		for (size_t w = 0; w < words; ++w)
+			simd_kernels.transpose64(strip.data() + w, words, TP.data() + 64 * w, 1);
+		for (size_t i = 0; i < rows; ++i)
+			std::copy(strip.data() + i * words, strip.data() + (i + 1) * words, m.data(r + i));
+	}
+}
+
 void m_setcolumns(const m_ptr& m, size_t coloffset, size_t cols, bool b)
 {
 	if (b)
@@ -320,114 +354,6 @@ void m_clearcolumns(const m_ptr& m, size_t coloffset, size_t cols)
 
 /* TRANSPOSE FUNCTIONS */
 
-template<size_t bits = 64>
-void block_transpose(uint64_t* dst, size_t dststride, const uint64_t* src, size_t srcstride)
-{
-	static_assert(0 == (bits&(bits-1)), "bits must be power of 2");
-	static_assert(64 >= bits, "bits must not exceed uint64_t bitsize");
-
-	
-	// mask of lower half bits
-	uint64_t m = (uint64_t(1) << (bits/2))-1;
-	unsigned int j = (bits/2);
-	uint64_t tmp[bits];
-
-	// first loop iteration, load src store in tmp
-//#pragma unroll
-	const uint64_t* src2 = src + ((bits/2)*srcstride);
-	for (unsigned int k=0;  k<bits/2;  ++k, src+=srcstride, src2+=srcstride)
-	{
-		// j = (bits/2)
-		uint64_t a = *src, b = *src2;
-		uint64_t t = ((a>>(bits/2)) ^ b) & m;
-		tmp[k] = a ^ (t << (bits/2));
-		tmp[k+(bits/2)] = b ^ t;
-	}
-	j>>=1; m^=m<<j;
-	// main loop
-	for (;  1 != j;  j>>=1,m^=m<<j)
-	{
-//#pragma unroll
-		for (unsigned int l=0,k=0;  l<bits/2;  ++l)
-		{
-			uint64_t t = ((tmp[k]>>j) ^ tmp[k+j]) & m;
-			tmp[k] ^= t<<j;
-			tmp[k+j] ^= t;
-			k=(k+j+1)&~j;
-		}
-	}
-	// last loop iteration (j==1), load tmp store in dst
-//#pragma unroll
-	const uint64_t bitmask = (~uint64_t(0)) >> (64 - bits);
-	for (unsigned int k=0;  k<bits;  k += 2)
-	{
-		uint64_t t = ((tmp[k]>>1) ^ tmp[k+1]) & m;
-		uint64_t val = tmp[k] ^ (t<<1);
-		*dst ^= (*dst ^ val) & bitmask;
-		dst+=dststride;
-		val = tmp[k+1] ^ t;
-		*dst ^= (*dst ^ val) & bitmask;
-		dst+=dststride;
-	}
-}
-
-template<size_t bits = 64>
-inline void block_transpose2(uint64_t* dst, size_t dststride, const uint64_t* src, size_t srcstride)
-{
-	static_assert(0 == (bits&(bits-1)), "bits must be power of 2");
-	static_assert(64 >= bits, "bits must not exceed uint64_t bitsize");
-
-	// mask of lower half bits
-	uint64_t m = (uint64_t(1) << (bits/2))-1;
-	unsigned int j = (bits/2);
-	uint64_t tmp[2*bits];
-
-	// first loop iteration, load src store in tmp
-//#pragma unroll
-	const uint64_t* src2 = src + ((bits/2)*srcstride);
-	for (unsigned int k=0;  k<bits/2;  ++k, src+=srcstride, src2+=srcstride)
-	{
-		// j = (bits/2)
-		uint64_t a1 = *src, b1 = *src2;
-		uint64_t t1 = ((a1>>(bits/2)) ^ b1) & m;
-		tmp[k] = a1 ^ (t1 << (bits/2));
-		tmp[k+(bits/2)] = b1 ^ t1;
-		uint64_t a2 = *(src+1), b2 = *(src2+1);
-		uint64_t t2 = ((a2>>(bits/2)) ^ b2) & m;
-		tmp[k+bits] = a2 ^ (t2 << (bits/2));
-		tmp[k+(bits/2)+bits] = b2 ^ t2;
-	}
-	j>>=1; m^=m<<j;
-	// main loop
-	for (;  1 != j;  j>>=1,m^=m<<j)
-	{
-//#pragma unroll
-		for (unsigned int l=0,k=0;  l<bits/2;  ++l)
-		{
-			uint64_t t = ((tmp[k]>>j) ^ tmp[k+j]) & m;
-			tmp[k] ^= t<<j;
-			tmp[k+j] ^= t;
-			uint64_t t2 = ((tmp[k+bits]>>j) ^ tmp[k+j+bits]) & m;
-			tmp[k+bits] ^= t2<<j;
-			tmp[k+j+bits] ^= t2;
-			k=(k+j+1)&~j;
-		}
-	}
-	// last loop iteration (j==1), load tmp store in dst
-//#pragma unroll
-	const uint64_t bitmask = (~uint64_t(0)) >> (64 - bits);
-	for (unsigned int k=0;  k<2*bits;  k += 2)
-	{
-		uint64_t t = ((tmp[k]>>1) ^ tmp[k+1]) & m;
-		uint64_t val = tmp[k] ^ (t<<1);
-		*dst ^= (*dst ^ val) & bitmask;
-		dst+=dststride;
-		val = tmp[k+1] ^ t;
-		*dst ^= (*dst ^ val) & bitmask;
-		dst+=dststride;
-	}
-}
-
 template<size_t bits = 64>
 inline void block_transpose(uint64_t* dst, size_t dststride, size_t dstrows, const uint64_t* src, size_t srcstride, size_t srcrows)
 {
@@ -570,6 +496,12 @@ inline void block_transpose(uint64_t* dst, size_t dststride, size_t dstrows, con
 
 
 
+// matrices with fewer bits than this are transposed single-threaded
+static const size_t transpose_parallel_min_bits = size_t(1) << 22;
+static const size_t transpose_parallel_min_blocks = 16;
+// number of 64-column blocks of a tile, i.e. 64 bytes of each source row
+static const size_t transpose_tile_blocks = 8;
+
 void m_transpose(const m_ptr& dst, const cm_ptr& src)
 {
 	static const size_t bits = 64;
@@ -585,45 +517,38 @@ void m_transpose(const m_ptr& dst, const cm_ptr& src)
 		std::cout << dst.ptr << " " << src.ptr << std::endl;
 		throw std::runtime_error("m_transpose: src and dst are equal! cannot transpose inplace");
 	}
-	// process batch of bits rows
-	size_t r = 0;
-	for (; r+bits <= src.rows; r += bits)
-	{
-		// process block of bits columns
-		size_t c = 0;
-		for (; c+2*bits <= src.columns; c += 2*bits)
-		{
-			block_transpose2(dst.data(c,r), dst.stride, src.data(r,c), src.stride);
-		}
-		if (c+bits <= src.columns)
-		{
-			block_transpose(dst.data(c,r), dst.stride, src.data(r,c), src.stride);
-			c += bits;
-		}
-		// process block of partial C columns
-		if (c < src.columns)
-		{
-			block_transpose(dst.data(c,r), dst.stride, (src.columns % bits), src.data(r,c), src.stride, bits);
-		}
-	}
-	// process last rows
-	if (r < src.rows)
+	// transposes the source column blocks [cb_begin,cb_end), i.e. writes only the corresponding dst rows
+	// full 64x64 blocks use the dispatched SIMD kernel, blocks at the matrix border the partial block_transpose
+	// column blocks are processed in tiles, so that each source row is read one cache line at a time
+	auto transpose_blocks = [&](size_t cb_begin, size_t cb_end)
 	{
-		size_t c = 0;
-		for (; c+bits <= src.columns; c += bits)
-		{
-			block_transpose(dst.data(c,r), dst.stride, bits, src.data(r,c), src.stride, (src.rows % bits));
-		}
-		// process final bits x C submatrix
-		if (c < src.columns)
+		for (size_t tb = cb_begin; tb < cb_end; tb += transpose_tile_blocks)
+		for (size_t r = 0; r < src.rows; r += bits)
 		{
-			size_t partialbits = next_pow2<uint32_t>(std::max(src.columns % bits, src.rows % bits));
-			if (partialbits == bits)
-				block_transpose(dst.data(c,r), dst.stride, (src.columns % bits), src.data(r,c), src.stride, (src.rows % bits));
-			else
-				block_transpose(dst.data(c,r), dst.stride, (src.columns % bits), src.data(r,c), src.stride, (src.rows % bits), partialbits);
+			const size_t rbits = std::min(bits, src.rows - r);
+			const size_t c_end = std::min(std::min(tb + transpose_tile_blocks, cb_end) * bits, src.columns);
+			for (size_t c = tb * bits; c < c_end; c += bits)
+			{
+				const size_t cbits = std::min(bits, src.columns - c);
+				if (rbits == bits && cbits == bits)
+				{
+					simd_kernels.transpose64(dst.data(c,r), dst.stride, src.data(r,c), src.stride);
+					continue;
+				}
+				size_t partialbits = next_pow2<uint32_t>(std::max(cbits, rbits));
+				if (partialbits == bits)
+					block_transpose(dst.data(c,r), dst.stride, cbits, src.data(r,c), src.stride, rbits);
+				else
+					block_transpose(dst.data(c,r), dst.stride, cbits, src.data(r,c), src.stride, rbits, partialbits);
+			}
 		}
-	}
+	};
+	// large matrices are divided by column blocks over the echelonize threads, so that threads write disjoint dst rows
+	const size_t column_blocks = (src.columns + bits - 1) / bits;
+	if (src.rows * src.columns < transpose_parallel_min_bits)
+		transpose_blocks(0, column_blocks);
+	else
+		echelonize_parallel_rows(column_blocks, transpose_blocks, transpose_parallel_min_blocks);
 }
 
 
@@ -707,6 +632,7 @@ MCCL_MATRIX_BASE_FUNCTION_1OP(clear,*first1r^*first1r)
 MCCL_MATRIX_BASE_FUNCTION_1OP(set,*first1r|~*first1r)
 
 
+// the full blocks of all rows are processed by the dispatched simd_kernels.bitop_rows
 #define MCCL_MATRIX_BASE_FUNCTION_2OP(func,expr) \
 template<size_t bits, bool masked> \
 void m_ ## func (const m_ptr& dst, const cm_ptr& m2, block_tag<bits,masked>) \
@@ -716,27 +642,17 @@ void m_ ## func (const m_ptr& dst, const cm_ptr& m2, block_tag<bits,masked>) \
         if (dst.rows == 0 || dst.columns == 0) \
                 return; \
         size_t blocks = (dst.columns + bits-1)/bits - (masked?1:0); \
-        const size_t stride1 = dst.stride / (bits/64); \
-        const size_t stride2 =  m2.stride / (bits/64); \
-        auto first1 = make_block_ptr(dst.ptr, block_tag<bits,masked>()); \
-        auto first2 = make_block_ptr( m2.ptr, block_tag<bits,masked>()); \
-        if (!masked)  \
+        simd_kernels.bitop_rows(simd_op::op_ ## func, dst.ptr, dst.stride, dst.ptr, dst.stride, m2.ptr, m2.stride, dst.rows, blocks * (bits/64)); \
+        if (masked)  \
         { \
-	        for (size_t r = 0; r < dst.rows; ++r, first1+=stride1, first2+=stride2) \
-	        { \
-	        	auto first1r = first1, last1r = first1r + blocks; \
-	        	auto first2r = first2; \
-		        for (; first1r != last1r; ++first1r,++first2r) \
-		        	*first1r = expr ; \
-		} \
-	} else { \
+                const size_t stride1 = dst.stride / (bits/64); \
+                const size_t stride2 =  m2.stride / (bits/64); \
+                auto first1 = make_block_ptr(dst.ptr, block_tag<bits,masked>()) + blocks; \
+                auto first2 = make_block_ptr( m2.ptr, block_tag<bits,masked>()) + blocks; \
                 auto lwm = lastwordmask(dst.columns, block_tag<bits,masked>()); \
 	        for (size_t r = 0; r < dst.rows; ++r, first1+=stride1, first2+=stride2) \
 	        { \
-	        	auto first1r = first1, last1r = first1r + blocks; \
-	        	auto first2r = first2; \
-		        for (; first1r != last1r; ++first1r,++first2r) \
-		        	*first1r = expr ; \
+	        	auto first1r = first1, first2r = first2; \
 			auto diff = lwm & (( expr ) ^ *first1r); \
 			*first1r ^= diff; \
 		} \
@@ -774,31 +690,19 @@ void m_ ## func (const m_ptr& dst, const cm_ptr& m2, const cm_ptr& m3, block_tag
         if (dst.rows == 0 || dst.columns == 0) \
                 return; \
         size_t blocks = (dst.columns + bits-1)/bits - (masked?1:0); \
-        const size_t stride1 = dst.stride / (bits/64); \
-        const size_t stride2 =  m2.stride / (bits/64); \
-        const size_t stride3 =  m3.stride / (bits/64); \
-        auto first1 = make_block_ptr(dst.ptr, block_tag<bits,masked>()); \
-        auto first2 = make_block_ptr( m2.ptr, block_tag<bits,masked>()); \
-        auto first3 = make_block_ptr( m3.ptr, block_tag<bits,masked>()); \
-        if (!masked)  \
+        simd_kernels.bitop_rows(simd_op::op_ ## func, dst.ptr, dst.stride, m2.ptr, m2.stride, m3.ptr, m3.stride, dst.rows, blocks * (bits/64)); \
+        if (masked)  \
         { \
-	        for (size_t r = 0; r < dst.rows; ++r, first1+=stride1, first2+=stride2, first3 += stride3) \
-	        { \
-	        	auto first1r = first1, last1r = first1r + blocks; \
-	        	auto first2r = first2; \
-	        	auto first3r = first3; \
-		        for (; first1r != last1r; ++first1r,++first2r,++first3r) \
-		        	*first1r = expr ; \
-		} \
-	} else { \
+                const size_t stride1 = dst.stride / (bits/64); \
+                const size_t stride2 =  m2.stride / (bits/64); \
+                const size_t stride3 =  m3.stride / (bits/64); \
+                auto first1 = make_block_ptr(dst.ptr, block_tag<bits,masked>()) + blocks; \
+                auto first2 = make_block_ptr( m2.ptr, block_tag<bits,masked>()) + blocks; \
+                auto first3 = make_block_ptr( m3.ptr, block_tag<bits,masked>()) + blocks; \
                 auto lwm = lastwordmask(dst.columns, block_tag<bits,masked>()); \
 	        for (size_t r = 0; r < dst.rows; ++r, first1+=stride1, first2+=stride2, first3 += stride3) \
 	        { \
-	        	auto first1r = first1, last1r = first1r + blocks; \
-	        	auto first2r = first2; \
-	        	auto first3r = first3; \
-		        for (; first1r != last1r; ++first1r,++first2r,++first3r) \
-		        	*first1r = expr ; \
+	        	auto first1r = first1, first2r = first2, first3r = first3; \
 			auto diff = lwm & (( expr ) ^ *first1r); \
 			*first1r ^= diff; \
 		} \
@@ -4,6 +4,7 @@
 #include <mccl/config/config.hpp>
 
 #include <mccl/core/matrix_base.hpp>
+#include <mccl/core/simd_kernels.hpp>
 
 #include <iostream>
 #include <array>
@@ -113,6 +114,8 @@ void m_print(std::ostream& o, const cm_ptr& m, bool transpose = false);
 size_t m_hw(const cm_ptr& m);
 
 void m_swapcolumns(const m_ptr& m, size_t c1, size_t c2);
+// new column c = old column perm[c] for all c < m.columns, perm has m.columns entries
+void m_permute_columns(const m_ptr& m, const size_t* perm, size_t perm_size);
 void m_setcolumns(const m_ptr& m, size_t coloffset, size_t cols, bool b);
 void m_setcolumns(const m_ptr& m, size_t coloffset, size_t cols);
 void m_clearcolumns(const m_ptr& m, size_t coloffset, size_t cols);
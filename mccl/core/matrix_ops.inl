@@ -15,13 +15,13 @@ inline size_t hammingweight(uint32_t n)
 {
 	return __builtin_popcountl(n);
 }
+// vectors of at most this many words (excluding a masked last block) are processed inline instead of by the dispatched simd_kernels
+static const size_t simd_min_words = 8;
+
 template<size_t bits>
 inline size_t hammingweight(const uint64_block_t<bits>& v)
 {
-	size_t hw = 0;
-	for (unsigned i = 0; i < v.size; ++i)
-		hw += __builtin_popcountll(v.v[i]);
-	return hw;
+	return v.hammingweight();
 }
 
 inline uint64_t rotate_right(uint64_t x, unsigned n)
@@ -168,6 +168,8 @@ inline size_t v_hw(const cv_ptr& v)
 	uint64_t lwm = lastwordmask(v.columns);
 	size_t hw = 0;
 	auto first1 = v.data(), last1 = v.data() + words - 1;
+	if (words > simd_min_words)
+		return simd_kernels.hw(first1, words - 1) + hammingweight((*last1) & lwm);
 	for (; first1 != last1; ++first1)
 		hw += hammingweight(*first1);
 	hw += hammingweight((*first1) & lwm);
@@ -219,6 +221,8 @@ inline size_t v_hw_xor(const cv_ptr& v1, const cv_ptr& v2)
 	size_t hw = 0;
 	auto first1 = v1.data(), last1 = v1.data() + words - 1;
 	auto first2 = v2.data();
+	if (words > simd_min_words)
+		return simd_kernels.hw_xor(first1, first2, words - 1) + hammingweight((*last1 ^ first2[words - 1]) & lwm);
 	for (; first1 != last1; ++first1,++first2)
 		hw += hammingweight(*first1 ^ *first2);
 	hw += hammingweight((*first1 ^ *first2) & lwm);
@@ -317,6 +321,12 @@ inline void v_ ## func (const v_ptr& dst, const cv_ptr& v1, block_tag<bits,maske
 	size_t words = (dst.columns + bits-1)/bits - (masked?1:0); \
 	auto firstd = make_block_ptr(dst.ptr, block_tag<bits,masked>()), lastd = firstd + words; \
 	auto first1 = make_block_ptr(v1.ptr, block_tag<bits,masked>()); \
+	if (words * (bits/64) > simd_min_words) \
+	{ \
+		simd_kernels.bitop_rows(simd_op::op_ ## func, dst.ptr, 0, dst.ptr, 0, v1.ptr, 0, 1, words * (bits/64)); \
+		firstd = lastd; \
+		first1 += words; \
+	} \
 	for (; firstd != lastd; ++firstd, ++first1) \
 		*firstd = expr ; \
 	if (masked) \
@@ -354,6 +364,13 @@ inline void v_ ## func (const v_ptr& dst, const cv_ptr& v1, const cv_ptr& v2, bl
 	auto firstd = make_block_ptr(dst.ptr, block_tag<bits,masked>()), lastd = firstd + words; \
 	auto first1 = make_block_ptr(v1.ptr, block_tag<bits,masked>()); \
 	auto first2 = make_block_ptr(v2.ptr, block_tag<bits,masked>()); \
+	if (words * (bits/64) > simd_min_words) \
+	{ \
+		simd_kernels.bitop_rows(simd_op::op_ ## func, dst.ptr, 0, v1.ptr, 0, v2.ptr, 0, 1, words * (bits/64)); \
+		firstd = lastd; \
+		first1 += words; \
+		first2 += words; \
+	} \
 	for (; firstd != lastd; ++firstd, ++first1, ++first2) \
 		*firstd = expr ; \
 	if (masked) \
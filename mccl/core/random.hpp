@@ -52,6 +52,16 @@ struct mccl_base_random_generator
     std::mt19937_64 rnd;
 };
 
+// derive a seed from a base seed and an index (e.g. trial or thread number) using splitmix64
+// so that consecutive indices lead to unrelated seeds
+inline uint64_t derive_seed(uint64_t seed, uint64_t index)
+{
+    uint64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
 MCCL_END_NAMESPACE
 
 #endif
@@ -0,0 +1,489 @@
+#include <mccl/config/config.hpp>
+#include <mccl/core/simd_kernels.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MCCL_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#define MCCL_SIMD_PRAGMA(x) _Pragma(#x)
+#if defined(MCCL_SIMD_X86) && defined(__clang__)
+#define MCCL_SIMD_TARGET_BEGIN(isa)    MCCL_SIMD_PRAGMA(clang attribute push (__attribute__((target(isa))), apply_to = function))
+#define MCCL_SIMD_TARGET_END           MCCL_SIMD_PRAGMA(clang attribute pop)
+#elif defined(MCCL_SIMD_X86)
+#define MCCL_SIMD_TARGET_BEGIN(isa)    MCCL_SIMD_PRAGMA(GCC push_options) MCCL_SIMD_PRAGMA(GCC target(isa))
+#define MCCL_SIMD_TARGET_END           MCCL_SIMD_PRAGMA(GCC pop_options)
+#endif
+
+// the AVX-512 intrinsics that start from an undefined vector (_mm512_undefined_epi32)
+// trigger false uninitialized warnings in gcc when they are inlined through target options
+#if defined(MCCL_SIMD_X86) && !defined(__clang__)
+#define MCCL_SIMD_AVX512_WARNINGS_BEGIN  MCCL_SIMD_PRAGMA(GCC diagnostic push) \
+                                        MCCL_SIMD_PRAGMA(GCC diagnostic ignored "-Wuninitialized") \
+                                        MCCL_SIMD_PRAGMA(GCC diagnostic ignored "-Wmaybe-uninitialized")
+#define MCCL_SIMD_AVX512_WARNINGS_END    MCCL_SIMD_PRAGMA(GCC diagnostic pop)
+#else
+#define MCCL_SIMD_AVX512_WARNINGS_BEGIN
+#define MCCL_SIMD_AVX512_WARNINGS_END
+#endif
+
+MCCL_BEGIN_NAMESPACE
+
+namespace detail {
+
+namespace simd_generic {
+#include <mccl/core/simd_kernels.inl>
+}
+
+#ifdef MCCL_SIMD_X86
+MCCL_SIMD_TARGET_BEGIN("sse4.2,popcnt")
+namespace simd_sse42 {
+#include <mccl/core/simd_kernels.inl>
+}
+MCCL_SIMD_TARGET_END
+
+// rows ahead of the current row that are prefetched by the explicit row xor kernels
+static const size_t prefetch_rows = 4;
+
+#define MCCL_SIMD_EXPLICIT_XOR_ROWS
+#define MCCL_SIMD_EXPLICIT_HW
+#define MCCL_SIMD_EXPLICIT_TRANSPOSE
+
+MCCL_SIMD_TARGET_BEGIN("avx2,popcnt")
+namespace simd_avx2 {
+#include <mccl/core/simd_kernels.inl>
+
+struct vec_ops
+{
+	typedef __m256i vec;
+	static const size_t words = 4;
+	static const bool harley_seal = true;
+	static vec zero() { return _mm256_setzero_si256(); }
+	static vec tailmask(size_t n) { return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_setr_epi64x(0, 1, 2, 3)); }
+	static vec load(const uint64_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static vec load_tail(const uint64_t* p, size_t n) { return _mm256_maskload_epi64((const long long*)p, tailmask(n)); }
+	static void store(uint64_t* p, vec x) { _mm256_storeu_si256((__m256i*)p, x); }
+	static void store_tail(uint64_t* p, size_t n, vec x) { _mm256_maskstore_epi64((long long*)p, tailmask(n), x); }
+	static vec bxor(vec a, vec b) { return _mm256_xor_si256(a, b); }
+	static vec band(vec a, vec b) { return _mm256_and_si256(a, b); }
+	static vec bor(vec a, vec b) { return _mm256_or_si256(a, b); }
+	static vec add(vec a, vec b) { return _mm256_add_epi64(a, b); }
+	template<int n> static vec shl(vec a) { return _mm256_slli_epi64(a, n); }
+	// nibble lookup table, byte counts are summed per 64-bit lane
+	static vec popcount(vec x)
+	{
+		const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4, 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+		const __m256i low = _mm256_set1_epi8(0x0f);
+		__m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, low));
+		__m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low));
+		return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+	}
+	static size_t sum(vec x)
+	{
+		__m128i s = _mm_add_epi64(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+		return size_t(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+	}
+};
+#include <mccl/core/simd_kernels_vec.inl>
+
+// 256-bit loads/stores, masked load/store for the last partial vector
+// branch-free: the src rows are and-ed with an all-zero or all-one mask per row
+template<size_t N>
+void xor_rows_if_bits_n(uint64_t* rows, size_t stride, size_t rows_count, const uint64_t* const* src, const size_t* pivotbit, size_t count, size_t words)
+{
+	if (N != 0)
+		count = N;
+	__m256i mask[simd_max_pivots];
+	const size_t vec_end = words - (words % 4);
+	const __m256i tailmask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(words % 4), _mm256_setr_epi64x(0, 1, 2, 3));
+	const size_t prefetch_offset = prefetch_rows * stride + pivotbit[0] / 64;
+	for (size_t r = 0; r < rows_count; ++r, rows += stride)
+	{
+		if (r + prefetch_rows < rows_count)
+			_mm_prefetch((const char*)(rows + prefetch_offset), _MM_HINT_T0);
+		unsigned sel = select_pivots(rows, src, pivotbit, count);
+		for (size_t j = 0; j < count; ++j)
+			mask[j] = _mm256_set1_epi64x(-int64_t((sel >> j) & 1));
+		size_t i = 0;
+		for (; i < vec_end; i += 4)
+		{
+			__m256i x = _mm256_loadu_si256((const __m256i*)(rows + i));
+			for (size_t j = 0; j < count; ++j)
+				x = _mm256_xor_si256(x, _mm256_and_si256(mask[j], _mm256_loadu_si256((const __m256i*)(src[j] + i))));
+			_mm256_storeu_si256((__m256i*)(rows + i), x);
+		}
+		if (i < words)
+		{
+			__m256i x = _mm256_maskload_epi64((const long long*)(rows + i), tailmask);
+			for (size_t j = 0; j < count; ++j)
+				x = _mm256_xor_si256(x, _mm256_and_si256(mask[j], _mm256_maskload_epi64((const long long*)(src[j] + i), tailmask)));
+			_mm256_maskstore_epi64((long long*)(rows + i), tailmask, x);
+		}
+	}
+}
+
+// the number of pivots is made a compile time constant for common cases
+void xor_rows_if_bits(uint64_t* rows, size_t stride, size_t rows_count, const uint64_t* const* src, const size_t* pivotbit, size_t count, size_t words)
+{
+	switch (count)
+	{
+		case 1:  xor_rows_if_bits_n<1>(rows, stride, rows_count, src, pivotbit, count, words); break;
+		case 2:  xor_rows_if_bits_n<2>(rows, stride, rows_count, src, pivotbit, count, words); break;
+		case 4:  xor_rows_if_bits_n<4>(rows, stride, rows_count, src, pivotbit, count, words); break;
+		default: xor_rows_if_bits_n<0>(rows, stride, rows_count, src, pivotbit, count, words); break;
+	}
+}
+
+// 64x64 transpose as an 8x8 grid of 8x8 bit tiles, 8 rows are held in 2 vectors of 4 rows:
+// - a byte transpose of each group of 8 rows gives one tile per 64-bit lane, which is transposed within its lane
+// - the lanes are transposed over the row groups, and a second byte transpose gives 8 dst rows per lane group
+// byte transpose of 8 rows in a (rows 0-3) and b (rows 4-7): lane i of a and lane i of b = byte i and byte 4+i of rows 0,...,7
+inline void transpose_bytes8x8(__m256i& a, __m256i& b)
+{
+	const __m256i interleave = _mm256_setr_epi8(0,8,1,9,2,10,3,11,4,12,5,13,6,14,7,15, 0,8,1,9,2,10,3,11,4,12,5,13,6,14,7,15);
+	// 16-bit pairs (row 2k byte i, row 2k+1 byte i) per 128-bit lane
+	__m256i x = _mm256_shuffle_epi8(a, interleave), y = _mm256_shuffle_epi8(b, interleave);
+	__m256i c = _mm256_permute2x128_si256(x, y, 0x20), d = _mm256_permute2x128_si256(x, y, 0x31);
+	// 32-bit quads (rows 0-3 byte i) and (rows 4-7 byte i)
+	__m256i lo = _mm256_unpacklo_epi16(c, d), hi = _mm256_unpackhi_epi16(c, d);
+	__m256i f = _mm256_permute2x128_si256(lo, hi, 0x20), g = _mm256_permute2x128_si256(lo, hi, 0x31);
+	// byte i of rows 0-7, in lane order 0,1,4,5 and 2,3,6,7
+	__m256i p = _mm256_unpacklo_epi32(f, g), q = _mm256_unpackhi_epi32(f, g);
+	a = _mm256_permute2x128_si256(p, q, 0x20);
+	b = _mm256_permute2x128_si256(p, q, 0x31);
+}
+
+// transpose the 8x8 bit tile in each 64-bit lane, byte i is row i
+inline __m256i transpose_tiles(__m256i x)
+{
+	__m256i t;
+	t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 7)), _mm256_set1_epi64x(0x00AA00AA00AA00AALL));
+	x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 7)));
+	t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 14)), _mm256_set1_epi64x(0x0000CCCC0000CCCCLL));
+	x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 14)));
+	t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 28)), _mm256_set1_epi64x(0x00000000F0F0F0F0LL));
+	x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 28)));
+	return x;
+}
+
+inline void transpose4x4(__m256i& x0, __m256i& x1, __m256i& x2, __m256i& x3)
+{
+	__m256i t0 = _mm256_unpacklo_epi64(x0, x1), t1 = _mm256_unpackhi_epi64(x0, x1);
+	__m256i t2 = _mm256_unpacklo_epi64(x2, x3), t3 = _mm256_unpackhi_epi64(x2, x3);
+	x0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+	x1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+	x2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+	x3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+void transpose64(uint64_t* dst, size_t dststride, const uint64_t* src, size_t srcstride)
+{
+	const __m256i srcidx = _mm256_setr_epi64x(0, srcstride, 2*srcstride, 3*srcstride);
+	// x[g][h]: lanes are rows 8g+4h,...,8g+4h+3, after the first byte transpose: tiles (g, 4h),...,(g, 4h+3)
+	__m256i x[8][2];
+	for (size_t g = 0; g < 8; ++g)
+	{
+		const long long* p = (const long long*)(src + 8 * g * srcstride);
+		x[g][0] = _mm256_i64gather_epi64(p, srcidx, 8);
+		x[g][1] = _mm256_i64gather_epi64(p + 4 * srcstride, srcidx, 8);
+		transpose_bytes8x8(x[g][0], x[g][1]);
+		x[g][0] = transpose_tiles(x[g][0]);
+		x[g][1] = transpose_tiles(x[g][1]);
+	}
+	// y[c][h]: tiles (4h, c),...,(4h+3, c)
+	__m256i y[8][2];
+	for (size_t h = 0; h < 2; ++h)
+		for (size_t k = 0; k < 2; ++k)
+		{
+			__m256i x0 = x[4*k][h], x1 = x[4*k+1][h], x2 = x[4*k+2][h], x3 = x[4*k+3][h];
+			transpose4x4(x0, x1, x2, x3);
+			y[4*h][k] = x0; y[4*h+1][k] = x1; y[4*h+2][k] = x2; y[4*h+3][k] = x3;
+		}
+	alignas(32) uint64_t out[8];
+	for (size_t c = 0; c < 8; ++c)
+	{
+		transpose_bytes8x8(y[c][0], y[c][1]);
+		_mm256_store_si256((__m256i*)out, y[c][0]);
+		_mm256_store_si256((__m256i*)(out + 4), y[c][1]);
+		uint64_t* d = dst + 8 * c * dststride;
+		for (size_t i = 0; i < 8; ++i)
+			d[i * dststride] = out[i];
+	}
+}
+}
+MCCL_SIMD_TARGET_END
+
+MCCL_SIMD_TARGET_BEGIN("avx512f,avx512bw,avx512vl,popcnt")
+namespace simd_avx512 {
+#include <mccl/core/simd_kernels.inl>
+
+MCCL_SIMD_AVX512_WARNINGS_BEGIN
+struct vec_ops
+{
+	typedef __m512i vec;
+	static const size_t words = 8;
+	static const bool harley_seal = true;
+	static vec zero() { return _mm512_setzero_si512(); }
+	static __mmask8 tailmask(size_t n) { return __mmask8((1u << n) - 1); }
+	static vec load(const uint64_t* p) { return _mm512_loadu_si512((const void*)p); }
+	static vec load_tail(const uint64_t* p, size_t n) { return _mm512_maskz_loadu_epi64(tailmask(n), (const void*)p); }
+	static void store(uint64_t* p, vec x) { _mm512_storeu_si512((void*)p, x); }
+	static void store_tail(uint64_t* p, size_t n, vec x) { _mm512_mask_storeu_epi64((void*)p, tailmask(n), x); }
+	static vec bxor(vec a, vec b) { return _mm512_xor_si512(a, b); }
+	static vec band(vec a, vec b) { return _mm512_and_si512(a, b); }
+	static vec bor(vec a, vec b) { return _mm512_or_si512(a, b); }
+	static vec add(vec a, vec b) { return _mm512_add_epi64(a, b); }
+	template<int n> static vec shl(vec a) { return _mm512_slli_epi64(a, n); }
+	// nibble lookup table, byte counts are summed per 64-bit lane
+	static vec popcount(vec x)
+	{
+		const __m512i lut = _mm512_broadcast_i32x4(_mm_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4));
+		const __m512i low = _mm512_set1_epi8(0x0f);
+		__m512i lo = _mm512_shuffle_epi8(lut, _mm512_and_si512(x, low));
+		__m512i hi = _mm512_shuffle_epi8(lut, _mm512_and_si512(_mm512_srli_epi16(x, 4), low));
+		return _mm512_sad_epu8(_mm512_add_epi8(lo, hi), _mm512_setzero_si512());
+	}
+	static size_t sum(vec x) { return size_t(_mm512_reduce_add_epi64(x)); }
+};
+#include <mccl/core/simd_kernels_vec.inl>
+MCCL_SIMD_AVX512_WARNINGS_END
+
+// 512-bit loads/stores, masked load/store for the last partial vector
+// branch-free: each src row is xored under an all-zero or all-one write mask per row
+template<size_t N>
+void xor_rows_if_bits_n(uint64_t* rows, size_t stride, size_t rows_count, const uint64_t* const* src, const size_t* pivotbit, size_t count, size_t words)
+{
+	if (N != 0)
+		count = N;
+	__mmask8 mask[simd_max_pivots];
+	const size_t vec_end = words - (words % 8);
+	const __mmask8 tailmask = __mmask8((1u << (words % 8)) - 1);
+	const size_t prefetch_offset = prefetch_rows * stride + pivotbit[0] / 64;
+	for (size_t r = 0; r < rows_count; ++r, rows += stride)
+	{
+		if (r + prefetch_rows < rows_count)
+			_mm_prefetch((const char*)(rows + prefetch_offset), _MM_HINT_T0);
+		unsigned sel = select_pivots(rows, src, pivotbit, count);
+		for (size_t j = 0; j < count; ++j)
+			mask[j] = __mmask8(-int((sel >> j) & 1));
+		size_t i = 0;
+		for (; i < vec_end; i += 8)
+		{
+			__m512i x = _mm512_loadu_si512((const void*)(rows + i));
+			for (size_t j = 0; j < count; ++j)
+				x = _mm512_mask_xor_epi64(x, mask[j], x, _mm512_loadu_si512((const void*)(src[j] + i)));
+			_mm512_storeu_si512((void*)(rows + i), x);
+		}
+		if (i < words)
+		{
+			__m512i x = _mm512_maskz_loadu_epi64(tailmask, (const void*)(rows + i));
+			for (size_t j = 0; j < count; ++j)
+				x = _mm512_mask_xor_epi64(x, mask[j], x, _mm512_maskz_loadu_epi64(tailmask, (const void*)(src[j] + i)));
+			_mm512_mask_storeu_epi64((void*)(rows + i), tailmask, x);
+		}
+	}
+}
+
+MCCL_SIMD_AVX512_WARNINGS_BEGIN
+// 64x64 transpose as an 8x8 grid of 8x8 bit tiles, see the avx2 version, here 8 rows fit in one vector
+// byte transpose of 8 rows: lane i = byte i of row 0,...,7
+inline __m512i transpose_bytes8x8(__m512i x)
+{
+	// interleave the bytes of the 2 rows of each 128-bit lane, then gather the 16-bit pairs of each byte index
+	const __m512i interleave = _mm512_broadcast_i32x4(_mm_setr_epi8(0,8,1,9,2,10,3,11,4,12,5,13,6,14,7,15));
+	const __m512i gather = _mm512_set_epi16(31,23,15,7, 30,22,14,6, 29,21,13,5, 28,20,12,4, 27,19,11,3, 26,18,10,2, 25,17,9,1, 24,16,8,0);
+	return _mm512_permutexvar_epi16(gather, _mm512_shuffle_epi8(x, interleave));
+}
+
+// transpose the 8x8 bit tile in each 64-bit lane, byte i is row i
+inline __m512i transpose_tiles(__m512i x)
+{
+	// 0x28: (a ^ b) & c, 0x96: a ^ b ^ c
+	__m512i t;
+	t = _mm512_ternarylogic_epi64(x, _mm512_srli_epi64(x, 7), _mm512_set1_epi64(0x00AA00AA00AA00AALL), 0x28);
+	x = _mm512_ternarylogic_epi64(x, t, _mm512_slli_epi64(t, 7), 0x96);
+	t = _mm512_ternarylogic_epi64(x, _mm512_srli_epi64(x, 14), _mm512_set1_epi64(0x0000CCCC0000CCCCLL), 0x28);
+	x = _mm512_ternarylogic_epi64(x, t, _mm512_slli_epi64(t, 14), 0x96);
+	t = _mm512_ternarylogic_epi64(x, _mm512_srli_epi64(x, 28), _mm512_set1_epi64(0x00000000F0F0F0F0LL), 0x28);
+	x = _mm512_ternarylogic_epi64(x, t, _mm512_slli_epi64(t, 28), 0x96);
+	return x;
+}
+
+void transpose64(uint64_t* dst, size_t dststride, const uint64_t* src, size_t srcstride)
+{
+	const __m512i srcidx = _mm512_setr_epi64(0, srcstride, 2*srcstride, 3*srcstride, 4*srcstride, 5*srcstride, 6*srcstride, 7*srcstride);
+	const __m512i dstidx = _mm512_setr_epi64(0, dststride, 2*dststride, 3*dststride, 4*dststride, 5*dststride, 6*dststride, 7*dststride);
+	// x[g]: lanes are rows 8g,...,8g+7, after the first byte transpose: tiles (g,0),...,(g,7)
+	__m512i x[8];
+	for (size_t g = 0; g < 8; ++g)
+		x[g] = transpose_tiles(transpose_bytes8x8(_mm512_i64gather_epi64(srcidx, (const void*)(src + 8 * g * srcstride), 8)));
+	// y[c]: tiles (0,c),...,(7,c), lanes are transposed in 3 steps of 64-bit, 128-bit and 256-bit granularity
+	__m512i y[8];
+	for (size_t h = 0; h < 2; ++h)
+	{
+		__m512i u[4];
+		for (size_t k = 0; k < 4; ++k)
+			u[k] = (h == 0) ? _mm512_unpacklo_epi64(x[2*k], x[2*k+1]) : _mm512_unpackhi_epi64(x[2*k], x[2*k+1]);
+		__m512i w0 = _mm512_shuffle_i64x2(u[0], u[1], 0x88), w1 = _mm512_shuffle_i64x2(u[0], u[1], 0xDD);
+		__m512i w2 = _mm512_shuffle_i64x2(u[2], u[3], 0x88), w3 = _mm512_shuffle_i64x2(u[2], u[3], 0xDD);
+		y[h]   = _mm512_shuffle_i64x2(w0, w2, 0x88);
+		y[h+4] = _mm512_shuffle_i64x2(w0, w2, 0xDD);
+		y[h+2] = _mm512_shuffle_i64x2(w1, w3, 0x88);
+		y[h+6] = _mm512_shuffle_i64x2(w1, w3, 0xDD);
+	}
+	for (size_t c = 0; c < 8; ++c)
+		_mm512_i64scatter_epi64((void*)(dst + 8 * c * dststride), dstidx, transpose_bytes8x8(y[c]), 8);
+}
+MCCL_SIMD_AVX512_WARNINGS_END
+
+// the number of pivots is made a compile time constant for common cases
+void xor_rows_if_bits(uint64_t* rows, size_t stride, size_t rows_count, const uint64_t* const* src, const size_t* pivotbit, size_t count, size_t words)
+{
+	switch (count)
+	{
+		case 1:  xor_rows_if_bits_n<1>(rows, stride, rows_count, src, pivotbit, count, words); break;
+		case 2:  xor_rows_if_bits_n<2>(rows, stride, rows_count, src, pivotbit, count, words); break;
+		case 4:  xor_rows_if_bits_n<4>(rows, stride, rows_count, src, pivotbit, count, words); break;
+		default: xor_rows_if_bits_n<0>(rows, stride, rows_count, src, pivotbit, count, words); break;
+	}
+}
+}
+MCCL_SIMD_TARGET_END
+
+// AVX-512 with VPOPCNTQ: row xor is shared with the avx512 level
+MCCL_SIMD_TARGET_BEGIN("avx512f,avx512bw,avx512vl,avx512vpopcntdq,popcnt")
+namespace simd_avx512vpopcnt {
+#include <mccl/core/simd_kernels.inl>
+
+using simd_avx512::xor_rows_if_bits;
+using simd_avx512::transpose64;
+
+struct vec_ops
+	: simd_avx512::vec_ops
+{
+	static const bool harley_seal = false;
+	static vec popcount(vec x) { return _mm512_popcnt_epi64(x); }
+};
+#include <mccl/core/simd_kernels_vec.inl>
+}
+MCCL_SIMD_TARGET_END
+
+#undef MCCL_SIMD_EXPLICIT_TRANSPOSE
+#undef MCCL_SIMD_EXPLICIT_HW
+#undef MCCL_SIMD_EXPLICIT_XOR_ROWS
+#endif
+
+#define MCCL_SIMD_KERNELS(level, ns) simd_kernels_t{ level, &ns::hw, &ns::hw_xor, &ns::hw_xor_max, &ns::xor_rows_if_bits, &ns::combine_hw, &ns::bitop_rows, &ns::transpose64 }
+
+simd_level detect_simd_level()
+{
+#ifdef MCCL_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512vpopcntdq") && __builtin_cpu_supports("popcnt"))
+		return simd_level::avx512vpopcnt;
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("popcnt"))
+		return simd_level::avx512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+		return simd_level::avx2;
+	if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+		return simd_level::sse42;
+#endif
+	return simd_level::generic;
+}
+
+} // namespace detail
+
+// constant initialized, so kernels are usable during static initialization of other translation units
+simd_kernels_t simd_kernels = MCCL_SIMD_KERNELS(simd_level::generic, detail::simd_generic);
+
+simd_level simd_cpu_level()
+{
+	static const simd_level level = detail::detect_simd_level();
+	return level;
+}
+
+simd_kernels_t simd_get_kernels(simd_level level)
+{
+	switch (level)
+	{
+#ifdef MCCL_SIMD_X86
+		case simd_level::sse42:  return MCCL_SIMD_KERNELS(level, detail::simd_sse42);
+		case simd_level::avx2:   return MCCL_SIMD_KERNELS(level, detail::simd_avx2);
+		case simd_level::avx512: return MCCL_SIMD_KERNELS(level, detail::simd_avx512);
+		case simd_level::avx512vpopcnt: return MCCL_SIMD_KERNELS(level, detail::simd_avx512vpopcnt);
+#endif
+		default: return MCCL_SIMD_KERNELS(simd_level::generic, detail::simd_generic);
+	}
+}
+
+bool simd_select(simd_level level)
+{
+	if (int(level) > int(simd_cpu_level()))
+		return false;
+	simd_kernels = simd_get_kernels(level);
+	return true;
+}
+
+std::string to_string(simd_level level)
+{
+	switch (level)
+	{
+		case simd_level::sse42:  return "sse4.2";
+		case simd_level::avx2:   return "avx2";
+		case simd_level::avx512: return "avx512";
+		case simd_level::avx512vpopcnt: return "avx512vpopcnt";
+		default: return "generic";
+	}
+}
+
+simd_level parse_simd_level(const std::string& str)
+{
+	if (str == "generic")
+		return simd_level::generic;
+	if (str == "sse4.2" || str == "sse42")
+		return simd_level::sse42;
+	if (str == "avx2")
+		return simd_level::avx2;
+	if (str == "avx512")
+		return simd_level::avx512;
+	if (str == "avx512vpopcnt")
+		return simd_level::avx512vpopcnt;
+	throw std::runtime_error("parse_simd_level: unknown level: " + str);
+}
+
+namespace detail {
+
+// select the best supported kernels when the library is loaded, capped by MCCL_SIMD
+struct simd_kernels_init_t
+{
+	simd_kernels_init_t()
+	{
+		simd_level level = simd_cpu_level();
+		const char* env = std::getenv("MCCL_SIMD");
+		if (env != nullptr && *env != 0)
+		{
+			try
+			{
+				simd_level cap = parse_simd_level(env);
+				if (int(cap) < int(level))
+					level = cap;
+			}
+			catch (std::exception&)
+			{
+				std::cerr << "Warning: ignoring unknown MCCL_SIMD value: " << env << std::endl;
+			}
+		}
+		simd_select(level);
+	}
+};
+static simd_kernels_init_t simd_kernels_init;
+
+} // namespace detail
+
+MCCL_END_NAMESPACE
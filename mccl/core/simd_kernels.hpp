@@ -0,0 +1,76 @@
+#ifndef MCCL_CORE_SIMD_KERNELS_HPP
+#define MCCL_CORE_SIMD_KERNELS_HPP
+
+#include <mccl/config/config.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+MCCL_BEGIN_NAMESPACE
+
+/*
+   Runtime dispatched kernels for the hot word-array loops.
+   Each kernel is compiled for several instruction set levels within one library build,
+   the best level supported by the CPU is selected when the library is loaded.
+   The environment variable MCCL_SIMD (generic, sse4.2, avx2, avx512, avx512vpopcnt) caps the selected level.
+   Popcounts use POPCNT, an AVX2/AVX-512 nibble lookup table with Harley-Seal carry-save adders for long arrays,
+   or VPOPCNTQ.
+   Transposes use byte shuffles that split a 64x64 block into an 8x8 grid of 8x8 bit tiles.
+
+   Kernels operate on raw uint64_t word arrays:
+   - rows are given by a pointer to the first row and a stride in words
+   - words is the number of words per row that are processed, callers must ensure any padding bits are zero
+*/
+
+static const size_t simd_max_pivots = 8;
+
+// word operations of bitop_rows: op(a,b) with a the dst word for the 2-operand matrix/vector operations
+// the names follow the matrix_ops functions, e.g. op_andin: a & ~b, op_andni: ~a & b
+enum class simd_op { op_copy, op_copynot, op_and, op_or, op_xor, op_nand, op_nor, op_nxor, op_andin, op_andni, op_orin, op_orni };
+
+// avx512: AVX-512 F/BW/VL, avx512vpopcnt: additionally VPOPCNTQ
+enum class simd_level { generic = 0, sse42 = 1, avx2 = 2, avx512 = 3, avx512vpopcnt = 4 };
+
+struct simd_kernels_t
+{
+	simd_level level;
+	// hammingweight of words
+	size_t (*hw)(const uint64_t* v, size_t words);
+	// hammingweight of v1 ^ v2
+	size_t (*hw_xor)(const uint64_t* v1, const uint64_t* v2, size_t words);
+	// hammingweight of v1 ^ v2, aborts early and returns a value > maxw as soon as the partial hammingweight exceeds maxw
+	size_t (*hw_xor_max)(const uint64_t* v1, const uint64_t* v2, size_t words, size_t maxw);
+	// for each row r in [0,rows_count) and each pivot j in [0,count) in order: if bit pivotbit[j] of row r is set then row r ^= src[j]
+	// all pivots are applied in a single pass over the rows, count must be at most simd_max_pivots
+	// the src rows must not be modified by the call, i.e. lie outside the rows or have none of the pivot bits set
+	void (*xor_rows_if_bits)(uint64_t* rows, size_t stride, size_t rows_count, const uint64_t* const* src, const size_t* pivotbit, size_t count, size_t words);
+	// dst = src ^ sum_{i in [begin,end)} rows[i] and returns its hammingweight
+	// aborts early and returns a value > maxw as soon as the partial hammingweight exceeds maxw
+	size_t (*combine_hw)(uint64_t* dst, const uint64_t* src, const uint64_t* rows, size_t stride, const uint32_t* begin, const uint32_t* end, size_t words, size_t maxw);
+	// for each row r in [0,rows_count): dst[i] = op(src1[i], src2[i]) for i in [0,words), then all pointers advance by their stride
+	// dst may equal src1 or src2, but must not partially overlap them
+	void (*bitop_rows)(simd_op op, uint64_t* dst, size_t dststride, const uint64_t* src1, size_t src1stride, const uint64_t* src2, size_t src2stride, size_t rows_count, size_t words);
+	// transpose a 64x64 bit block of one word per row: bit r of dst[c*dststride] = bit c of src[r*srcstride]
+	// all 64 dst words are overwritten, dst and src must not overlap
+	void (*transpose64)(uint64_t* dst, size_t dststride, const uint64_t* src, size_t srcstride);
+};
+
+// kernels currently in use
+extern simd_kernels_t simd_kernels;
+
+// best level supported by this CPU (and this build)
+simd_level simd_cpu_level();
+
+// select kernels of given level, returns false (and leaves selection unchanged) if the CPU does not support it
+bool simd_select(simd_level level);
+
+// kernels of a given level, only valid if supported by the CPU
+simd_kernels_t simd_get_kernels(simd_level level);
+
+std::string to_string(simd_level level);
+simd_level parse_simd_level(const std::string& str);
+
+MCCL_END_NAMESPACE
+
+#endif
@@ -0,0 +1,204 @@
+// kernel bodies of simd_kernels.hpp
+// this file is included by simd_kernels.cpp once for every instruction set level,
+// each time within its own namespace and with the corresponding target options enabled
+// levels with explicit intrinsics kernels define MCCL_SIMD_EXPLICIT_* to skip the generic version
+
+// loops over fixed size chunks are vectorized by the compiler for the enabled instruction set
+static const size_t chunk_words = 8;
+
+inline void xor_chunk(uint64_t* __restrict dst, const uint64_t* __restrict src)
+{
+	for (size_t i = 0; i < chunk_words; ++i)
+		dst[i] ^= src[i];
+}
+
+// bitmask of the pivots j for which src[j] has to be added to row, pivots are applied in order
+// computed without branches, as the pivot bits of the rows are unpredictable
+inline unsigned select_pivots(const uint64_t* row, const uint64_t* const* src, const size_t* pivotbit, size_t count)
+{
+	unsigned sel = 0;
+	for (size_t j = 0; j < count; ++j)
+	{
+		size_t bitword = pivotbit[j] / 64;
+		uint64_t x = row[bitword];
+		for (size_t i = 0; i < j; ++i)
+			x ^= src[i][bitword] & -uint64_t((sel >> i) & 1);
+		sel |= unsigned((x >> (pivotbit[j] % 64)) & 1) << j;
+	}
+	return sel;
+}
+
+template<simd_op op>
+inline uint64_t bitop(uint64_t a, uint64_t b)
+{
+	switch (op)
+	{
+		case simd_op::op_copy:    return b;
+		case simd_op::op_copynot: return ~b;
+		case simd_op::op_and:     return a & b;
+		case simd_op::op_or:      return a | b;
+		case simd_op::op_xor:     return a ^ b;
+		case simd_op::op_nand:    return ~(a & b);
+		case simd_op::op_nor:     return ~(a | b);
+		case simd_op::op_nxor:    return ~(a ^ b);
+		case simd_op::op_andin:   return a & ~b;
+		case simd_op::op_andni:   return ~a & b;
+		case simd_op::op_orin:    return a | ~b;
+		case simd_op::op_orni:    return ~a | b;
+	}
+	return 0;
+}
+
+// a chunk is loaded completely before it is stored, so dst may equal src1 or src2
+template<simd_op op>
+void bitop_rows_op(uint64_t* dst, size_t dststride, const uint64_t* src1, size_t src1stride, const uint64_t* src2, size_t src2stride, size_t rows_count, size_t words)
+{
+	const size_t chunk_end = words - (words % chunk_words);
+	for (size_t r = 0; r < rows_count; ++r, dst += dststride, src1 += src1stride, src2 += src2stride)
+	{
+		size_t i = 0;
+		for (; i < chunk_end; i += chunk_words)
+		{
+			uint64_t tmp[chunk_words];
+			for (size_t j = 0; j < chunk_words; ++j)
+				tmp[j] = bitop<op>(src1[i + j], src2[i + j]);
+			for (size_t j = 0; j < chunk_words; ++j)
+				dst[i + j] = tmp[j];
+		}
+		for (; i < words; ++i)
+			dst[i] = bitop<op>(src1[i], src2[i]);
+	}
+}
+
+void bitop_rows(simd_op op, uint64_t* dst, size_t dststride, const uint64_t* src1, size_t src1stride, const uint64_t* src2, size_t src2stride, size_t rows_count, size_t words)
+{
+	switch (op)
+	{
+#define MCCL_SIMD_BITOP_CASE(o) case simd_op::o: bitop_rows_op<simd_op::o>(dst, dststride, src1, src1stride, src2, src2stride, rows_count, words); break;
+		MCCL_SIMD_BITOP_CASE(op_copy)
+		MCCL_SIMD_BITOP_CASE(op_copynot)
+		MCCL_SIMD_BITOP_CASE(op_and)
+		MCCL_SIMD_BITOP_CASE(op_or)
+		MCCL_SIMD_BITOP_CASE(op_xor)
+		MCCL_SIMD_BITOP_CASE(op_nand)
+		MCCL_SIMD_BITOP_CASE(op_nor)
+		MCCL_SIMD_BITOP_CASE(op_nxor)
+		MCCL_SIMD_BITOP_CASE(op_andin)
+		MCCL_SIMD_BITOP_CASE(op_andni)
+		MCCL_SIMD_BITOP_CASE(op_orin)
+		MCCL_SIMD_BITOP_CASE(op_orni)
+#undef MCCL_SIMD_BITOP_CASE
+	}
+}
+
+#ifndef MCCL_SIMD_EXPLICIT_XOR_ROWS
+inline void xor_chunk_masked(uint64_t* __restrict dst, const uint64_t* __restrict src, uint64_t mask)
+{
+	for (size_t i = 0; i < chunk_words; ++i)
+		dst[i] ^= src[i] & mask;
+}
+
+// branch-free: every row is rewritten, rows that do not have a pivot bit set are xored with zero
+void xor_rows_if_bits(uint64_t* rows, size_t stride, size_t rows_count, const uint64_t* const* src, const size_t* pivotbit, size_t count, size_t words)
+{
+	const size_t chunk_end = words - (words % chunk_words);
+	uint64_t mask[simd_max_pivots];
+	for (size_t r = 0; r < rows_count; ++r, rows += stride)
+	{
+		unsigned sel = select_pivots(rows, src, pivotbit, count);
+		for (size_t j = 0; j < count; ++j)
+			mask[j] = -uint64_t((sel >> j) & 1);
+		size_t i = 0;
+		for (; i < chunk_end; i += chunk_words)
+			for (size_t j = 0; j < count; ++j)
+				xor_chunk_masked(rows + i, src[j] + i, mask[j]);
+		for (; i < words; ++i)
+			for (size_t j = 0; j < count; ++j)
+				rows[i] ^= src[j][i] & mask[j];
+	}
+}
+#endif
+
+#ifndef MCCL_SIMD_EXPLICIT_HW
+size_t hw(const uint64_t* v, size_t words)
+{
+	size_t w = 0;
+	for (size_t i = 0; i < words; ++i)
+		w += __builtin_popcountll(v[i]);
+	return w;
+}
+
+size_t hw_xor(const uint64_t* v1, const uint64_t* v2, size_t words)
+{
+	size_t w = 0;
+	for (size_t i = 0; i < words; ++i)
+		w += __builtin_popcountll(v1[i] ^ v2[i]);
+	return w;
+}
+
+size_t hw_xor_max(const uint64_t* v1, const uint64_t* v2, size_t words, size_t maxw)
+{
+	size_t w = 0;
+	size_t i = 0;
+	const size_t chunk_end = words - (words % chunk_words);
+	for (; i < chunk_end; i += chunk_words)
+	{
+		for (size_t j = 0; j < chunk_words; ++j)
+			w += __builtin_popcountll(v1[i + j] ^ v2[i + j]);
+		if (w > maxw)
+			return w;
+	}
+	for (; i < words; ++i)
+		w += __builtin_popcountll(v1[i] ^ v2[i]);
+	return w;
+}
+
+size_t combine_hw(uint64_t* dst, const uint64_t* src, const uint64_t* rows, size_t stride, const uint32_t* begin, const uint32_t* end, size_t words, size_t maxw)
+{
+	size_t w = 0;
+	size_t i = 0;
+	const size_t chunk_end = words - (words % chunk_words);
+	for (; i < chunk_end; i += chunk_words)
+	{
+		uint64_t tmp[chunk_words];
+		for (size_t j = 0; j < chunk_words; ++j)
+			tmp[j] = src[i + j];
+		for (const uint32_t* p = begin; p != end; ++p)
+			xor_chunk(tmp, rows + stride * (*p) + i);
+		for (size_t j = 0; j < chunk_words; ++j)
+			w += __builtin_popcountll(dst[i + j] = tmp[j]);
+		if (w > maxw)
+			return w;
+	}
+	for (; i < words; ++i)
+	{
+		uint64_t x = src[i];
+		for (const uint32_t* p = begin; p != end; ++p)
+			x ^= rows[stride * (*p) + i];
+		w += __builtin_popcountll(dst[i] = x);
+	}
+	return w;
+}
+#endif
+
+#ifndef MCCL_SIMD_EXPLICIT_TRANSPOSE
+// swaps the off-diagonal halves of all aligned 2j x 2j sub-blocks for j = 32, 16, ..., 1
+void transpose64(uint64_t* dst, size_t dststride, const uint64_t* src, size_t srcstride)
+{
+	uint64_t tmp[64];
+	for (size_t k = 0; k < 64; ++k)
+		tmp[k] = src[k * srcstride];
+	uint64_t m = 0x00000000FFFFFFFFULL;
+	for (unsigned j = 32; j != 0; j >>= 1, m ^= m << j)
+	{
+		for (unsigned l = 0, k = 0; l < 32; ++l, k = (k + j + 1) & ~j)
+		{
+			uint64_t t = ((tmp[k] >> j) ^ tmp[k + j]) & m;
+			tmp[k] ^= t << j;
+			tmp[k + j] ^= t;
+		}
+	}
+	for (size_t k = 0; k < 64; ++k)
+		dst[k * dststride] = tmp[k];
+}
+#endif
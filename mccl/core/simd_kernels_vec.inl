@@ -0,0 +1,146 @@
+// vectorized popcount kernel bodies of simd_kernels.hpp
+// this file is included by simd_kernels.cpp for the AVX levels, after simd_kernels.inl,
+// within a namespace that defines struct vec_ops with:
+//   vec, words (words per vector), harley_seal (use Harley-Seal carry-save adders on long arrays),
+//   zero(), load(p), load_tail(p,n), store(p,x), store_tail(p,n,x) for the first n < words words,
+//   bxor(a,b), band(a,b), bor(a,b), add(a,b) and shl<n>(a) on 64-bit lanes,
+//   popcount(x): popcount of each 64-bit lane, sum(x): sum of the 64-bit lanes
+
+typedef vec_ops V;
+typedef V::vec vec;
+
+// carry-save adder: h*2 + l = a + b + c
+inline void csa(vec& h, vec& l, vec a, vec b, vec c)
+{
+	vec u = V::bxor(a, b);
+	h = V::bor(V::band(a, b), V::band(u, c));
+	l = V::bxor(u, c);
+}
+
+// Harley-Seal: only one vector popcount per 16 input vectors
+// adds the popcount of the largest multiple of 16 vectors to acc and returns the number of words processed
+template<typename Load>
+inline size_t hw_harley_seal(vec& acc, Load load, size_t words)
+{
+	const size_t w = V::words;
+	vec ones = V::zero(), twos = V::zero(), fours = V::zero(), eights = V::zero(), sixteens = V::zero();
+	vec twosA, twosB, foursA, foursB, eightsA, eightsB;
+	vec total = V::zero();
+	size_t i = 0;
+	for (; i + 16*w <= words; i += 16*w)
+	{
+		csa(twosA, ones, ones, load(i + 0*w), load(i + 1*w));
+		csa(twosB, ones, ones, load(i + 2*w), load(i + 3*w));
+		csa(foursA, twos, twos, twosA, twosB);
+		csa(twosA, ones, ones, load(i + 4*w), load(i + 5*w));
+		csa(twosB, ones, ones, load(i + 6*w), load(i + 7*w));
+		csa(foursB, twos, twos, twosA, twosB);
+		csa(eightsA, fours, fours, foursA, foursB);
+		csa(twosA, ones, ones, load(i + 8*w), load(i + 9*w));
+		csa(twosB, ones, ones, load(i + 10*w), load(i + 11*w));
+		csa(foursA, twos, twos, twosA, twosB);
+		csa(twosA, ones, ones, load(i + 12*w), load(i + 13*w));
+		csa(twosB, ones, ones, load(i + 14*w), load(i + 15*w));
+		csa(foursB, twos, twos, twosA, twosB);
+		csa(eightsB, fours, fours, foursA, foursB);
+		csa(sixteens, eights, eights, eightsA, eightsB);
+		total = V::add(total, V::popcount(sixteens));
+	}
+	total = V::shl<4>(total);
+	total = V::add(total, V::shl<3>(V::popcount(eights)));
+	total = V::add(total, V::shl<2>(V::popcount(fours)));
+	total = V::add(total, V::shl<1>(V::popcount(twos)));
+	total = V::add(total, V::popcount(ones));
+	acc = V::add(acc, total);
+	return i;
+}
+
+template<typename Load, typename LoadTail>
+inline size_t hw_vec(Load load, LoadTail load_tail, size_t words)
+{
+	vec acc = V::zero();
+	size_t i = 0;
+	if (V::harley_seal && words >= 16 * V::words)
+		i = hw_harley_seal(acc, load, words);
+	for (; i + V::words <= words; i += V::words)
+		acc = V::add(acc, V::popcount(load(i)));
+	if (i < words)
+		acc = V::add(acc, V::popcount(load_tail(i, words - i)));
+	return V::sum(acc);
+}
+
+size_t hw(const uint64_t* v, size_t words)
+{
+	return hw_vec(
+		[v](size_t i) { return V::load(v + i); },
+		[v](size_t i, size_t n) { return V::load_tail(v + i, n); },
+		words);
+}
+
+size_t hw_xor(const uint64_t* v1, const uint64_t* v2, size_t words)
+{
+	return hw_vec(
+		[v1,v2](size_t i) { return V::bxor(V::load(v1 + i), V::load(v2 + i)); },
+		[v1,v2](size_t i, size_t n) { return V::bxor(V::load_tail(v1 + i, n), V::load_tail(v2 + i, n)); },
+		words);
+}
+
+// the early abort check needs a horizontal sum, it is done once per abort_words words
+static const size_t abort_words = 8;
+
+size_t hw_xor_max(const uint64_t* v1, const uint64_t* v2, size_t words, size_t maxw)
+{
+	size_t w = 0;
+	size_t i = 0;
+	vec acc = V::zero();
+	for (; i + V::words <= words; i += V::words)
+	{
+		acc = V::add(acc, V::popcount(V::bxor(V::load(v1 + i), V::load(v2 + i))));
+		if ((i + V::words) % abort_words == 0)
+		{
+			w += V::sum(acc);
+			acc = V::zero();
+			if (w > maxw)
+				return w;
+		}
+	}
+	if (i < words)
+		acc = V::add(acc, V::popcount(V::bxor(V::load_tail(v1 + i, words - i), V::load_tail(v2 + i, words - i))));
+	return w + V::sum(acc);
+}
+
+// processes 2 vectors per selected row and checks for early abort after each 2 vectors
+size_t combine_hw(uint64_t* dst, const uint64_t* src, const uint64_t* rows, size_t stride, const uint32_t* begin, const uint32_t* end, size_t words, size_t maxw)
+{
+	size_t w = 0;
+	size_t i = 0;
+	for (; i + 2 * V::words <= words; i += 2 * V::words)
+	{
+		vec x0 = V::load(src + i), x1 = V::load(src + i + V::words);
+		for (const uint32_t* p = begin; p != end; ++p)
+		{
+			const uint64_t* row = rows + stride * (*p) + i;
+			x0 = V::bxor(x0, V::load(row));
+			x1 = V::bxor(x1, V::load(row + V::words));
+		}
+		V::store(dst + i, x0);
+		V::store(dst + i + V::words, x1);
+		w += V::sum(V::add(V::popcount(x0), V::popcount(x1)));
+		if (w > maxw)
+			return w;
+	}
+	vec acc = V::zero();
+	for (; i < words; i += V::words)
+	{
+		const size_t n = std::min(words - i, V::words);
+		vec x = (n == V::words) ? V::load(src + i) : V::load_tail(src + i, n);
+		for (const uint32_t* p = begin; p != end; ++p)
+			x = V::bxor(x, (n == V::words) ? V::load(rows + stride * (*p) + i) : V::load_tail(rows + stride * (*p) + i, n));
+		if (n == V::words)
+			V::store(dst + i, x);
+		else
+			V::store_tail(dst + i, n, x);
+		acc = V::add(acc, V::popcount(x));
+	}
+	return w + V::sum(acc);
+}
@@ -89,13 +89,13 @@ struct staged_bitfield
     {
         if (!usefilter1)
             return true;
-        return 0 != (filter1[ (L2val/64) & addressmask_filter1 ] |= uint64_t(1) << (L2val%64));
+        return 0 != (filter1[ (L2val/64) & addressmask_filter1 ] & (uint64_t(1) << (L2val%64)));
     }
     inline bool filter2get(uint64_t L1val)
     {
         if (!usefilter2)
             return true;
-        return 0 != (filter2[ (L1val/64) & addressmask_filter2 ] |= uint64_t(1) << (L1val%64));
+        return 0 != (filter2[ (L1val/64) & addressmask_filter2 ] & (uint64_t(1) << (L1val%64)));
     }
     
     inline void stage1(uint64_t L1val)
@@ -121,6 +121,28 @@ struct staged_bitfield
             return false;
         return 0 != (bitfield[ (L1val/32) & addressmask_bitfield ] & ((uint64_t(1)<<32) << (L1val%32)));
     }
+
+    // thread-safe variants of stage1 and stage2 using atomic or
+    // stage3 only reads and can be used concurrently as is
+    inline void stage1_atomic(uint64_t L1val)
+    {
+        __atomic_fetch_or(&bitfield[ (L1val/32) & addressmask_bitfield ], uint64_t(1) << (L1val%32), __ATOMIC_RELAXED);
+        if (usefilter1)
+            __atomic_fetch_or(&filter1[ (L1val/64) & addressmask_filter1 ], uint64_t(1) << (L1val%64), __ATOMIC_RELAXED);
+    }
+    inline bool stage2_atomic(uint64_t L2val)
+    {
+        if (!filter1get(L2val))
+            return false;
+        uint64_t& x = bitfield[ (L2val/32) & addressmask_bitfield ];
+        uint64_t L1bitval = uint64_t(1) << (L2val%32);
+        if (0 == (__atomic_load_n(&x, __ATOMIC_RELAXED) & L1bitval))
+            return false;
+        __atomic_fetch_or(&x, L1bitval<<32, __ATOMIC_RELAXED);
+        if (usefilter2)
+            __atomic_fetch_or(&filter2[ (L2val/64) & addressmask_filter2 ], uint64_t(1) << (L2val%64), __ATOMIC_RELAXED);
+        return true;
+    }
 };
 
 MCCL_END_NAMESPACE
@@ -0,0 +1,232 @@
+// local multi-process work coordinator:
+// - process_coordinator forks a number of worker processes, connected to the coordinator by a Unix socketpair
+// - workers send line based messages "<type> <payload>" through their worker_channel
+// - the coordinator passes every message to a handler, which returns false to stop all workers
+// - stopped workers are killed with SIGTERM, workers that end by themselves close their channel
+// - on Linux workers also receive SIGTERM when the coordinator process dies
+// only available on POSIX systems
+
+#ifndef MCCL_TOOLS_COORDINATOR_HPP
+#define MCCL_TOOLS_COORDINATOR_HPP
+
+#include <mccl/config/config.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+MCCL_BEGIN_NAMESPACE
+
+// worker side of the channel to the coordinator
+class worker_channel
+{
+public:
+    worker_channel(int _fd = -1)
+        : fd(_fd)
+    {
+    }
+
+    // send a single message, payload may not contain newlines
+    void send(const std::string& type, const std::string& payload = std::string())
+    {
+        std::string msg = type + " " + payload + "\n";
+        const char* p = msg.data();
+        size_t left = msg.size();
+        while (left > 0)
+        {
+            ssize_t r = ::write(fd, p, left);
+            if (r < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error("worker_channel::send: write failed: " + std::string(strerror(errno)));
+            }
+            p += r;
+            left -= size_t(r);
+        }
+    }
+
+private:
+    int fd;
+};
+
+class process_coordinator
+{
+public:
+    // work(worker_index, channel) is run in worker process worker_index
+    typedef std::function<void(unsigned, worker_channel&)> work_t;
+    // handler(worker_index, type, payload) returns false to stop all workers
+    typedef std::function<bool(unsigned, const std::string&, const std::string&)> handler_t;
+
+    // run workers processes until all have finished or the handler returns false
+    // returns true if stopped by the handler
+    bool run(unsigned workers, const work_t& work, const handler_t& handler)
+    {
+        if (workers == 0)
+            throw std::runtime_error("process_coordinator::run: need at least one worker");
+        std::cout << std::flush;
+        std::cerr << std::flush;
+
+        procs.assign(workers, process_t());
+        for (unsigned i = 0; i < workers; ++i)
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            {
+                stop_all();
+                throw std::runtime_error("process_coordinator::run: socketpair failed: " + std::string(strerror(errno)));
+            }
+            pid_t pid = fork();
+            if (pid < 0)
+            {
+                ::close(fds[0]);
+                ::close(fds[1]);
+                stop_all();
+                throw std::runtime_error("process_coordinator::run: fork failed: " + std::string(strerror(errno)));
+            }
+            if (pid == 0)
+            {
+                // worker process: end when the coordinator dies and close all coordinator side channels
+#if defined(__linux__)
+                prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+                ::close(fds[0]);
+                for (unsigned j = 0; j < i; ++j)
+                    ::close(procs[j].fd);
+                worker_channel channel(fds[1]);
+                int status = 0;
+                try
+                {
+                    work(i, channel);
+                }
+                catch (std::exception& e)
+                {
+                    channel.send("error", e.what());
+                    status = 1;
+                }
+                catch (...)
+                {
+                    channel.send("error", "unknown exception");
+                    status = 1;
+                }
+                std::cout << std::flush;
+                ::close(fds[1]);
+                _exit(status);
+            }
+            ::close(fds[1]);
+            procs[i].pid = pid;
+            procs[i].fd = fds[0];
+        }
+
+        bool stopped = false;
+        while (!stopped)
+        {
+            std::vector<pollfd> pfds;
+            std::vector<unsigned> pidx;
+            for (unsigned i = 0; i < workers; ++i)
+            {
+                if (procs[i].fd < 0)
+                    continue;
+                pfds.push_back(pollfd{procs[i].fd, POLLIN, 0});
+                pidx.push_back(i);
+            }
+            if (pfds.empty())
+                break;
+            if (poll(pfds.data(), pfds.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                stop_all();
+                throw std::runtime_error("process_coordinator::run: poll failed: " + std::string(strerror(errno)));
+            }
+            for (size_t j = 0; j < pfds.size() && !stopped; ++j)
+            {
+                if (pfds[j].revents == 0)
+                    continue;
+                if (!read_messages(pidx[j], handler))
+                    stopped = true;
+            }
+        }
+        stop_all();
+        return stopped;
+    }
+
+private:
+    struct process_t
+    {
+        pid_t pid = -1;
+        int fd = -1;
+        std::string buffer;
+    };
+
+    // read available data and pass all complete messages to handler, returns false if handler did
+    bool read_messages(unsigned i, const handler_t& handler)
+    {
+        auto& proc = procs[i];
+        char buf[4096];
+        ssize_t r = ::read(proc.fd, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR)
+            return true;
+        if (r <= 0)
+        {
+            // worker ended
+            ::close(proc.fd);
+            proc.fd = -1;
+            return true;
+        }
+        proc.buffer.append(buf, size_t(r));
+        size_t pos;
+        while ((pos = proc.buffer.find('\n')) != std::string::npos)
+        {
+            std::string line = proc.buffer.substr(0, pos);
+            proc.buffer.erase(0, pos+1);
+            size_t sep = line.find(' ');
+            std::string type = line.substr(0, sep);
+            std::string payload = (sep == std::string::npos) ? std::string() : line.substr(sep+1);
+            if (!handler(i, type, payload))
+                return false;
+        }
+        return true;
+    }
+
+    // kill all remaining workers and reap all processes
+    void stop_all()
+    {
+        for (auto& proc : procs)
+        {
+            if (proc.fd >= 0)
+            {
+                ::close(proc.fd);
+                proc.fd = -1;
+            }
+            if (proc.pid > 0)
+                kill(proc.pid, SIGTERM);
+        }
+        for (auto& proc : procs)
+        {
+            if (proc.pid > 0)
+                waitpid(proc.pid, nullptr, 0);
+            proc.pid = -1;
+        }
+    }
+
+    std::vector<process_t> procs;
+};
+
+MCCL_END_NAMESPACE
+
+#endif
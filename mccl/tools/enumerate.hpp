@@ -3,13 +3,32 @@
 
 #include <mccl/config/config.hpp>
 
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
 MCCL_BEGIN_NAMESPACE
 
+// a chunk of the enumeration space of enumerate(begin,end,p,f), see enumerate_t::split:
+// all selections prefix + {i} + S with first_lo <= i < first_hi and S any selection of indices > i
+// of total size at most p, plus the selection prefix itself if include_prefix is set
+template<typename Idx = uint16_t>
+struct enumerate_chunk_t
+{
+    Idx prefix[16];
+    unsigned prefix_size;
+    bool include_prefix;
+    size_t first_lo, first_hi;
+    // number of selections in this chunk
+    uint64_t count;
+};
+
 template<typename Idx = uint16_t>
 class enumerate_t
 {
 public:
     typedef Idx index_type;
+    typedef enumerate_chunk_t<Idx> chunk_type;
 
     // if return type of f is void always return true (continue enumeration)
     template<typename F, typename ... Args>
@@ -40,8 +59,6 @@ public:
     template<typename T, typename F>
     void enumerate12_val(const T* begin, const T* end, F&& f)
     {
-        if (end-begin < 2)
-            return;
         for (; begin != end; )
         {
             auto val = *begin;
@@ -207,6 +224,8 @@ public:
     void enumerate3(const T* begin, const T* end, F&& f)
     {
         size_t count = end-begin;
+        if (count < 3)
+            return;
         auto mid = begin + (count/2);
         idx[1] = 1;
         // try to have as large as possible inner loop
@@ -310,7 +329,154 @@ public:
         }
     }
 
+    // split the enumeration space of enumerate(begin,end,p,f) with n = end-begin into chunks
+    // of roughly equal size such that there are about nr_chunks chunks
+    // large chunks are split further by fixing more leading indices,
+    // so chunks remain balanced despite the triangular shape of the enumeration space
+    static std::vector<chunk_type> split(size_t n, size_t p, size_t nr_chunks)
+    {
+        std::vector<chunk_type> chunks;
+        if (n == 0 || p == 0)
+            return chunks;
+        if (p > 16)
+            throw std::runtime_error("enumerate::split: only p <= 16 supported");
+        uint64_t total = count_selections(n, p) - 1;
+        uint64_t target = std::max<uint64_t>(1, (total + nr_chunks - 1) / std::max<size_t>(1, nr_chunks));
+        chunk_type root;
+        root.prefix_size = 0;
+        root.include_prefix = false;
+        _split(root, 0, n, n, p, target, chunks);
+        return chunks;
+    }
+
+    // enumerate all selections in the given chunk of enumerate(begin,end,p,f)
+    // together all chunks from split cover exactly the same selections as enumerate_val / enumerate
+    // this allows to divide the work over multiple threads, each with its own enumerate_t object
+    template<typename T, typename F>
+    bool enumerate_chunk_val(const T* begin, const T* end, size_t p, const chunk_type& chunk, F&& f)
+    {
+        T val0 = 0;
+        for (unsigned j = 0; j < chunk.prefix_size; ++j)
+            val0 ^= begin[chunk.prefix[j]];
+        if (chunk.include_prefix && !call_function(f,val0))
+            return false;
+        size_t r = p - chunk.prefix_size - 1;
+        for (size_t i = chunk.first_lo; i < chunk.first_hi; ++i)
+        {
+            T val1 = val0 ^ begin[i];
+            if (!call_function(f,val1))
+                return false;
+            if (r == 0)
+                continue;
+            bool ret = true;
+            enumerate_val(begin+i+1, end, r,
+                [&](T val)
+                {
+                    return ret = call_function(f,val1 ^ val);
+                });
+            if (!ret)
+                return false;
+        }
+        return true;
+    }
+
+    // same as above, passing the selected indices (relative to begin) to f as well
+    template<typename T, typename F>
+    bool enumerate_chunk(const T* begin, const T* end, size_t p, const chunk_type& chunk, F&& f)
+    {
+        T val0 = 0;
+        for (unsigned j = 0; j < chunk.prefix_size; ++j)
+        {
+            chunk_idx[j] = chunk.prefix[j];
+            val0 ^= begin[chunk.prefix[j]];
+        }
+        index_type* it0 = chunk_idx + chunk.prefix_size;
+        if (chunk.include_prefix && !call_function(f,chunk_idx+0,it0,val0))
+            return false;
+        size_t r = p - chunk.prefix_size - 1;
+        for (size_t i = chunk.first_lo; i < chunk.first_hi; ++i)
+        {
+            T val1 = val0 ^ begin[i];
+            *it0 = index_type(i);
+            if (!call_function(f,chunk_idx+0,it0+1,val1))
+                return false;
+            if (r == 0)
+                continue;
+            bool ret = true;
+            enumerate(begin+i+1, end, r,
+                [&](const index_type* idxbegin, const index_type* idxend, T val)
+                {
+                    index_type* it = it0+1;
+                    for (; idxbegin != idxend; ++idxbegin,++it)
+                        *it = *idxbegin + index_type(i+1);
+                    return ret = call_function(f,chunk_idx+0,it,val1 ^ val);
+                });
+            if (!ret)
+                return false;
+        }
+        return true;
+    }
+
+    // number of selections of 0 up to r elements out of n
+    static uint64_t count_selections(size_t n, size_t r)
+    {
+        uint64_t binom = 1, sum = 1;
+        for (size_t j = 0; j < r && j < n; ++j)
+        {
+            binom = binom * (n - j) / (j + 1);
+            sum += binom;
+        }
+        return sum;
+    }
+
     index_type idx[16];
+    index_type chunk_idx[16];
+
+private:
+    // split chunk {parent.prefix + {i} + S : lo <= i < hi} (+ parent.prefix itself if parent.include_prefix)
+    static void _split(const chunk_type& parent, size_t lo, size_t hi, size_t n, size_t p, uint64_t target, std::vector<chunk_type>& chunks)
+    {
+        chunk_type cur = parent;
+        cur.first_lo = lo;
+        cur.count = parent.include_prefix ? 1 : 0;
+        for (size_t i = lo; i < hi; ++i)
+        {
+            uint64_t c = count_selections(n - 1 - i, p - parent.prefix_size - 1);
+            if (c > target && parent.prefix_size + 1 < p)
+            {
+                // close current chunk and split selections starting with prefix + {i} further
+                if (cur.count > 0)
+                {
+                    cur.first_hi = i;
+                    chunks.push_back(cur);
+                }
+                chunk_type child = parent;
+                child.prefix[child.prefix_size++] = index_type(i);
+                child.include_prefix = true;
+                _split(child, i+1, n, n, p, target, chunks);
+                cur = parent;
+                cur.include_prefix = false;
+                cur.first_lo = i+1;
+                cur.count = 0;
+                continue;
+            }
+            if (cur.count > 0 && cur.count + c > target)
+            {
+                cur.first_hi = i;
+                chunks.push_back(cur);
+                cur = parent;
+                cur.include_prefix = false;
+                cur.first_lo = i;
+                cur.count = 0;
+            }
+            cur.count += c;
+        }
+        if (cur.count > 0)
+        {
+            cur.first_hi = hi;
+            chunks.push_back(cur);
+        }
+    }
 };
 
 MCCL_END_NAMESPACE
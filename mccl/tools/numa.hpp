@@ -0,0 +1,289 @@
+// NUMA-aware thread placement:
+// - numa_topology: the NUMA nodes of this machine and the CPUs on each node that this process may use
+// - thread_placement: binds worker threads to the CPUs of a node according to a placement policy
+//   and sets the memory policy of the worker thread to prefer its local node,
+//   so that memory allocated and first touched by the worker (e.g. in initialize) lives on its node
+// a worker is bound to all CPUs of its node instead of a single CPU, since the threads it starts afterwards
+// (e.g. the thread pool of a subISD with subthreads > 1) inherit its CPU set and memory policy
+// the pages of page_vector and collection come from mccl_page_allocator, which keeps a free page pool per node:
+// a pinned worker first touches the pages it allocates and only reuses pages that were allocated on its node
+// only implemented for Linux, on other platforms pinning is a no-op
+
+#ifndef MCCL_TOOLS_NUMA_HPP
+#define MCCL_TOOLS_NUMA_HPP
+
+#include <mccl/config/config.hpp>
+#include <mccl/core/collection.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+MCCL_BEGIN_NAMESPACE
+
+// none:    do not pin threads
+// compact: fill all CPUs of the first node before moving to the next node
+// spread:  distribute threads round-robin over the nodes
+enum class placement_policy { none, compact, spread };
+
+inline placement_policy parse_placement_policy(const std::string& str)
+{
+    if (str == "none")
+        return placement_policy::none;
+    if (str == "compact")
+        return placement_policy::compact;
+    if (str == "spread")
+        return placement_policy::spread;
+    throw std::runtime_error("parse_placement_policy: unknown placement policy: " + str);
+}
+
+inline std::string to_string(placement_policy policy)
+{
+    switch (policy)
+    {
+        case placement_policy::compact: return "compact";
+        case placement_policy::spread: return "spread";
+        default: return "none";
+    }
+}
+
+class numa_topology
+{
+public:
+    // topology of this machine, determined once
+    static const numa_topology& get()
+    {
+        static const numa_topology topology;
+        return topology;
+    }
+
+    // explicit topology with the given CPUs per node, node ids default to 0,1,...
+    numa_topology(std::vector< std::vector<int> > _node_cpus, std::vector<int> _node_ids = std::vector<int>())
+        : node_cpus(std::move(_node_cpus)), node_ids(std::move(_node_ids)), cpu_count(0)
+    {
+        if (node_cpus.empty())
+            throw std::runtime_error("numa_topology: no nodes");
+        if (node_ids.empty())
+            for (size_t node = 0; node < node_cpus.size(); ++node)
+                node_ids.push_back(int(node));
+        if (node_ids.size() != node_cpus.size())
+            throw std::runtime_error("numa_topology: node ids do not match nodes");
+        for (auto& cpus : node_cpus)
+        {
+            if (cpus.empty())
+                throw std::runtime_error("numa_topology: node without CPUs");
+            cpu_count += cpus.size();
+        }
+    }
+
+    // parse a list like "0-3,8,10-11" as in /sys/devices/system/node/node*/cpulist
+    static std::vector<int> parse_cpulist(const std::string& cpulist)
+    {
+        std::vector<int> cpus;
+        std::istringstream iss(cpulist);
+        std::string range;
+        while (std::getline(iss, range, ','))
+        {
+            if (range.empty())
+                continue;
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash+1));
+            for (int cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    size_t nodes() const { return node_cpus.size(); }
+    size_t cpus() const { return cpu_count; }
+    const std::vector<int>& cpus(size_t node) const { return node_cpus[node]; }
+    int node_id(size_t node) const { return node_ids[node]; }
+
+private:
+    numa_topology()
+        : cpu_count(0)
+    {
+        std::vector<bool> allowed = allowed_cpus();
+#if defined(__linux__)
+        for (int node = 0; node < 1024; ++node)
+        {
+            std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!ifs)
+                continue;
+            std::string cpulist;
+            std::getline(ifs, cpulist);
+            std::vector<int> cpus;
+            for (int cpu : parse_cpulist(cpulist))
+                if (cpu < int(allowed.size()) && allowed[cpu])
+                    cpus.push_back(cpu);
+            if (cpus.empty())
+                continue;
+            node_ids.push_back(node);
+            node_cpus.emplace_back(std::move(cpus));
+        }
+#endif
+        // fall back to a single node with all allowed CPUs
+        if (node_cpus.empty())
+        {
+            node_ids.assign(1, 0);
+            node_cpus.resize(1);
+            for (int cpu = 0; cpu < int(allowed.size()); ++cpu)
+                if (allowed[cpu])
+                    node_cpus[0].push_back(cpu);
+        }
+        for (auto& cpus : node_cpus)
+            cpu_count += cpus.size();
+    }
+
+    static std::vector<bool> allowed_cpus()
+    {
+        std::vector<bool> allowed;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            allowed.resize(CPU_SETSIZE);
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                allowed[cpu] = CPU_ISSET(cpu, &set);
+            return allowed;
+        }
+#endif
+        allowed.assign(std::max<unsigned>(1, std::thread::hardware_concurrency()), true);
+        return allowed;
+    }
+
+    std::vector< std::vector<int> > node_cpus;
+    std::vector<int> node_ids;
+    size_t cpu_count;
+};
+
+// maps worker indices to nodes of a topology, by default the topology of this machine
+// offset is added to the worker index, so that multiple multi-threaded objects can share the machine
+// every worker occupies width CPUs (itself and the threads it starts), compact fills a node with as many workers as fit
+class thread_placement
+{
+public:
+    thread_placement(placement_policy _policy = placement_policy::none, size_t _offset = 0, size_t _width = 1, const numa_topology& _topology = numa_topology::get())
+        : policy(_policy), offset(_offset), width(std::max<size_t>(1, _width)), topology(&_topology)
+    {
+    }
+
+    placement_policy get_policy() const { return policy; }
+    bool enabled() const { return policy != placement_policy::none; }
+
+    // index of the node used for the given worker
+    size_t node(size_t worker) const
+    {
+        if (policy == placement_policy::spread)
+            return (worker + offset) % topology->nodes();
+        size_t i = ((worker + offset) * width) % topology->cpus();
+        size_t node = 0;
+        for (; i >= topology->cpus(node).size(); ++node)
+            i -= topology->cpus(node).size();
+        return node;
+    }
+
+    // bind the calling thread to the CPUs of the node of the given worker and prefer allocations on that node
+    // a thread that is already bound to that node is left as is, so only the first pin of a thread makes system calls
+    // throws when the CPU affinity or the memory policy cannot be set
+    void pin(size_t worker) const
+    {
+        if (!enabled())
+            return;
+        size_t workernode = node(worker);
+        if (bound_node() == workernode)
+            return;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : topology->cpus(workernode))
+            CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+            throw std::runtime_error("thread_placement::pin(): pthread_setaffinity_np failed: " + std::string(std::strerror(err)));
+        if (topology->nodes() > 1)
+        {
+            // MPOL_PREFERRED for this thread only, through the syscall to avoid a dependency on libnuma
+            const int mpol_preferred = 1;
+            int nodeid = topology->node_id(workernode);
+            std::vector<unsigned long> nodemask(nodeid / (8*sizeof(unsigned long)) + 1, 0);
+            nodemask[nodeid / (8*sizeof(unsigned long))] |= 1UL << (nodeid % (8*sizeof(unsigned long)));
+            if (syscall(SYS_set_mempolicy, mpol_preferred, nodemask.data(), nodemask.size() * 8*sizeof(unsigned long) + 1) != 0)
+                throw std::runtime_error("thread_placement::pin(): set_mempolicy failed: " + std::string(std::strerror(errno)));
+        }
+#endif
+        bound_node() = workernode;
+    }
+
+    // node the calling thread was last bound to by pin, or size_t(-1) if it was never pinned
+    // this also selects the free page pool of mccl_page_allocator used by the thread
+    static size_t& bound_node()
+    {
+        return detail::mccl_page_node();
+    }
+
+private:
+    placement_policy policy;
+    size_t offset, width;
+    const numa_topology* topology;
+};
+
+// hands out the workers of one parallel run (e.g. one thread_pool::run call) to the threads executing it
+// a thread gets an unclaimed worker on the node it is already bound to when there is one,
+// so pool threads keep their binding across runs and pin does not rebind them on every run
+class worker_claims
+{
+public:
+    worker_claims(const thread_placement& _placement, size_t workers)
+        : placement(_placement), claimed(workers, false)
+    {
+    }
+
+    // claim a worker for the calling thread
+    size_t claim()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t worker = claimed.size();
+        for (size_t i = 0; i < claimed.size(); ++i)
+        {
+            if (claimed[i])
+                continue;
+            if (worker == claimed.size())
+                worker = i;
+            if (!placement.enabled() || placement.node(i) == thread_placement::bound_node())
+            {
+                worker = i;
+                break;
+            }
+        }
+        if (worker == claimed.size())
+            throw std::runtime_error("worker_claims::claim: all workers are claimed");
+        claimed[worker] = true;
+        return worker;
+    }
+
+private:
+    const thread_placement& placement;
+    std::vector<bool> claimed;
+    std::mutex mutex;
+};
+
+MCCL_END_NAMESPACE
+
+#endif
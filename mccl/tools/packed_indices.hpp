@@ -0,0 +1,101 @@
+#ifndef MCCL_TOOLS_PACKED_INDICES_HPP
+#define MCCL_TOOLS_PACKED_INDICES_HPP
+
+#include <mccl/config/config.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+MCCL_BEGIN_NAMESPACE
+
+// compact encoding of a selection of at most arity() row indices in one uint64_t:
+// - every index is stored in a slot of bits() bits, the width is the smallest one that fits all indices < rows
+// - unused slots are all ones, so 0 is a valid index
+// - the i-th index is stored in slot i counted from the lowest bits, so sorted selections have a unique encoding
+// - encodings of arity a can be concatenated by shifting by total_bits(): (hi << total_bits()) | lo
+//   and decoded by an index_packer of the same rows and arity 2*a
+// pack and unpack are branch-free loops of a few shifts and masks per slot
+class index_packer
+{
+public:
+    typedef uint64_t packed_type;
+
+    index_packer()
+        : _bits(0), _arity(0), _mask(0), _empty(0)
+    {}
+
+    index_packer(size_t rows, size_t arity)
+    {
+        reset(rows, arity);
+    }
+
+    // number of bits per index for indices < rows, the all-ones value is reserved for unused slots
+    static unsigned bits_for(size_t rows)
+    {
+        unsigned bits = 1;
+        while (bits < 32 && (uint64_t(1) << bits) - 1 < uint64_t(rows))
+            ++bits;
+        return bits;
+    }
+
+    // whether arity indices < rows fit in packed_type
+    static bool fits(size_t rows, size_t arity)
+    {
+        return arity >= 1 && bits_for(rows) * arity <= 64 && uint64_t(rows) < (uint64_t(1) << 32);
+    }
+
+    void reset(size_t rows, size_t arity)
+    {
+        if (!fits(rows, arity))
+            throw std::runtime_error("index_packer::reset(): " + std::to_string(arity) + " indices < " + std::to_string(rows) + " do not fit in 64 bits");
+        _bits = bits_for(rows);
+        _arity = unsigned(arity);
+        _mask = (uint64_t(1) << _bits) - 1;
+        _empty = (_bits * _arity == 64) ? ~uint64_t(0) : ((uint64_t(1) << (_bits * _arity)) - 1);
+    }
+
+    unsigned bits() const { return _bits; }
+    unsigned arity() const { return _arity; }
+    unsigned total_bits() const { return _bits * _arity; }
+    // value of an unused slot
+    uint32_t unused() const { return uint32_t(_mask); }
+    // encoding of the empty selection
+    packed_type empty() const { return _empty; }
+
+    // encode the indices [begin,end), at most arity() indices
+    packed_type pack(const uint32_t* begin, const uint32_t* end) const
+    {
+        packed_type x = _empty;
+        for (unsigned shift = 0; begin != end; ++begin, shift += _bits)
+            x ^= packed_type(*begin ^ _mask) << shift;
+        return x;
+    }
+
+    // index in slot i, equals unused() if the slot is unused
+    uint32_t get(packed_type x, unsigned i) const
+    {
+        return uint32_t((x >> (i * _bits)) & _mask);
+    }
+
+    // write the used indices plus offset to first, returns the end of the written indices
+    // first must have room for arity() indices
+    uint32_t* unpack(packed_type x, uint32_t* first, uint32_t offset = 0) const
+    {
+        for (unsigned i = 0; i < _arity; ++i, x >>= _bits)
+        {
+            const uint32_t y = uint32_t(x & _mask);
+            *first = y + offset;
+            first += (y != uint32_t(_mask));
+        }
+        return first;
+    }
+
+private:
+    unsigned _bits, _arity;
+    uint64_t _mask, _empty;
+};
+
+MCCL_END_NAMESPACE
+
+#endif
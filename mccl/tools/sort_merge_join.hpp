@@ -0,0 +1,247 @@
+#ifndef MCCL_TOOLS_SORT_MERGE_JOIN_HPP
+#define MCCL_TOOLS_SORT_MERGE_JOIN_HPP
+
+#include <mccl/config/config.hpp>
+#include <mccl/core/collection.hpp>
+#include <mccl/contrib/thread_pool.hpp>
+
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+MCCL_BEGIN_NAMESPACE
+
+// sort-merge join of two lists of (key,value) items, an alternative to bitfield & hashmap matching:
+// - fill the left and right lists, directly or by merging per-thread lists into them
+// - sort() sorts both lists on key with an LSD radix sort on the used key bits, in parallel when given a thread pool
+// - match(f) merges the sorted lists and calls f(leftvalue, rightvalue) for all pairs with equal key
+// the lists are stored in collections of fixed size pages: filling them never reallocates,
+// and memory use is the two lists plus one sort buffer, independent of the key distribution
+template<typename Key, typename Value>
+class sort_merge_join
+{
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+
+    struct item_t
+    {
+        key_type key;
+        value_type value;
+
+        bool operator<(const item_t& r) const { return key < r.key; }
+    };
+    typedef collection<item_t> list_type;
+
+    // bits sorted per radix sort pass
+    static const unsigned radix_bits = 8;
+    // minimum list size to sort in parallel
+    static const size_t parallel_min_size = 1 << 16;
+
+    // only the lowest key_bits bits of keys are used for sorting, all higher key bits must be zero
+    void set_key_bits(unsigned bits) { _key_bits = bits; }
+    unsigned key_bits() const { return _key_bits; }
+
+    list_type& left() { return _left; }
+    list_type& right() { return _right; }
+    const list_type& left() const { return _left; }
+    const list_type& right() const { return _right; }
+
+    void push_left(const key_type& k, const value_type& v) { _left.push_back(item_t{k, v}); }
+    void push_right(const key_type& k, const value_type& v) { _right.push_back(item_t{k, v}); }
+
+    // the pages are returned to the page allocator pool and reused by the next fill
+    void clear()
+    {
+        _left.clear();
+        _right.clear();
+    }
+
+    void sort(thread_pool::thread_pool* threadpool = nullptr)
+    {
+        sort_list(_left, threadpool);
+        sort_list(_right, threadpool);
+    }
+
+    // calls f(leftvalue, rightvalue) for all pairs with equal key, both lists must be sorted
+    // f returns false to stop, match returns false if it was stopped
+    template<typename F>
+    bool match(F&& f) const
+    {
+        // values of the current run of equal keys in the right list
+        std::vector<value_type> run;
+        list_cursor l(_left), r(_right);
+        while (l.valid() && r.valid())
+        {
+            const key_type k = l->key;
+            if (k < r->key)
+            {
+                l.next();
+                continue;
+            }
+            if (r->key < k)
+            {
+                r.next();
+                continue;
+            }
+            run.clear();
+            for (; r.valid() && r->key == k; r.next())
+                run.push_back(r->value);
+            for (; l.valid() && l->key == k; l.next())
+                for (auto& rv : run)
+                    if (!f(l->value, rv))
+                        return false;
+        }
+        return true;
+    }
+
+    template<typename F>
+    bool join(F&& f, thread_pool::thread_pool* threadpool = nullptr)
+    {
+        sort(threadpool);
+        return match(std::forward<F>(f));
+    }
+
+private:
+    // forward iteration over the pages of a list without the index computations of the collection iterator
+    struct list_cursor
+    {
+        const list_type& list;
+        size_t page = 0;
+        const item_t* it = nullptr;
+        const item_t* end = nullptr;
+
+        explicit list_cursor(const list_type& _list) : list(_list) { load(); }
+
+        bool valid() const { return it != end; }
+        const item_t* operator->() const { return it; }
+        void next()
+        {
+            if (++it == end)
+            {
+                ++page;
+                load();
+            }
+        }
+        void load()
+        {
+            if (page < list.data().size())
+            {
+                it = list.data()[page].data();
+                end = it + list.data()[page].size();
+            }
+            else
+                it = end = nullptr;
+        }
+    };
+
+    // calls f(item) for the items [begin,end) of list
+    template<typename F>
+    static void for_each_item(list_type& list, size_t begin, size_t end, F&& f)
+    {
+        while (begin < end)
+        {
+            auto& page = list.data()[begin / page_capacity];
+            const size_t offset = begin % page_capacity;
+            const size_t count = std::min(end - begin, page.size() - offset);
+            for (item_t* it = page.data() + offset, *itend = it + count; it != itend; ++it)
+                f(*it);
+            begin += count;
+        }
+    }
+
+    // LSD radix sort, alternating between list and _buffer
+    // the digit counts of all passes are computed in one scan, passes where all digits are equal are skipped
+    // with a thread pool every thread counts and scatters a contiguous range of items:
+    // the positions of digit d of thread t start after all smaller digits and digit d of threads < t,
+    // after the first permutation each pass recounts its digit over the new thread ranges
+    void sort_list(list_type& list, thread_pool::thread_pool* threadpool)
+    {
+        const size_t n = list.size();
+        const unsigned passes = (_key_bits + radix_bits - 1) / radix_bits;
+        const size_t buckets = size_t(1) << radix_bits;
+        const key_type digitmask = key_type(buckets - 1);
+        if (n < 2 || passes == 0)
+            return;
+        size_t threads = 1;
+        if (threadpool != nullptr && n >= parallel_min_size)
+            threads = threadpool->size() + 1;
+        auto run = [&](const std::function<void(size_t, size_t, size_t)>& f)
+            {
+                if (threads == 1)
+                    f(0, 0, n);
+                else
+                    threadpool->run([&](int t, int) { f(size_t(t), n * size_t(t) / threads, n * (size_t(t) + 1) / threads); }, int(threads));
+            };
+        // _counts[(pass * threads + t) * buckets + d]
+        _counts.assign(passes * threads * buckets, 0);
+        run([&,this](size_t t, size_t begin, size_t end)
+            {
+                for_each_item(list, begin, end, [&,this](const item_t& item)
+                    {
+                        for (unsigned pass = 0; pass < passes; ++pass)
+                            ++_counts[(pass * threads + t) * buckets + size_t((item.key >> (pass * radix_bits)) & digitmask)];
+                    });
+            });
+        _buffer.resize(n);
+        bool permuted = false;
+        for (unsigned pass = 0; pass < passes; ++pass)
+        {
+            size_t* count = &_counts[pass * threads * buckets];
+            const unsigned shift = pass * radix_bits;
+            const size_t firstdigit = size_t((list[0].key >> shift) & digitmask);
+            size_t firstdigitcount = 0;
+            for (size_t t = 0; t < threads; ++t)
+                firstdigitcount += count[t * buckets + firstdigit];
+            if (firstdigitcount == n)
+                continue;
+            // the digit totals remain valid after a permutation, but the per-thread counts have to be recomputed
+            if (threads > 1 && permuted)
+            {
+                std::fill(count, count + threads * buckets, 0);
+                run([&](size_t t, size_t begin, size_t end)
+                    {
+                        size_t* tcount = count + t * buckets;
+                        for_each_item(list, begin, end, [&](const item_t& item)
+                            {
+                                ++tcount[size_t((item.key >> shift) & digitmask)];
+                            });
+                    });
+            }
+            for (size_t d = 0, pos = 0; d < buckets; ++d)
+                for (size_t t = 0; t < threads; ++t)
+                {
+                    const size_t c = count[t * buckets + d];
+                    count[t * buckets + d] = pos;
+                    pos += c;
+                }
+            _pages.clear();
+            for (auto& page : _buffer.data())
+                _pages.push_back(page.data());
+            run([&,this](size_t t, size_t begin, size_t end)
+                {
+                    size_t* tcount = count + t * buckets;
+                    for_each_item(list, begin, end, [&,this](const item_t& item)
+                        {
+                            const size_t pos = tcount[size_t((item.key >> shift) & digitmask)]++;
+                            _pages[pos / page_capacity][pos % page_capacity] = item;
+                        });
+                });
+            list.swap(_buffer);
+            permuted = true;
+        }
+    }
+
+    static const size_t page_capacity = list_type::page_capacity;
+
+    list_type _left, _right, _buffer;
+    // data pointers of the _buffer pages
+    std::vector<item_t*> _pages;
+    std::vector<size_t> _counts;
+    unsigned _key_bits = 64;
+};
+
+MCCL_END_NAMESPACE
+
+#endif
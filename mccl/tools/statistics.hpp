@@ -166,6 +166,18 @@ struct counter_statistic
     this->add( _counter );
     _counter = 0;
   }
+  // count accumulated since the last refresh()
+  uint64_t pending() const
+  {
+    return _counter;
+  }
+  // merge statistic of another thread: add its pending count and optionally concatenate its samples
+  void merge(const counter_statistic& o, bool merge_samples = true)
+  {
+    _counter += o._counter;
+    if (merge_samples)
+      samples.insert(samples.end(), o.samples.begin(), o.samples.end());
+  }
   void print(std::string name, std::ostream& o = std::cerr)
   {
     o << std::setw(15) << name << ":";
@@ -202,6 +214,16 @@ public:
     cnt_check_solution.refresh();
   }
 
+  // merge counters of another decoder (e.g. a worker thread)
+  void merge(const decoding_statistics& o, bool merge_samples = true) {
+    cnt_initialize.merge(o.cnt_initialize, merge_samples);
+    cnt_callback.merge(o.cnt_callback, merge_samples);
+    cnt_prepare_loop.merge(o.cnt_prepare_loop, merge_samples);
+    cnt_loop_next.merge(o.cnt_loop_next, merge_samples);
+    cnt_solve.merge(o.cnt_solve, merge_samples);
+    cnt_check_solution.merge(o.cnt_check_solution, merge_samples);
+  }
+
   // print
   void print(std::ostream& o = std::cerr) {
     if(cnt_solve.size()==0) {
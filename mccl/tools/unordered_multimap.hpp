@@ -127,7 +127,9 @@ hash_prime create_hash_prime(uint64_t p, bool dothrow = true);
 
 
 // hash function that returns uint64_t hash
-inline uint64_t hash(uint64_t x) { return x; }
+// multiplicative mixing: keys from a small range (e.g. l-bit syndromes) are spread over all buckets,
+// with the identity the buckets below 2^l would be overloaded and linear probing degenerates
+inline uint64_t hash(uint64_t x) { return 0x9E3779B97F4A7C15ULL * x; }
 // overloads for custom types may use hash_combine:
 inline uint64_t hash_combine(uint64_t x, uint64_t y) { return 4611686018427388039ULL * x + 268435459ULL * y + 2147483659; }
 
@@ -435,6 +437,171 @@ private:
 };
 
 
+/** concurrent cacheline hash table **/
+// variant of cacheline_unordered_multimap that allows many threads to insert simultaneously
+// - the capacity is fixed by reserve() / _reserve() beforehand: there is no automatic rehash
+// - insert reserves a slot in the bucket lock-free by a CAS on the bucket fill count,
+//   when the bucket is full it moves on to the next bucket
+// - insert returns false only if all buckets are full, choose the reserved number of elements with care
+// - match is const and may be called by many threads simultaneously,
+//   but not on the same multimap while inserts are in progress:
+//   inserted elements are visible after the insert phase has been synchronized (e.g. thread_pool::run returned)
+//   so threads can insert into one multimap while matching against another, previously filled, multimap
+// - reserve, rehash, clear and size are not thread-safe
+template<typename Key = uint64_t, typename Value = uint64_t, typename Traits = default_unordered_multimap_traits>
+class concurrent_cacheline_unordered_multimap
+{
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef Traits traits;
+    typedef detail::hash_prime hash_prime;
+
+    static constexpr size_t cacheline_size = traits::cacheline_size;
+    
+    static constexpr float default_scale_factor = traits::default_scale_factor;
+    static constexpr float default_max_load_factor = traits::default_max_load_factor;
+
+    typedef detail::cacheline_bucket_t<key_type,value_type,cacheline_size> bucket_t;
+    typedef typename bucket_t::bucket_size_t bucket_size_t;
+    static constexpr size_t bucket_size = bucket_t::bucket_size;
+
+    static_assert( std::is_trivial<Key>::value, "Key type is not trivial");
+    static_assert( std::is_trivial<Value>::value, "Value type is not trivial");
+    static_assert(bucket_size > 0, "bucket_size must be non-zero");
+    static_assert(sizeof(bucket_t) == cacheline_size, "sizeof(bucket_t) != cacheline_size");
+    static_assert(alignof(bucket_t) == cacheline_size, "alignof(bucket_t) != cacheline_size");
+
+    concurrent_cacheline_unordered_multimap(float __max_load_factor = default_max_load_factor)
+        : _max_load_factor(__max_load_factor), _reserved_size(1)
+    {
+    }
+
+    // read configuration
+    size_t bucket_count()      const { return _reserved_size; }
+    float  max_load_factor()   const { return _max_load_factor; }
+
+    // number of elements, computed from the bucket fill counts
+    size_t size() const
+    {
+        size_t s = 0;
+        for (auto& B : _map)
+            s += B.size;
+        return s;
+    }
+    bool   empty()             const { return size() == 0; }
+    float  load_factor()       const { return float(size()) / float(_reserved_size); }
+
+    // reserve to store a given number of elements
+    void reserve(size_t elements, double scale = default_scale_factor)
+    {
+        // lower bound scale by 1/max_load_factor
+        scale = std::max<float>(scale, 1.0f/_max_load_factor);
+        _reserve( size_t(double(elements) * scale / double(bucket_size)) );
+    }
+
+    // reserve a given number of buckets, clears the multimap
+    void _reserve(size_t buckets)
+    {
+        // find fast prime >= buckets
+        _hp = detail::get_hash_prime_ge(buckets);
+        _reserved_size = _hp.prime() * bucket_size;
+        _map.resize(_hp.prime());
+        // check proper alignment
+        uintptr_t check_align = reinterpret_cast<uintptr_t>(&_map[0]);
+        if (0 != (check_align & (cacheline_size-1)))
+            throw std::runtime_error("concurrent_cacheline_unordered_multimap::reserve(): aligned allocation failed");
+        clear();
+    }
+
+    // clear multimap
+    void clear()
+    {
+        if (!_map.empty())
+            memset(&_map[0], 0, sizeof(bucket_t)*_hp.prime());
+    }
+
+    // compute uint64_t hash of key
+    uint64_t hash(const key_type& k) const
+    {
+        return mccl::detail::hash(k);
+    }
+    
+    // compute bucket from key via hash
+    uint64_t bucket(const key_type& k) const
+    {
+        return _hp.mod( this->hash(k) );
+    }
+
+    // prefetch target bucket to speed up operations
+    inline void prefetch(const key_type& k)
+    {
+        uint64_t h = bucket(k);
+        __builtin_prefetch(&_map[h].size,1,0);
+    }
+
+    // thread-safe insert, returns false if the multimap is full
+    bool insert(const key_type& k, const value_type& v)
+    {
+        if (_map.empty())
+            return false;
+        const uint64_t b0 = bucket(k);
+        uint64_t b = b0;
+        while (true)
+        {
+            auto& B = _map[b];
+            bucket_size_t j = __atomic_load_n(&B.size, __ATOMIC_RELAXED);
+            // try to claim slot j, on failure j is updated with the current fill count
+            while (j < bucket_size)
+            {
+                if (__atomic_compare_exchange_n(&B.size, &j, bucket_size_t(j+1), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                {
+                    B.keys[j] = k;
+                    B.values[j] = v;
+                    return true;
+                }
+            }
+            // bucket is full: move to next bucket
+            if (++b == _hp.prime())
+                b = 0;
+            if (__builtin_expect(b == b0, 0))
+                return false;
+        }
+    }
+
+    template<typename F>
+    void match(const key_type& k, F&& f) const
+    {
+        if (_map.empty())
+            return;
+        const uint64_t b0 = bucket(k);
+        uint64_t b = b0;
+        while (true)
+        {
+            const auto& B = _map[b];
+            const size_t n = B.size;
+            for (size_t j = 0; j < n; ++j)
+                if (B.keys[j] == k)
+                    f(B.values[j]);
+            if (n < bucket_size)
+                return;
+            __builtin_prefetch(&_map[b+1 == _hp.prime() ? 0 : b+1].size,0,0);
+            if (++b == _hp.prime())
+                b = 0;
+            if (b == b0)
+                return;
+        }
+    }
+    
+private:
+    float _max_load_factor;
+    size_t _reserved_size;
+    hash_prime _hp;
+
+    aligned_vector<bucket_t> _map;
+};
+
+
 /** batched cacheline hash table **/
 // very similar to the above simple unordered_multimap using cacheline buckets
 // however:
@@ -762,6 +929,32 @@ public:
         while (!process_match_queue(f))
             ;
     }
+
+    // unqueued match: calls f(v) for all elements with key k
+    // does not use the match queue, so it may be called concurrently by several threads once all inserts are finalized
+    template<typename F>
+    void match(const key_type& k, F&& f) const
+    {
+        if (_map.empty())
+            return;
+        const uint64_t b0 = bucket(k);
+        uint64_t b = b0;
+        while (true)
+        {
+            const auto& B = _map[b];
+            const size_t n = B.size;
+            for (size_t j = 0; j < n; ++j)
+                if (B.keys[j] == k)
+                    f(B.values[j]);
+            if (n < bucket_size)
+                return;
+            if (++b == _hp.prime())
+                b = 0;
+            // all buckets are full
+            if (b == b0)
+                return;
+        }
+    }
     
 private:
     float _max_load_factor, _grow_factor;
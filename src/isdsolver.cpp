@@ -1,8 +1,11 @@
 #include <mccl/config/config.hpp>
 #include <mccl/config/utils.hpp>
 
+#include <mccl/core/matrix_algorithms.hpp>
+
 #include <mccl/algorithm/decoding.hpp>
 #include <mccl/algorithm/isdgeneric.hpp>
+#include <mccl/algorithm/isdgeneric_parallel.hpp>
 #include <mccl/algorithm/prange.hpp>
 #include <mccl/algorithm/lee_brickell.hpp>
 #include <mccl/algorithm/stern_dumer.hpp>
@@ -13,50 +16,265 @@
 #include <mccl/tools/generator.hpp>
 #include <mccl/tools/statistics.hpp>
 #include <mccl/tools/utils.hpp>
+#include <mccl/tools/numa.hpp>
+#include <mccl/tools/coordinator.hpp>
 
 #include <mccl/contrib/program_options.hpp>
 #include <mccl/contrib/string_algo.hpp>
+#include <mccl/contrib/thread_pool.hpp>
 
 #include <iostream>
 #include <cstdlib>
 #include <memory>
+#include <functional>
+#include <mutex>
+#include <exception>
+#include <sstream>
 
 using namespace mccl;
 
+/* ISD object together with the subISD object(s) it uses */
+
+struct ISD_instance
+{
+  std::unique_ptr<syndrome_decoding_API> ISD;
+  std::vector< std::unique_ptr<subISDT_API> > subISDs;
+  // placement of the ISD threads, the calling thread is pinned as worker 0
+  thread_placement placement;
+  // seed the random generator(s) of ISD
+  std::function<void(uint64_t)> seed;
+
+  decoding_statistics get_subISD_stats() const
+  {
+    decoding_statistics stats = subISDs[0]->get_stats();
+    for (size_t i = 1; i < subISDs.size(); ++i)
+      stats.merge(subISDs[i]->get_stats());
+    return stats;
+  }
+};
+// creates the ISD instance for the given trial thread
+typedef std::function<void(ISD_instance&, unsigned)> ISD_factory_t;
+
 /* run Trials */
 
-void run_ISD(syndrome_decoding_API& ISD, cmat_view& H, cvec_view& S, size_t w, bool quiet)
+void print_basic_statistics(time_statistic& time_trial_stat, time_statistic& time_total_stat, decoding_statistics stats);
+
+// run trials with one ISD instance per thread, a single trial thread runs all trials on the calling thread
+// thread t runs trials t, t+trial_threads, ...
+// generated instances for trial i > 0 use a generator seeded by a seed derived from genseed and i
+// and trial i seeds its ISD object with a seed derived from seed and i
+// so the trials do not depend on the number of threads
+// the solutions of the trials on the input instance are verified together with check_SD_solutions
+// the solutions of generated instances are verified per trial
+void runtrials_ISD_parallel(ISD_factory_t& ISD_factory, ISD_instance& main_ISD, const cmat_view& H, const cvec_view& S, size_t w, size_t trials, unsigned trial_threads, bool quiet, bool generate, uint64_t genseed, uint64_t seed, decoding_statistics& ISD_stats, decoding_statistics& subISD_stats)
 {
-  ISD.initialize(H, S, w);
-  ISD.solve();
-  if (!quiet)
-    std::cout << "Solution found:\n" << ISD.get_solution() << std::endl;
+  std::vector<ISD_instance> instances(trial_threads);
+  std::swap(instances[0], main_ISD);
+  for (unsigned t = 1; t < trial_threads; ++t)
+    ISD_factory(instances[t], t);
+  std::vector<time_statistic> time_trial_stats(trial_threads);
+  time_statistic time_total_stat;
+  // row i: solution of trial i on the input instance, only trial 0 uses it for generated instances
+  mat solutions(generate ? 1 : trials, H.columns());
+
+  std::mutex output_mutex;
+  std::exception_ptr eptr;
+  thread_pool::thread_pool threadpool(trial_threads - 1);
+
+  time_total_stat.start();
+  threadpool.run([&](int thread_id, int thread_count)
+    {
+      try
+      {
+        instances[thread_id].placement.pin(0);
+        auto& ISD = *instances[thread_id].ISD;
+        SDP_generator generator;
+        for (size_t i = thread_id; i < trials; i += thread_count)
+        {
+          cmat_view Hi(H);
+          cvec_view Si(S);
+          if (i > 0 && generate)
+          {
+            generator.seed(derive_seed(genseed, i));
+            generator.generate(H.columns(), H.columns()-H.rows(), w);
+            Hi.reset(generator.H());
+            Si.reset(generator.S());
+          }
+          instances[thread_id].seed(derive_seed(seed, i));
+          time_trial_stats[thread_id].start();
+          ISD.initialize(Hi, Si, w);
+          ISD.solve();
+          time_trial_stats[thread_id].stop();
+          if (i == 0 || !generate)
+            solutions[generate ? 0 : i].v_copy(ISD.get_solution());
+          else if (!check_SD_solution(Hi, Si, w, ISD.get_solution()))
+            throw std::runtime_error("runtrials_ISD_parallel(): trial " + std::to_string(i) + " returned an invalid solution");
+          if (!quiet)
+          {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            std::cout << "Solution found:\n" << ISD.get_solution() << std::endl;
+          }
+        }
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        if (!eptr)
+          eptr = std::current_exception();
+      }
+    }, int(trial_threads));
+  time_total_stat.stop();
+  if (eptr)
+    std::rethrow_exception(eptr);
+  if (trials > 0)
+  {
+    auto ok = check_SD_solutions(H, S, w, solutions);
+    for (size_t i = 0; i < ok.size(); ++i)
+      if (!ok[i])
+        throw std::runtime_error("runtrials_ISD_parallel(): trial " + std::to_string(i) + " returned an invalid solution");
+  }
+
+  /* aggregate statistics of all threads */
+  time_statistic time_trial_stat;
+  for (auto& ts : time_trial_stats)
+    time_trial_stat.samples.insert(time_trial_stat.samples.end(), ts.samples.begin(), ts.samples.end());
+  ISD_stats = instances[0].ISD->get_stats();
+  subISD_stats = instances[0].get_subISD_stats();
+  for (unsigned t = 1; t < trial_threads; ++t)
+  {
+    ISD_stats.merge(instances[t].ISD->get_stats());
+    subISD_stats.merge(instances[t].get_subISD_stats());
+  }
+  std::swap(instances[0], main_ISD);
+
+  print_basic_statistics(time_trial_stat, time_total_stat, ISD_stats);
 }
 
-void runtrials_ISD(syndrome_decoding_API& ISD, cmat_view& H, cvec_view& S, size_t w, size_t trials, bool quiet, bool generate, SDP_generator& generator)
+/* run worker processes */
+
+// worker process: solve the instance with its own ISD object & seed
+// and report the number of iterations and elapsed time every report_interval seconds
+// the worker starts its own echelonize threads, a forked process only inherits the forking thread
+void run_ISD_worker(ISD_factory_t& ISD_factory, unsigned worker, const cmat_view& H, const cvec_view& S, size_t w, unsigned threads, uint64_t seed, double report_interval, worker_channel& channel)
 {
-  // run trials
-  time_statistic time_trial_stat, time_total_stat;
+  set_echelonize_threads(threads);
+  ISD_instance inst;
+  ISD_factory(inst, worker);
+  inst.placement.pin(0);
+  inst.seed(seed);
+  auto& ISD = *inst.ISD;
+
+  time_statistic time_total;
+  size_t iterations = 0;
+  auto report = [&]()
+    {
+      channel.send("stats", std::to_string(iterations) + " " + std::to_string(time_total.elapsed_time()));
+    };
 
-  time_total_stat.start();
-  for (size_t i = 0; i < trials; ++i)
+  time_total.start();
+  ISD.initialize(H, S, w);
+  ISD.prepare_loop();
+  double next_report = report_interval;
+  while (true)
   {
-    if(i > 0 && generate)
+    bool found = ISD.loop_next();
+    // every loop_next runs one iteration per subISD
+    iterations += inst.subISDs.size();
+    if (found)
+      break;
+    if (time_total.elapsed_time() >= next_report)
     {
-      generator.generate(H.columns(), H.columns()-H.rows(), w);
-      H.reset(generator.H());
-      S.reset(generator.S());
+      report();
+      next_report += report_interval;
     }
-    time_trial_stat.start();
-    run_ISD(ISD, H,S,w, quiet);
-    time_trial_stat.stop();
   }
+  report();
+  auto E = ISD.get_solution();
+  std::string sol(E.columns(), '0');
+  for (size_t i = 0; i < E.columns(); ++i)
+    if (E[i])
+      sol[i] = '1';
+  channel.send("solution", sol);
+}
+
+// coordinator: run worker processes with seeds derived from seed until one finds a verified solution
+// must be called while no other threads are running, so the echelonize thread pool is stopped before forking
+void runcoordinator_ISD(ISD_factory_t& ISD_factory, const cmat_view& H, const cvec_view& S, size_t w, unsigned processes, unsigned threads, uint64_t seed, double report_interval, bool quiet)
+{
+  set_echelonize_threads(1);
+  std::vector<size_t> iterations(processes, 0);
+  std::vector<double> times(processes, 0);
+  vec solution;
+  unsigned solver = processes;
+  std::string error;
+
+  time_statistic time_total_stat;
+  time_total_stat.start();
+  process_coordinator coordinator;
+  coordinator.run(processes,
+    [&](unsigned worker, worker_channel& channel)
+    {
+      run_ISD_worker(ISD_factory, worker, H, S, w, threads, derive_seed(seed, worker), report_interval, channel);
+    },
+    [&](unsigned worker, const std::string& type, const std::string& payload)
+    {
+      if (type == "stats")
+      {
+        std::istringstream(payload) >> iterations[worker] >> times[worker];
+        if (!quiet)
+          std::cout << "Worker " << worker << ": iterations=" << iterations[worker] << " time=" << times[worker] << "s" << std::endl;
+        return true;
+      }
+      if (type == "solution")
+      {
+        vec E;
+        E.resize(payload.size());
+        for (size_t i = 0; i < payload.size(); ++i)
+          if (payload[i] == '1')
+            E.setbit(i);
+        if (!check_SD_solution(H, S, w, E))
+        {
+          std::cout << "Worker " << worker << " reported an invalid solution" << std::endl;
+          return true;
+        }
+        solution = E;
+        solver = worker;
+        return false;
+      }
+      if (type == "error")
+      {
+        error = "worker " + std::to_string(worker) + ": " + payload;
+        return false;
+      }
+      return true;
+    });
   time_total_stat.stop();
+  if (!error.empty())
+    throw std::runtime_error(error);
+  if (solver == processes)
+    throw std::runtime_error("runcoordinator_ISD: all workers ended without solution");
+
+  std::cout << "Solution found by worker " << solver << std::endl;
+  if (!quiet)
+    std::cout << "Solution found:\n" << solution << std::endl;
+
+  size_t total_iterations = 0;
+  for (auto its : iterations)
+    total_iterations += its;
+  std::cout << "=== Coordinator statistics ===" << std::endl;
+  std::cout << "  Processes            : " << processes << std::endl;
+  std::cout << "  Time                 : " << std::setw(10) << time_total_stat.total() << "s" << std::endl;
+  std::cout << "  Number of iterations : " << std::setw(10) << total_iterations << std::endl;
+  std::cout << "  Iterations per second: " << std::setw(10) << double(total_iterations) / time_total_stat.total() << std::endl;
+  for (unsigned i = 0; i < processes; ++i)
+    std::cout << "  Worker " << std::setw(3) << i << "           : iterations= " << std::setw(10) << iterations[i] << "  time= " << times[i] << "s" << std::endl;
+}
 
-  /* print basic overall statistics */
+void print_basic_statistics(time_statistic& time_trial_stat, time_statistic& time_total_stat, decoding_statistics stats)
+{
   double total_time = time_total_stat.total(), avg_time = time_trial_stat.mean();
-  double avg_loop_cnt = ISD.get_stats().cnt_loop_next.mean(),
-         total_loop_cnt = ISD.get_stats().cnt_loop_next.total();
+  double avg_loop_cnt = stats.cnt_loop_next.mean(),
+         total_loop_cnt = stats.cnt_loop_next.total();
 
   std::cout << "=== Basic statistics ===" << std::endl;
   std::cout << "  Time                 : mean= " << std::setw(10) << avg_time     << "s  total= " << std::setw(10) << total_time << "s" << std::endl;
@@ -112,6 +330,12 @@ try
     /* Configuration variables */
     std::string filepath, algo;
     size_t trials;
+    unsigned threads, trial_threads;
+    bool pipeline = false;
+    std::string placement_str;
+    unsigned processes;
+    uint64_t seed;
+    double report_interval;
     bool quiet = true;
     bool print_stats = true;
     bool print_input = true;
@@ -149,8 +373,14 @@ try
     // these are other configuration options
     auxopts.add_options()
       ("algo,a", po::value<std::string>(&algo)->default_value("P"), "Specify algorithm: P, LB, SDv0, MMT, Sieve")
-      ("algo,a", po::value<std::string>(&algo)->default_value("P"), "Specify algorithm: P, LB, SDv0, MMT")
       ("trials,t", po::value<size_t>(&trials)->default_value(1), "Number of ISD trials")
+      ("threads", po::value<unsigned>(&threads)->default_value(1), "Number of ISD threads")
+      ("pipeline", po::bool_switch(&pipeline), "Use 1 thread for ISD form updates and the others for subISD")
+      ("trialthreads", po::value<unsigned>(&trial_threads)->default_value(1), "Number of trials to run in parallel")
+      ("placement", po::value<std::string>(&placement_str)->default_value("none"), "Bind threads to the CPUs of a NUMA node & allocate on that node: none, compact, spread")
+      ("processes", po::value<unsigned>(&processes)->default_value(0), "Coordinator mode: solve 1 instance with this many worker processes")
+      ("seed", po::value<uint64_t>(&seed), "Set ISD random generator seed, per-thread trial and worker process seeds are derived from it")
+      ("reportinterval", po::value<double>(&report_interval)->default_value(60.0), "Seconds between statistics reports of worker processes")
       ("quiet,q", po::bool_switch(&quiet), "Quiet: reduce verbosity of trials")
       ("printinput", po::bool_switch(&print_input), "Print input H & S")
       ("printstats", po::bool_switch(&print_stats), "Print ISD function call statistics")
@@ -244,18 +474,62 @@ try
 
 
     /* Create the corresponding syndrome decoding object */
-    std::unique_ptr<syndrome_decoding_API> ISD_ptr;
-    std::unique_ptr<subISDT_API> subISD_ptr;
+    // ISD_factory creates an ISD object with its own subISD object(s)
+    // so that parallel trials can each use their own ISD object
+    ISD_factory_t ISD_factory;
+    ISD_instance main_ISD;
     std::string ISD_conf_str, subISD_conf_str;
     
+    if (threads == 0)
+      threads = 1;
+    if (trial_threads == 0)
+      trial_threads = 1;
+    // pipeline needs at least one producer and one consumer thread
+    if (pipeline && threads < 2)
+      threads = 2;
+    unsigned subISD_count = pipeline ? threads - 1 : threads;
+    placement_policy placement = parse_placement_policy(placement_str);
+    // every ISD thread is placed together with the subthreads its subISD starts
+    unsigned placement_width = 1;
+    if (configmap.count("subthreads") && !configmap["subthreads"].empty())
+      placement_width = std::max<unsigned>(1, unsigned(std::stoul(configmap["subthreads"])));
+    // instance setup (parsing / generating) uses the same number of threads for echelonization
+    set_echelonize_threads(threads);
 
 #define INITIALIZE_ALGO(subISDT_type) \
-    auto _subISD = new subISDT_type(); \
-    auto _ISD = new ISD_generic<subISDT_type>(*_subISD); \
-    subISD_ptr.reset(_subISD); \
-    ISD_ptr.reset(_ISD); \
-    subISD_conf_str = get_configuration_str(*_subISD); \
-    ISD_conf_str = get_configuration_str(*_ISD);
+    ISD_factory = [=](ISD_instance& inst, unsigned trial_thread) \
+    { \
+      inst.placement = thread_placement(placement, trial_thread * threads, placement_width); \
+      std::vector<subISDT_type*> _subISDs; \
+      for (unsigned i = 0; i < subISD_count; ++i) \
+      { \
+        _subISDs.push_back(new subISDT_type()); \
+        inst.subISDs.emplace_back(_subISDs.back()); \
+      } \
+      if (pipeline) \
+      { \
+        auto _ISD = new ISD_generic_pipeline<subISDT_type>(_subISDs); \
+        _ISD->set_placement(inst.placement); \
+        inst.seed = [_ISD](uint64_t s){ _ISD->seed(s); }; \
+        inst.ISD.reset(_ISD); \
+      } \
+      else if (threads == 1) \
+      { \
+        auto _ISD = new ISD_generic<subISDT_type>(*_subISDs[0]); \
+        inst.seed = [_ISD](uint64_t s){ _ISD->seed(s); }; \
+        inst.ISD.reset(_ISD); \
+      } \
+      else \
+      { \
+        auto _ISD = new ISD_generic_parallel<subISDT_type>(_subISDs); \
+        _ISD->set_placement(inst.placement); \
+        inst.seed = [_ISD](uint64_t s){ _ISD->seed(s); }; \
+        inst.ISD.reset(_ISD); \
+      } \
+    }; \
+    ISD_factory(main_ISD, 0); \
+    subISD_conf_str = get_configuration_str(*main_ISD.subISDs[0]); \
+    ISD_conf_str = get_configuration_str(*main_ISD.ISD);
 
 
     // ==================== ADD NEW ALGORITHMS HERE ====================
@@ -303,6 +577,8 @@ try
     if (vm.count("genseed"))
       generator.seed(genseed);
     genseed = generator.get_seed();
+    if (!vm.count("seed"))
+      seed = mccl_base_random_generator()();
 
     if (!filepath.empty())
     {
@@ -335,9 +611,19 @@ try
       S.reset(generator.S());
     }
     
-    std::cout << "Run settings       : n=" << n << " k=" << k << " w=" << w << " trials=" << trials;
+    std::cout << "Run settings       : n=" << n << " k=" << k << " w=" << w << " trials=" << trials << " threads=" << threads;
+    if (trial_threads > 1)
+      std::cout << " trialthreads=" << trial_threads;
+    if (pipeline)
+      std::cout << " pipeline=1";
+    if (placement != placement_policy::none)
+      std::cout << " placement=" << to_string(placement) << " (" << numa_topology::get().nodes() << " NUMA nodes, " << numa_topology::get().cpus() << " CPUs)";
     if (vm.count("generate"))
       std::cout << " genseed=" << genseed;
+    if (processes > 0)
+      std::cout << " processes=" << processes;
+    std::cout << " seed=" << seed;
+    std::cout << " simd=" << to_string(simd_kernels.level);
     std::cout << std::endl;
     std::cout << " -     ISD generic : " << ISD_conf_str << std::endl;
     std::cout << " - " << std::setw(15) << algo << " : " << subISD_conf_str << std::endl;
@@ -348,27 +634,44 @@ try
       std::cout << "S = " << S << std::endl;
     }
 
+    /* coordinator mode: solve 1 instance with worker processes */
+    if (processes > 0)
+    {
+      if (report_interval <= 0)
+        report_interval = 60.0;
+      // stop the worker threads of main_ISD before forking, the workers create their own ISD objects
+      main_ISD.ISD.reset();
+      runcoordinator_ISD(ISD_factory, H,S,w, processes, threads, seed, report_interval, quiet);
+      return 0;
+    }
+
     /* run all trials / benchmark */
+    decoding_statistics ISD_stats("ISD"), subISD_stats("subISD");
     if (benchmark)
     {
+      main_ISD.placement.pin(0);
+      main_ISD.seed(seed);
       // run benchmark
       if (min_bench_iterations == 0)
         min_bench_iterations = 1;
       if (min_bench_time <= 1.0)
         min_bench_time = 1.0;
-      benchmark_ISD(*ISD_ptr, H,S,w, min_bench_iterations, min_bench_time);
+      benchmark_ISD(*main_ISD.ISD, H,S,w, min_bench_iterations, min_bench_time);
+      ISD_stats = main_ISD.ISD->get_stats();
+      subISD_stats = main_ISD.get_subISD_stats();
     }
     else
     {
-      runtrials_ISD(*ISD_ptr, H,S,w, trials, quiet, vm.count("generate"), generator);
+      // also for a single trial thread: the trials do not depend on the number of trial threads
+      runtrials_ISD_parallel(ISD_factory, main_ISD, H,S,w, trials, std::max(trial_threads, 1u), quiet, vm.count("generate"), genseed, seed, ISD_stats, subISD_stats);
     }
 
     /* print detailed statistics */
     if (print_stats)
     {
       std::cout << "\n=== Detailed statistics ===" << std::endl;
-      ISD_ptr->get_stats().print(std::cout);
-      subISD_ptr->get_stats().print(std::cout);
+      ISD_stats.print(std::cout);
+      subISD_stats.print(std::cout);
     }
     
     return 0;
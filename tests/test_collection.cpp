@@ -42,10 +42,10 @@ int test_allocator()
             memset(p2, 2, s);
             std::size_t afteralloc2 = getCurrentRSS();
 
-            detail::mccl_aligned_free(p1);
+            detail::mccl_aligned_dealloc(p1);
             std::size_t afterfree2 = getCurrentRSS();
 
-            detail::mccl_aligned_free(p2);
+            detail::mccl_aligned_dealloc(p2);
             std::size_t afterfree1 = getCurrentRSS();
 
             std::cout << "\t alloc 1: " << afteralloc1 << " (+=" << afteralloc1-basemem << ")" << std::endl;
@@ -3,6 +3,7 @@
 #include <mccl/tools/parser.hpp>
 #include <mccl/algorithm/isdgeneric.hpp>
 #include <mccl/algorithm/stern_dumer.hpp>
+#include <mccl/tools/bitfield.hpp>
 
 #include "test_utils.hpp"
 
@@ -10,9 +11,107 @@
 #include <vector>
 #include <set>
 #include <utility>
+#include <random>
+#include <unordered_map>
+#include <algorithm>
 
 using namespace mccl;
 
+// random H12T with halves of more rows than fit in 16-bit indices:
+// check that every callback sums to S and that all solutions with p = 2 are found
+std::vector<uint64_t> large_words;
+uint64_t large_S;
+size_t large_count;
+bool large_callback(void*, const uint32_t* begin, const uint32_t* end, unsigned int)
+{
+    uint64_t x = large_S;
+    for (; begin != end; ++begin)
+        x ^= large_words[*begin];
+    large_count += (x == 0) ? 1 : (size_t(1) << 32);
+    return true;
+}
+
+int test_large_rows(size_t rows, size_t l)
+{
+    std::mt19937_64 mt;
+    mat H12T(rows, l);
+    vec S(l);
+    large_words.resize(rows);
+    for (size_t r = 0; r < rows; ++r)
+    {
+        large_words[r] = mt() & detail::lastwordmask(l);
+        *H12T.word_ptr(r) = large_words[r];
+    }
+    large_S = mt() & detail::lastwordmask(l);
+    *S.word_ptr() = large_S;
+
+    // left-table indices are [rows/2,rows), right-table indices are [0,rows - rows/2)
+    const size_t rows2 = rows - rows/2;
+    std::unordered_map<uint64_t, size_t> right;
+    for (size_t r = 0; r < rows2; ++r)
+        ++right[large_words[r] ^ large_S];
+    size_t expected = 0;
+    for (size_t r = rows2; r < rows; ++r)
+    {
+        auto it = right.find(large_words[r]);
+        if (it != right.end())
+            expected += it->second;
+    }
+
+    int status = 0;
+    for (auto subthreads : { "1", "3" })
+    for (auto sortmerge : { "0", "1" })
+    {
+        subISDT_stern_dumer stern_dumer;
+        stern_dumer.load_config(configmap_t{ {"p", "2"}, {"subthreads", subthreads}, {"sortmerge", sortmerge} });
+        stern_dumer.initialize(H12T, l, S, 2, &large_callback, nullptr);
+        large_count = 0;
+        stern_dumer.solve();
+        if (large_count != expected)
+        {
+            std::cerr << "test_large_rows(" << rows << "," << l << ") failed: " << large_count << " " << expected << std::endl;
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// the filters of staged_bitfield are only read by lookups: a value passes iff a value with the same address was set
+int test_staged_bitfield()
+{
+    std::mt19937_64 mt;
+    staged_bitfield<true,true> bitfield;
+    // the bitfield addresses the lowest 12 bits, the filters the lowest 10 bits
+    bitfield.resize(12, 10, 10);
+    std::vector<uint64_t> L1(100), L2(100);
+    for (auto& x : L1)
+        x = mt();
+    for (auto& x : L2)
+        x = mt();
+    L2[0] = L1[0];
+    auto collides = [](const std::vector<uint64_t>& L, uint64_t x, uint64_t mask)
+        {
+            return std::any_of(L.begin(), L.end(), [=](uint64_t y) { return ((x ^ y) & mask) == 0; });
+        };
+
+    int status = 0;
+    for (auto x : L1)
+        bitfield.stage1(x);
+    const std::vector<uint64_t> filter1 = bitfield.filter1;
+    for (auto x : L2)
+        status |= (bitfield.filter1get(x) != collides(L1, x, 1023));
+    status |= (bitfield.filter1 != filter1);
+    for (auto x : L2)
+        status |= (bitfield.stage2(x) != collides(L1, x, 4095));
+    const std::vector<uint64_t> filter2 = bitfield.filter2;
+    for (auto x : L1)
+        status |= (bitfield.stage3(x) != collides(L2, x, 4095));
+    status |= (bitfield.filter2 != filter2);
+    if (status)
+        std::cerr << "test_staged_bitfield() failed" << std::endl;
+    return status;
+}
+
 int main(int, char**)
 {
     int status = 0;
@@ -32,9 +131,11 @@ int main(int, char**)
         rowweights[r] = hammingweight(Hraw[r]);
 //    auto total_hw = hammingweight(Hraw);
 
-    configmap_t configmap = { {"p", "4"}, {"l", "6"} };
-    // test subISD_stern_dumer
+    // test subISD_stern_dumer single-threaded and multi-threaded, with bitfield & hashmap and sort-merge join
+    for (auto subthreads : { "1", "3" })
+    for (auto sortmerge : { "0", "1" })
     {
+        configmap_t configmap = { {"p", "4"}, {"l", "6"}, {"subthreads", subthreads}, {"sortmerge", sortmerge} };
         subISDT_stern_dumer stern_dumer;
         ISD_generic<subISDT_stern_dumer> ISD_stern_dumer(stern_dumer);
         
@@ -56,6 +157,9 @@ int main(int, char**)
         status |= not(eval_S.is_equal(S));
     }
 
+    status |= test_staged_bitfield();
+    status |= test_large_rows(140000, 18);
+
     if (status == 0)
     {
         LOG_CERR("All tests passed.");
@@ -0,0 +1,85 @@
+#include <mccl/config/config.hpp>
+
+#include <mccl/tools/enumerate.hpp>
+
+#include "test_utils.hpp"
+
+#include <iostream>
+#include <vector>
+#include <set>
+#include <utility>
+
+using namespace mccl;
+
+typedef std::pair< std::vector<uint32_t>, uint64_t > selection_t;
+
+// check that the chunks from split together enumerate exactly the same selections as enumerate
+int test_split(size_t n, size_t p, size_t nr_chunks)
+{
+    int status = 0;
+    std::vector<uint64_t> values(n);
+    for (size_t i = 0; i < n; ++i)
+        values[i] = uint64_t(1) << (i % 64) ^ (uint64_t(i) << 32);
+
+    enumerate_t<uint32_t> enumerate;
+    std::multiset<selection_t> all, chunked;
+    std::multiset<uint64_t> chunked_val;
+    enumerate.enumerate(values.data(), values.data()+n, p,
+        [&](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+        {
+            all.emplace(std::vector<uint32_t>(idxbegin, idxend), val);
+        });
+
+    auto chunks = enumerate_t<uint32_t>::split(n, p, nr_chunks);
+    uint64_t total = 0;
+    for (auto& chunk : chunks)
+    {
+        total += chunk.count;
+        size_t cnt = 0;
+        enumerate.enumerate_chunk(values.data(), values.data()+n, p, chunk,
+            [&](const uint32_t* idxbegin, const uint32_t* idxend, uint64_t val)
+            {
+                chunked.emplace(std::vector<uint32_t>(idxbegin, idxend), val);
+                ++cnt;
+            });
+        enumerate.enumerate_chunk_val(values.data(), values.data()+n, p, chunk,
+            [&](uint64_t val)
+            {
+                chunked_val.insert(val);
+            });
+        status |= not(cnt == chunk.count);
+    }
+    status |= not(all == chunked);
+    status |= not(total == all.size());
+    std::multiset<uint64_t> all_val;
+    for (auto& s : all)
+        all_val.insert(s.second);
+    status |= not(all_val == chunked_val);
+    if (status)
+        std::cerr << "split(" << n << "," << p << "," << nr_chunks << ") failed" << std::endl;
+    return status;
+}
+
+int main(int, char**)
+{
+    int status = 0;
+
+    for (size_t n : { 1, 2, 5, 17, 40 })
+        for (size_t p = 1; p <= 4; ++p)
+            for (size_t nr_chunks : { 1, 3, 8, 64, 1000 })
+                status |= test_split(n, p, nr_chunks);
+
+    // chunks should be reasonably balanced
+    auto chunks = enumerate_t<uint32_t>::split(200, 3, 32);
+    uint64_t maxcount = 0;
+    for (auto& chunk : chunks)
+        maxcount = std::max(maxcount, chunk.count);
+    status |= not(maxcount <= 2 * (enumerate_t<uint32_t>::count_selections(200, 3) / 32));
+
+    if (status == 0)
+    {
+        LOG_CERR("All tests passed.");
+        return 0;
+    }
+    return -1;
+}
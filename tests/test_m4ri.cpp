@@ -1,9 +1,12 @@
 #include <mccl/config/config.hpp>
 
 #include <mccl/core/matrix.hpp>
+#include <mccl/core/matrix_algorithms.hpp>
 #include <mccl/core/matrix_m4ri.hpp>
+#include <mccl/contrib/program_options.hpp>
 
 #include <iostream>
+#include <chrono>
 #include <vector>
 #include <set>
 #include <utility>
@@ -11,6 +14,7 @@
 #include "test_utils.hpp"
 
 using namespace mccl;
+namespace po = program_options;
 
 int test_bool(bool val, const std::string& errmsg = "error")
 {
@@ -62,14 +66,51 @@ int test_m4ri(size_t r = 512, size_t c = 512)
 }
 
 
+// both compute the unique reduced row echelon form, with bench the timings of both are printed
+int test_echelonize_m4ri(size_t r, size_t c, bool bench)
+{
+    int status = 0;
+
+    mat m0(r,c);
+    fillrandom(m0);
+    mat m1 = m_copy(m0), m2 = m_copy(m0);
+
+    auto start = std::chrono::steady_clock::now();
+    echelonize(m1);
+    auto mid = std::chrono::steady_clock::now();
+    m4ri_echelonize(m2, true);
+    auto end = std::chrono::steady_clock::now();
+    if (bench)
+        std::cout << "echelonize " << r << "x" << c << ": mccl " << std::chrono::duration<double, std::milli>(mid - start).count()
+            << "ms, M4RI " << std::chrono::duration<double, std::milli>(end - mid).count() << "ms" << std::endl;
+    status |= test_bool(m1.is_equal(m2), "echelonize differs from M4RI");
+
+    return status;
+}
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    po::options_description allopts;
+    allopts.add_options()
+        ("bench,b", "Print timings of echelonize and M4RI")
+        ("help,h",  "Show options")
+        ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, allopts), vm);
+    po::notify(vm);
+    if (vm.count("help"))
+    {
+        std::cout << allopts << std::endl;
+        return 0;
+    }
+
     int status = 0;
 
     for (size_t i = 1; i <= 4*64; ++i)
         status |= test_m4ri(i,i);
 
+    status |= test_echelonize_m4ri(2000, 4000, vm.count("bench"));
+
     if (status == 0)
     {
         LOG_CERR("All tests passed.");
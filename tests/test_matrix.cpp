@@ -2,8 +2,13 @@
 
 #include <mccl/core/matrix.hpp>
 #include <mccl/core/matrix_algorithms.hpp>
+#include <mccl/core/matrix_isdform.hpp>
+#include <mccl/algorithm/decoding.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <numeric>
+#include <random>
 #include <vector>
 #include <set>
 #include <utility>
@@ -116,6 +121,25 @@ int test_swapcolumns(size_t r, size_t c)
     return status;
 }
 
+// random column permutation compared with bitwise copying, on a view so the bits beyond the last column must remain
+int test_permute_columns(size_t r, size_t c)
+{
+    mat m1(r, c + 64);
+    fillrandom(m1);
+    mat m2 = m_copy(m1);
+    std::vector<size_t> perm(c);
+    std::iota(perm.begin(), perm.end(), 0);
+    std::mt19937_64 rng(r * c);
+    std::shuffle(perm.begin(), perm.end(), rng);
+    auto v2 = m2.submatrix(0, r, c);
+    v2.permute_columns(perm);
+    int status = 0;
+    for (size_t i = 0; i < r; ++i)
+        for (size_t j = 0; j < c + 64; ++j)
+            status |= test_bool(m2(i,j) == m1(i, j < c ? perm[j] : j), "permute columns failed");
+    return status;
+}
+
 int test_matrixref(size_t r = 512, size_t c = 512)
 {
     if (r%64 != 0) return 0;
@@ -162,6 +186,257 @@ int test_matrixref(size_t r = 512, size_t c = 512)
     return status;
 }
 
+// compare blocked (multi-threaded) echelonize variants with the scalar ones
+int test_echelonize(size_t r, size_t c)
+{
+    int status = 0;
+    mat m0(r, c + 64);
+    fillrandom(m0);
+    // create some dependent rows so that not every column has a pivot
+    for (size_t i = 0; i + 7 < r; i += 7)
+        m0[i] = m0[i+1] ^ m0[i+2];
+    for (unsigned threads : { 1, 3 })
+    {
+        set_echelonize_threads(threads);
+        for (size_t start : { size_t(0), size_t(5) })
+        {
+            // use a view with fewer columns, so bits beyond the last column must remain untouched
+            mat m1 = m_copy(m0), m2 = m_copy(m0);
+            auto v1 = m1.submatrix(0, r, c), v2 = m2.submatrix(0, r, c);
+            size_t p1 = detail::echelonize_scalar(v1, start, c/2 + start, start);
+            size_t p2 = echelonize(v2, start, c/2 + start, start);
+            status |= test_bool(p1 == p2 && m1.is_equal(m2), "echelonize failed");
+
+            m1 = m_copy(m0); m2 = m_copy(m0);
+            v1.reset(m1.submatrix(0, r, c)); v2.reset(m2.submatrix(0, r, c));
+            p1 = detail::echelonize_col_scalar(v1, start, r - start, start);
+            p2 = echelonize_col(v2, start, r - start, start);
+            status |= test_bool(p1 == p2 && m1.is_equal(m2), "echelonize_col failed");
+
+            m1 = m_copy(m0); m2 = m_copy(m0);
+            v1.reset(m1.submatrix(0, r, c)); v2.reset(m2.submatrix(0, r, c));
+            p1 = detail::echelonize_col_rev_scalar(v1, start, r - start, c - start);
+            p2 = echelonize_col_rev(v2, start, r - start, c - start);
+            status |= test_bool(p1 == p2 && m1.is_equal(m2), "echelonize_col_rev failed");
+
+            m1 = m_copy(m0); m2 = m_copy(m0);
+            v1.reset(m1.submatrix(0, r, c)); v2.reset(m2.submatrix(0, r, c));
+            std::vector<size_t> perm1(r), perm2(r);
+            std::iota(perm1.begin(), perm1.end(), 0);
+            std::iota(perm2.begin(), perm2.end(), 0);
+            p1 = detail::echelonize_col_rev_rowswap_scalar(v1, start, c - start, start, r - start, [&](size_t a, size_t b) { std::swap(perm1[a], perm1[b]); });
+            p2 = echelonize_col_rev_rowswap(v2, start, c - start, start, r - start, [&](size_t a, size_t b) { std::swap(perm2[a], perm2[b]); });
+            status |= test_bool(p1 == p2 && perm1 == perm2 && m1.is_equal(m2), "echelonize_col_rev_rowswap failed");
+        }
+    }
+    set_echelonize_threads(1);
+    return status;
+}
+
+// compare m_mul and m_addmul with bitwise inner products
+int test_mul(size_t r, size_t k, size_t c)
+{
+    int status = 0;
+    mat A(r, k), B(k, c), C0(r, c);
+    fillrandom(A);
+    fillrandom(B);
+    fillrandom(C0);
+    mat BT = m_transpose(B), ref(r, c);
+    for (size_t i = 0; i < r; ++i)
+        for (size_t j = 0; j < c; ++j)
+            ref.setbit(i, j, hammingweight_and(A[i], BT[j]) % 2);
+    for (unsigned threads : { 1, 3 })
+    {
+        set_echelonize_threads(threads);
+        mat C(r, c);
+        fillrandom(C);
+        m_mul(C, A, B);
+        status |= test_bool(C.is_equal(ref), "m_mul failed");
+        C = m_copy(C0);
+        m_addmul(C, A, B);
+        C ^= C0;
+        status |= test_bool(C.is_equal(ref), "m_addmul failed");
+    }
+    set_echelonize_threads(1);
+    return status;
+}
+
+// the batched solution check must agree with check_SD_solution for every row
+int test_check_SD_solutions(size_t n, size_t k, size_t w, size_t count)
+{
+    int status = 0;
+    mat H(n - k, n), E(count, n);
+    fillrandom(H);
+    // rows of E have weight w, except for every third row
+    for (size_t i = 0; i < count; ++i)
+        for (size_t j = 0; j < w + (i % 3 == 2); ++j)
+            E.setbit(i, (i * 7 + j * 13) % n);
+    vec S(n - k);
+    for (size_t i = 0; i < n - k; ++i)
+        S.setbit(i, hammingweight_and(H[i], E[0]) % 2);
+    // duplicate the solution in a later row
+    E[count / 2].v_copy(E[0]);
+    auto ok = check_SD_solutions(H, S, w, E);
+    size_t solutions = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        status |= test_bool(ok[i] == check_SD_solution(H, S, w, E[i]), "check_SD_solutions failed");
+        solutions += ok[i];
+    }
+    status |= test_bool(ok[0] && ok[count / 2] && solutions >= 2, "check_SD_solutions missed a solution");
+    return status;
+}
+
+// every row of the dual matrix must be orthogonal to every row of m: m * dual^T = 0
+int test_dual_matrix(size_t rows, size_t columns)
+{
+    int status = 0;
+    mat m(rows, columns);
+    fillrandom(m);
+    mat msf(m);
+    size_t rank = echelonize(msf);
+    mat dual = dual_matrix(m);
+    status |= test_bool(dual.rows() == columns - rank && dual.columns() == columns, "dual_matrix has wrong dimensions");
+    mat dualT = m_transpose(dual), check(rows, dual.rows());
+    m_mul(check, m, dualT);
+    status |= test_bool(check.hw() == 0, "dual_matrix is not orthogonal");
+    return status;
+}
+
+uint64_t bitop_reference(simd_op op, uint64_t a, uint64_t b)
+{
+    switch (op)
+    {
+        case simd_op::op_copy:    return b;
+        case simd_op::op_copynot: return ~b;
+        case simd_op::op_and:     return a & b;
+        case simd_op::op_or:      return a | b;
+        case simd_op::op_xor:     return a ^ b;
+        case simd_op::op_nand:    return ~(a & b);
+        case simd_op::op_nor:     return ~(a | b);
+        case simd_op::op_nxor:    return ~(a ^ b);
+        case simd_op::op_andin:   return a & ~b;
+        case simd_op::op_andni:   return ~a & b;
+        case simd_op::op_orin:    return a | ~b;
+        case simd_op::op_orni:    return ~a | b;
+    }
+    return 0;
+}
+
+// compare all dispatched kernel levels supported by this CPU with the generic kernels
+int test_simd_kernels(size_t r, size_t c)
+{
+    int status = 0;
+    mat m0(r, c);
+    fillrandom(m0);
+    std::vector<uint32_t> sel = { 3, 1, 7, uint32_t(r-1) };
+    auto k0 = simd_get_kernels(simd_level::generic);
+    for (int l = 0; l <= int(simd_cpu_level()); ++l)
+    {
+        auto k = simd_get_kernels(simd_level(l));
+        size_t words = m0.row_words(), stride = m0.word_stride();
+        status |= test_bool(k.hw(m0.word_ptr(2), words) == k0.hw(m0.word_ptr(2), words), "simd hw failed");
+        status |= test_bool(k.hw_xor(m0.word_ptr(2), m0.word_ptr(5), words) == k0.hw_xor(m0.word_ptr(2), m0.word_ptr(5), words), "simd hw_xor failed");
+        for (size_t n = 0; n <= words; n += 1 + n/4)
+            status |= test_bool(k.hw(m0.word_ptr(3), n) == k0.hw(m0.word_ptr(3), n), "simd hw failed");
+        size_t wxor = k0.hw_xor(m0.word_ptr(2), m0.word_ptr(5), words);
+        status |= test_bool(k.hw_xor_max(m0.word_ptr(2), m0.word_ptr(5), words, wxor) == wxor, "simd hw_xor_max failed");
+        status |= test_bool(k.hw_xor_max(m0.word_ptr(2), m0.word_ptr(5), words, wxor/2) > wxor/2, "simd hw_xor_max abort failed");
+
+        // src rows 0..2 lie outside the updated rows, compare with applying the pivots one at a time
+        mat m1 = m_copy(m0), m2 = m_copy(m0);
+        const uint64_t* src1[3] = { m1.word_ptr(0), m1.word_ptr(1), m1.word_ptr(2) };
+        const uint64_t* src2[3] = { m2.word_ptr(0), m2.word_ptr(1), m2.word_ptr(2) };
+        size_t pivotbit[3] = { 2, c-1, c/2 };
+        for (size_t j = 0; j < 3; ++j)
+            k0.xor_rows_if_bits(m1.word_ptr(3), stride, r-3, src1 + j, pivotbit + j, 1, words);
+        k.xor_rows_if_bits(m2.word_ptr(3), stride, r-3, src2, pivotbit, 3, words);
+        status |= test_bool(m1.is_equal(m2), "simd xor_rows_if_bits failed");
+
+        vec c1(c), c2(c);
+        size_t w1 = k0.combine_hw(c1.word_ptr(), m0.word_ptr(0), m0.word_ptr(), stride, &sel[0], &sel[0] + sel.size(), words, c);
+        size_t w2 = k.combine_hw(c2.word_ptr(), m0.word_ptr(0), m0.word_ptr(), stride, &sel[0], &sel[0] + sel.size(), words, c);
+        status |= test_bool(w1 == w2 && w1 == c2.hw() && c1.is_equal(c2), "simd combine_hw failed");
+        // early abort must report a weight above the limit
+        status |= test_bool(k.combine_hw(c2.word_ptr(), m0.word_ptr(0), m0.word_ptr(), stride, &sel[0], &sel[0] + sel.size(), words, 2) > 2, "simd combine_hw abort failed");
+
+        // every word operation, in place (dst = src1) and on distinct rows
+        const size_t h = r/2;
+        for (int op = int(simd_op::op_copy); op <= int(simd_op::op_orni); ++op)
+        {
+            mat m1 = m_copy(m0), m2 = m_copy(m0);
+            k.bitop_rows(simd_op(op), m1.word_ptr(0), stride, m1.word_ptr(0), stride, m0.word_ptr(h), stride, h, words);
+            k.bitop_rows(simd_op(op), m2.word_ptr(0), stride, m0.word_ptr(1), stride, m0.word_ptr(h), stride, h - 1, words);
+            bool ok = true;
+            for (size_t i = 0; i < h; ++i)
+                for (size_t j = 0; j < words; ++j)
+                {
+                    ok &= m1.word_ptr(i)[j] == bitop_reference(simd_op(op), m0.word_ptr(i)[j], m0.word_ptr(h + i)[j]);
+                    if (i + 1 < h)
+                        ok &= m2.word_ptr(i)[j] == bitop_reference(simd_op(op), m0.word_ptr(i + 1)[j], m0.word_ptr(h + i)[j]);
+                }
+            status |= test_bool(ok, "simd bitop_rows failed");
+        }
+    }
+
+    // matrix and vector operations use bitop_rows for the full blocks
+    const size_t h = r/2;
+    mat m3(h, c);
+    vec v3(c);
+    m3.m_andin(m0.submatrix(0, h), m0.submatrix(h, h));
+    v3.v_orni(m0[0], m0[1]);
+    bool ok = true;
+    for (size_t i = 0; i < h; ++i)
+        for (size_t j = 0; j < c; ++j)
+            ok &= m3(i, j) == (m0(i, j) && !m0(h + i, j));
+    for (size_t j = 0; j < c; ++j)
+        ok &= v3[j] == (!m0(0, j) || m0(1, j));
+    status |= test_bool(ok, "bitop matrix/vector operations failed");
+
+    // block hammingweight uses the dispatched hw
+    uint64_block_t<256> b256;
+    uint64_block_t<512> b512;
+    size_t hw256 = 0, hw512 = 0;
+    for (size_t j = 0; j < 8; ++j)
+    {
+        b512.v[j] = m0.word_ptr(j % r)[0];
+        hw512 += hammingweight(b512.v[j]);
+        if (j < 4)
+        {
+            b256.v[j] = b512.v[j];
+            hw256 += hammingweight(b256.v[j]);
+        }
+    }
+    status |= test_bool(b256.hammingweight() == hw256 && b512.hammingweight() == hw512, "block hammingweight failed");
+    return status;
+}
+
+// batched updates must give exactly the same ISD form as applying every pivot by swap_echelon
+int test_isdform_batched(size_t n, size_t k, size_t l)
+{
+    int status = 0;
+    mat H(n - k, n);
+    vec S(n - k);
+    fillrandom(H);
+    fillrandom(S);
+    for (int updatetype : { 1, 2, 3, 4, 10, 12, 13, 14 })
+    {
+        HST_ISD_form_t<> HST1, HST2;
+        HST1.set_update_batch(1);
+        HST1.seed(updatetype);
+        HST2.seed(updatetype);
+        HST1.reset(H, S, l);
+        HST2.reset(H, S, l);
+        for (int u : { -1, 1, 3, 8, 17 })
+        {
+            HST1.update(u, updatetype);
+            HST2.update(u, updatetype);
+            status |= test_bool(HST1.HSTpadded().is_equal(HST2.HSTpadded()) && HST1.permutation() == HST2.permutation(), "batched update failed");
+        }
+    }
+    return status;
+}
+
 int main(int, char**)
 {
     int status = 0;
@@ -180,6 +455,27 @@ int main(int, char**)
     }
 
     status |= test_swapcolumns(1024, 256);
+    for (size_t r : { 1, 63, 64, 200 })
+        for (size_t c : { 1, 64, 100, 1000 })
+            status |= test_permute_columns(r, c);
+
+    status |= test_echelonize(200, 150);
+    status |= test_echelonize(300, 500);
+    status |= test_echelonize(150, 130);
+
+    status |= test_mul(10, 70, 130);
+    status |= test_mul(300, 200, 500);
+    status |= test_mul(200, 1000, 1300);
+    status |= test_check_SD_solutions(200, 100, 20, 150);
+    status |= test_dual_matrix(50, 130);
+    status |= test_dual_matrix(300, 1000);
+
+    for (size_t c : { 64, 100, 512, 1000, 1300, 9000, 20000 })
+        status |= test_simd_kernels(50, c);
+
+    status |= test_isdform_batched(100, 50, 0);
+    status |= test_isdform_batched(1000, 500, 10);
+    status |= test_isdform_batched(1300, 300, 20);
     
     if (status == 0)
     {
@@ -29,8 +29,13 @@ int main(int, char**)
         rowweights[r] = hammingweight(Hraw[r]);
 //    auto total_hw = hammingweight(Hraw);
 
-    configmap_t configmap = { {"p", "4"}, {"l", "14"} };
+    // test subISDT_mmt single-threaded and multi-threaded, with hashmap and sort-merge join,
+    // and with l1 hashmap buckets that are too small and have to grow
+    for (auto subthreads : { "1", "3" })
+    for (auto sortmerge : { "0", "1" })
+    for (auto bucketsize : { "0", "1" })
     {
+        configmap_t configmap = { {"p", "4"}, {"l", "14"}, {"subthreads", subthreads}, {"sortmerge", sortmerge}, {"bucketsize", bucketsize} };
         subISDT_mmt mmt;
         ISD_generic<subISDT_mmt> ISD_mmt(mmt);
         
@@ -52,6 +57,24 @@ int main(int, char**)
         status |= not(eval_S.is_equal(S));
     }
 
+    // the same seed must give the same run, including the random l1 target of MMT
+    {
+        configmap_t configmap = { {"p", "4"}, {"l", "14"} };
+        size_t iterations[2];
+        for (size_t i = 0; i < 2; ++i)
+        {
+            subISDT_mmt mmt;
+            ISD_generic<subISDT_mmt> ISD_mmt(mmt);
+            ISD_mmt.load_config(configmap);
+            mmt.load_config(configmap);
+            ISD_mmt.seed(1234);
+            ISD_mmt.initialize(Hraw, S, w);
+            ISD_mmt.solve();
+            iterations[i] = ISD_mmt.get_stats().cnt_loop_next.total();
+        }
+        status |= not(iterations[0] == iterations[1]);
+    }
+
     if (status == 0)
     {
         LOG_CERR("All tests passed.");
@@ -0,0 +1,126 @@
+#include <mccl/config/config.hpp>
+
+#include <mccl/tools/numa.hpp>
+#include <mccl/core/collection.hpp>
+
+#include "test_utils.hpp"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace mccl;
+
+int test_bool(bool val, const std::string& errmsg = "error")
+{
+    if (val)
+       return 0;
+    LOG_CERR(errmsg);
+    return -1;
+}
+
+int test_parse_cpulist()
+{
+    int status = 0;
+    status |= test_bool(numa_topology::parse_cpulist("0-3,8,10-11") == std::vector<int>({0,1,2,3,8,10,11}), "parse_cpulist: ranges failed");
+    status |= test_bool(numa_topology::parse_cpulist("5") == std::vector<int>({5}), "parse_cpulist: single cpu failed");
+    status |= test_bool(numa_topology::parse_cpulist("2,,4-4,") == std::vector<int>({2,4}), "parse_cpulist: empty entries failed");
+    status |= test_bool(numa_topology::parse_cpulist("").empty(), "parse_cpulist: empty list failed");
+    return status;
+}
+
+// node of a worker for every policy on explicit topologies
+int test_placement_node()
+{
+    int status = 0;
+    numa_topology even({ {0,1,2,3}, {4,5,6,7} });
+    numa_topology uneven({ {0,1,2}, {3} }, {0, 2});
+
+    thread_placement spread(placement_policy::spread, 0, 1, even), spread1(placement_policy::spread, 1, 1, even);
+    for (size_t w = 0; w < 8; ++w)
+    {
+        status |= test_bool(spread.node(w) == w % 2, "thread_placement: spread failed");
+        status |= test_bool(spread1.node(w) == (w + 1) % 2, "thread_placement: spread with offset failed");
+    }
+
+    // compact: fill node 0, then node 1, then wrap around
+    thread_placement compact(placement_policy::compact, 0, 1, even), compact2(placement_policy::compact, 0, 2, even);
+    for (size_t w = 0; w < 16; ++w)
+    {
+        status |= test_bool(compact.node(w) == (w % 8) / 4, "thread_placement: compact failed");
+        status |= test_bool(compact2.node(w) == (w % 4) / 2, "thread_placement: compact with width failed");
+    }
+
+    thread_placement compact_uneven(placement_policy::compact, 0, 1, uneven), compact_offset(placement_policy::compact, 2, 1, uneven);
+    const std::vector<size_t> nodes = { 0, 0, 0, 1, 0, 0, 0, 1 };
+    for (size_t w = 0; w < nodes.size(); ++w)
+    {
+        status |= test_bool(compact_uneven.node(w) == nodes[w], "thread_placement: compact on uneven nodes failed");
+        status |= test_bool(compact_offset.node(w) == nodes[(w + 2) % nodes.size()], "thread_placement: compact with offset failed");
+    }
+    status |= test_bool(uneven.node_id(1) == 2 && even.node_id(1) == 1, "numa_topology: node ids failed");
+    return status;
+}
+
+// pin binds a thread once and selects its page pool
+int test_pin()
+{
+    int status = 0;
+    std::thread([&]()
+        {
+            status |= test_bool(thread_placement::bound_node() == size_t(-1), "thread_placement: new thread is bound");
+            thread_placement(placement_policy::none).pin(0);
+            status |= test_bool(thread_placement::bound_node() == size_t(-1), "thread_placement: none pinned a thread");
+            thread_placement placement(placement_policy::compact);
+            placement.pin(0);
+            status |= test_bool(thread_placement::bound_node() == placement.node(0), "thread_placement: pin failed");
+            status |= test_bool(detail::mccl_page_allocator<>::current_pool() == placement.node(0), "thread_placement: pin did not select the page pool");
+        }).join();
+    return status;
+}
+
+// a freed page returns to the pool of the node it was allocated on, also when another thread frees it
+int test_page_pools()
+{
+    int status = 0;
+    typedef detail::mccl_page_allocator<> allocator;
+    auto alloc_on_node = [](size_t node)
+        {
+            void* p = nullptr;
+            std::thread([&]()
+                {
+                    detail::mccl_page_node() = node;
+                    p = allocator::alloc_page();
+                }).join();
+            return p;
+        };
+    void* page1 = alloc_on_node(1);
+    allocator::free_page(page1);
+    void* page0 = alloc_on_node(0);
+    status |= test_bool(page0 != page1, "mccl_page_allocator: page of node 1 reused on node 0");
+    void* page1b = alloc_on_node(1);
+    status |= test_bool(page1b == page1, "mccl_page_allocator: page of node 1 not reused on node 1");
+    allocator::free_page(page0);
+    allocator::free_page(page1b);
+    void* pageu = allocator::alloc_page();
+    status |= test_bool(pageu != page1, "mccl_page_allocator: page of node 1 reused by an unpinned thread");
+    allocator::free_page(pageu);
+    return status;
+}
+
+int main(int, char**)
+{
+    int status = 0;
+
+    status |= test_parse_cpulist();
+    status |= test_placement_node();
+    status |= test_pin();
+    status |= test_page_pools();
+
+    if (status == 0)
+    {
+        LOG_CERR("All tests passed.");
+        return 0;
+    }
+    return -1;
+}
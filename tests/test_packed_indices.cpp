@@ -0,0 +1,104 @@
+#include <mccl/config/config.hpp>
+
+#include <mccl/tools/packed_indices.hpp>
+
+#include "test_utils.hpp"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace mccl;
+
+std::mt19937_64 mt;
+
+// pack and unpack random selections of 0 up to arity indices < rows,
+// and concatenations of two selections decoded with the double arity packer
+int test_packer(size_t rows, size_t arity)
+{
+    int status = 0;
+    index_packer packer(rows, arity);
+    status |= (packer.arity() != arity);
+    status |= ((uint64_t(1) << packer.bits()) - 1 < rows);
+    status |= (packer.bits() > 1 && (uint64_t(1) << (packer.bits()-1)) - 1 >= rows);
+    status |= (packer.pack(nullptr, nullptr) != packer.empty());
+
+    const bool concat = index_packer::fits(rows, 2*arity);
+    index_packer packer2;
+    if (concat)
+        packer2.reset(rows, 2*arity);
+
+    std::vector<uint32_t> a, b, out(4*arity + 1);
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        a.resize(mt() % (arity+1));
+        b.resize(mt() % (arity+1));
+        for (auto& x : a) x = uint32_t(mt() % rows);
+        for (auto& x : b) x = uint32_t(mt() % rows);
+        // the largest index must be representable
+        if (!a.empty() && i % 10 == 0)
+            a[0] = uint32_t(rows - 1);
+
+        uint64_t xa = packer.pack(a.data(), a.data()+a.size());
+        uint64_t xb = packer.pack(b.data(), b.data()+b.size());
+        for (size_t j = 0; j < arity; ++j)
+            status |= (packer.get(xa, unsigned(j)) != (j < a.size() ? a[j] : packer.unused()));
+        uint32_t* end = packer.unpack(xa, out.data());
+        status |= !std::equal(a.begin(), a.end(), out.data(), end);
+        end = packer.unpack(xa, out.data(), 7);
+        status |= (size_t(end - out.data()) != a.size());
+        for (size_t j = 0; j < a.size(); ++j)
+            status |= (out[j] != a[j] + 7);
+
+        if (concat)
+        {
+            // unused slots of the lower selection are skipped
+            std::vector<uint32_t> ab(b);
+            ab.insert(ab.end(), a.begin(), a.end());
+            end = packer2.unpack((xa << packer.total_bits()) | xb, out.data());
+            status |= !std::equal(ab.begin(), ab.end(), out.data(), end);
+        }
+    }
+    if (status)
+        std::cerr << "test_packer(" << rows << "," << arity << ") failed" << std::endl;
+    return status;
+}
+
+int main(int, char**)
+{
+    int status = 0;
+
+    status |= test_packer(2, 1);
+    status |= test_packer(100, 4);
+    status |= test_packer(255, 8);
+    status |= test_packer(256, 7);
+    status |= test_packer(65534, 4);
+    status |= test_packer(65535, 4);
+    status |= test_packer(70000, 3);
+    status |= test_packer(4000, 5);
+    status |= test_packer((size_t(1) << 32) - 1, 2);
+
+    status |= !index_packer::fits(65534, 4);
+    status |= !index_packer::fits(65535, 4);
+    status |= index_packer::fits(65536, 4);
+    status |= !index_packer::fits(4095, 5);
+    status |= index_packer::fits(4096, 6);
+    status |= index_packer::fits(size_t(1) << 32, 1);
+    status |= index_packer::fits(10, 0);
+    try
+    {
+        index_packer packer(65536, 4);
+        status |= 1;
+    }
+    catch (std::exception&)
+    {
+    }
+
+    if (status == 0)
+    {
+        LOG_CERR("All tests passed.");
+        return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,71 @@
+#include <mccl/config/config.hpp>
+
+#include <mccl/tools/parser.hpp>
+#include <mccl/algorithm/isdgeneric_parallel.hpp>
+#include <mccl/algorithm/prange.hpp>
+#include <mccl/algorithm/stern_dumer.hpp>
+
+#include "test_utils.hpp"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+
+using namespace mccl;
+
+template<template<typename,size_t,bool> class driver_t, typename subISDT_t>
+int test_parallel_ISD(const cmat_view& H, const cvec_view& S, size_t w, size_t threads, const configmap_t& configmap)
+{
+    int status = 0;
+    std::vector< std::unique_ptr<subISDT_t> > subISDs;
+    std::vector< subISDT_t* > subISDptrs;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        subISDs.emplace_back(new subISDT_t());
+        subISDs.back()->load_config(configmap);
+        subISDptrs.push_back(subISDs.back().get());
+    }
+    driver_t<subISDT_t,256,false> ISD(subISDptrs);
+    ISD.load_config(configmap);
+    ISD.seed(1234);
+    for (unsigned trial = 0; trial < 4; ++trial)
+    {
+        ISD.initialize(H, S, w);
+        ISD.solve();
+        status |= not(check_SD_solution(H, S, w, ISD.get_solution()));
+    }
+    // a second solve without initialize must not count the first one again
+    ISD.solve();
+    status |= not(check_SD_solution(H, S, w, ISD.get_solution()));
+    auto stats = ISD.get_stats();
+    status |= not(stats.cnt_solve.size() == 5);
+    status |= not(stats.cnt_initialize.total() == 4 * threads);
+    return status;
+}
+
+int main(int, char**)
+{
+    int status = 0;
+
+    file_parser parse;
+    status |= !parse.parse_file("./tests/data/SD_100_0");
+
+    auto H = parse.H();
+    auto S = parse.S();
+    size_t w = parse.w();
+
+    status |= test_parallel_ISD<ISD_generic_parallel, subISDT_prange>(H, S, w, 4, configmap_t());
+    status |= test_parallel_ISD<ISD_generic_parallel, subISDT_stern_dumer>(H, S, w, 3, configmap_t({ {"p", "4"}, {"l", "6"} }));
+    status |= test_parallel_ISD<ISD_generic_parallel, subISDT_prange>(H, S, w, 1, configmap_t());
+
+    status |= test_parallel_ISD<ISD_generic_pipeline, subISDT_prange>(H, S, w, 3, configmap_t());
+    status |= test_parallel_ISD<ISD_generic_pipeline, subISDT_stern_dumer>(H, S, w, 2, configmap_t({ {"p", "4"}, {"l", "6"} }));
+    status |= test_parallel_ISD<ISD_generic_pipeline, subISDT_prange>(H, S, w, 1, configmap_t());
+
+    if (status == 0)
+    {
+        LOG_CERR("All tests passed.");
+        return 0;
+    }
+    return -1;
+}
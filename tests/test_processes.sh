@@ -0,0 +1,18 @@
+#!/bin/sh
+# isdsolver --processes forks the worker processes after the instance has been set up:
+# with n >= 128 and threads > 1 every worker echelonizes with its own echelonize thread pool
+# a worker that inherited the thread pool of the coordinator would wait forever for threads that do not exist
+
+status=0
+for args in "-a P --threads 2" "-a P --threads 3 --pipeline" "-a SDv0 -p 2 -l 12 --threads 2 --subthreads 2"
+do
+    if ! timeout 300 ./bin/isdsolver -g -n 160 --genseed 1 --seed 1 --processes 2 -q $args > /dev/null
+    then
+        echo "test_processes: isdsolver -g -n 160 --processes 2 $args failed"
+        status=1
+    fi
+done
+if [ $status -eq 0 ]; then
+    echo "All tests passed."
+fi
+exit $status
@@ -32,9 +32,10 @@ int main(int, char**)
         rowweights[r] = hammingweight(Hraw[r]);
     //    auto total_hw = hammingweight(Hraw);
 
-    configmap_t configmap = { {"p", "4"}, {"l", "6"} };
-    // test subISD_sieving
+    // test subISD_sieving single-threaded and multi-threaded
+    for (auto subthreads : { "1", "3" })
     {
+        configmap_t configmap = { {"p", "4"}, {"l", "6"}, {"subthreads", subthreads} };
         subISDT_sieving sieving;
         ISD_generic<subISDT_sieving> ISD_sieving(sieving);
 
@@ -56,6 +57,24 @@ int main(int, char**)
         status |= !(eval_S.is_equal(S));
     }
 
+    // the same seed must give the same run, including the sampling of the sieving lists
+    {
+        configmap_t configmap = { {"p", "4"}, {"l", "6"} };
+        size_t iterations[2];
+        for (size_t i = 0; i < 2; ++i)
+        {
+            subISDT_sieving sieving;
+            ISD_generic<subISDT_sieving> ISD_sieving(sieving);
+            ISD_sieving.load_config(configmap);
+            sieving.load_config(configmap);
+            ISD_sieving.seed(1234);
+            ISD_sieving.initialize(Hraw, S, w);
+            ISD_sieving.solve();
+            iterations[i] = ISD_sieving.get_stats().cnt_loop_next.total();
+        }
+        status |= !(iterations[0] == iterations[1]);
+    }
+
     if (status == 0)
     {
         LOG_CERR("All tests passed.");
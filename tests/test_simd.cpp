@@ -0,0 +1,212 @@
+#include <mccl/config/config.hpp>
+
+#include <mccl/core/matrix.hpp>
+#include <mccl/core/matrix_algorithms.hpp>
+#include <mccl/core/simd_kernels.hpp>
+
+#include "test_utils.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define TEST_HAVE_RDTSC 1
+#define TEST_COUNTER_UNIT "cycles"
+#else
+#define TEST_COUNTER_UNIT "ns"
+#endif
+
+using namespace mccl;
+
+typedef std::conditional<std::chrono::high_resolution_clock::is_steady, std::chrono::high_resolution_clock, std::chrono::steady_clock>::type bench_clock_t;
+
+int test_bool(bool val, const std::string& errmsg = "error")
+{
+    if (val)
+       return 0;
+    LOG_CERR(errmsg);
+    return -1;
+}
+
+// cycles if available, otherwise nanoseconds
+inline uint64_t bench_counter()
+{
+#ifdef TEST_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock_t::now().time_since_epoch()).count();
+#endif
+}
+
+// the row-conditional xor of swap_echelon as done by the vector interface
+void xor_rows_loop(mat_t<block_tag<256,false>>& m, size_t first_row, size_t src_row, size_t pivotcol)
+{
+    auto pivotrow = m[src_row];
+    auto rowit = m.begin() + first_row;
+    for (size_t r = first_row; r < m.rows(); ++r, ++rowit)
+        if (m(r, pivotcol))
+            rowit.v_xor(pivotrow);
+}
+
+// microbenchmark of the swap_echelon row update on a HST-like matrix:
+// the src rows are the first rows and each update uses another pivot column from the last 64 columns,
+// like in swap_echelon the src rows have their pivot bits cleared
+int bench_xor_rows(size_t rows, size_t cols, size_t passes)
+{
+    int status = 0;
+    const size_t pivots = 4;
+    mat_t<block_tag<256,false>> m0(rows, cols);
+    fillrandom(m0);
+    for (size_t i = 0; i < pivots; ++i)
+        for (size_t c = cols - 64; c < cols; ++c)
+            m0.clearbit(i, c);
+    auto pivotcol = [cols](size_t p, size_t j) { return cols - 1 - ((p * pivots + j) % 64); };
+    size_t words = m0.row_words(), stride = m0.word_stride();
+    std::cout << "xor_rows_if_bits " << rows << "x" << cols << ", " << TEST_COUNTER_UNIT << " per row per pivot:" << std::endl;
+
+    // reference: current vector loop
+    mat_t<block_tag<256,false>> m1 = m_copy(m0);
+    uint64_t start = bench_counter();
+    for (size_t p = 0; p < passes; ++p)
+        for (size_t j = 0; j < pivots; ++j)
+            xor_rows_loop(m1, pivots, j, pivotcol(p, j));
+    double ref = double(bench_counter() - start) / double(passes * pivots * (rows - pivots));
+    std::cout << "   vector loop                : " << std::setprecision(3) << ref << std::endl;
+
+    const uint64_t* src[pivots];
+    size_t pivotbit[pivots];
+    for (int l = 0; l <= int(simd_cpu_level()); ++l)
+    {
+        auto k = simd_get_kernels(simd_level(l));
+        for (size_t n : { size_t(1), pivots })
+        {
+            mat_t<block_tag<256,false>> m2 = m_copy(m0);
+            for (size_t j = 0; j < pivots; ++j)
+                src[j] = m2.word_ptr(j);
+            start = bench_counter();
+            for (size_t p = 0; p < passes; ++p)
+                for (size_t j = 0; j < pivots; j += n)
+                {
+                    for (size_t i = 0; i < n; ++i)
+                        pivotbit[i] = pivotcol(p, j + i);
+                    k.xor_rows_if_bits(m2.word_ptr(pivots), stride, rows - pivots, src + j, pivotbit, n, words);
+                }
+            double t = double(bench_counter() - start) / double(passes * pivots * (rows - pivots));
+            std::cout << "   " << std::setw(13) << to_string(simd_level(l)) << " " << n << " pivot(s) : " << std::setprecision(3) << t << std::endl;
+            status |= test_bool(m1.is_equal(m2), "xor_rows_if_bits differs from vector loop");
+        }
+    }
+    return status;
+}
+
+// microbenchmark of the popcount kernels: long arrays and the ISD callback weight check
+int bench_popcount(size_t cols, size_t passes)
+{
+    int status = 0;
+    mat m0(16, cols);
+    fillrandom(m0);
+    size_t words = m0.row_words(), stride = m0.word_stride();
+    std::vector<uint32_t> sel = { 3, 7, 11 };
+    vec c(cols);
+    std::cout << "popcount " << cols << " bits, " << TEST_COUNTER_UNIT << " per word:" << std::endl;
+
+    // reference: current word loop
+    size_t wref = 0;
+    uint64_t start = bench_counter();
+    for (size_t p = 0; p < passes; ++p)
+        for (size_t i = 0; i < words; ++i)
+            wref += hammingweight(m0.word_ptr(p % 16)[i] ^ m0.word_ptr(15)[i]);
+    double ref = double(bench_counter() - start) / double(passes * words);
+    std::cout << "   word loop             : " << std::setprecision(3) << ref << std::endl;
+
+    for (int l = 0; l <= int(simd_cpu_level()); ++l)
+    {
+        auto k = simd_get_kernels(simd_level(l));
+        size_t w = 0;
+        start = bench_counter();
+        for (size_t p = 0; p < passes; ++p)
+            w += k.hw_xor(m0.word_ptr(p % 16), m0.word_ptr(15), words);
+        double t1 = double(bench_counter() - start) / double(passes * words);
+        status |= test_bool(w == wref, "hw_xor differs from word loop");
+        start = bench_counter();
+        for (size_t p = 0; p < passes; ++p)
+            w += k.combine_hw(c.word_ptr(), m0.word_ptr(p % 16), m0.word_ptr(), stride, &sel[0], &sel[0] + sel.size(), words, cols);
+        double t2 = double(bench_counter() - start) / double(passes * words);
+        std::cout << "   " << std::setw(13) << to_string(simd_level(l)) << " hw_xor : " << std::setprecision(3) << t1 << ", combine_hw : " << t2 << std::endl;
+    }
+    return status;
+}
+
+// benchmark of m_transpose with the transpose64 kernel of every level, compared bit by bit with the source
+// the last line uses the echelonize threads, which divide the column blocks
+int bench_transpose(size_t rows, size_t cols, size_t passes)
+{
+    int status = 0;
+    mat m0(rows, cols);
+    fillrandom(m0);
+    auto check = [&](const mat& mt)
+    {
+        bool ok = mt.rows() == cols && mt.columns() == rows;
+        for (size_t r = 0; ok && r < rows; ++r)
+            for (size_t c = 0; ok && c < cols; ++c)
+                ok = m0(r,c) == mt(c,r);
+        return ok;
+    };
+    const double blocks = double(((rows + 63) / 64) * ((cols + 63) / 64));
+    std::cout << "transpose " << rows << "x" << cols << ", " << TEST_COUNTER_UNIT << " per 64x64 block:" << std::endl;
+    const simd_level selected = simd_kernels.level;
+    for (int l = 0; l <= int(simd_cpu_level()); ++l)
+    {
+        simd_select(simd_level(l));
+        mat mt(cols, rows);
+        uint64_t start = bench_counter();
+        for (size_t p = 0; p < passes; ++p)
+            mt.transpose(m0);
+        double t = double(bench_counter() - start) / (double(passes) * blocks);
+        std::cout << "   " << std::setw(13) << to_string(simd_level(l)) << " : " << std::setprecision(3) << t << std::endl;
+        status |= test_bool(check(mt), "m_transpose failed");
+    }
+    simd_select(selected);
+    set_echelonize_threads(3);
+    mat mt(cols, rows);
+    uint64_t start = bench_counter();
+    for (size_t p = 0; p < passes; ++p)
+        mt.transpose(m0);
+    double t = double(bench_counter() - start) / (double(passes) * blocks);
+    set_echelonize_threads(1);
+    std::cout << "   " << std::setw(13) << to_string(selected) << " 3 threads : " << std::setprecision(3) << t << std::endl;
+    status |= test_bool(check(mt), "m_transpose with threads failed");
+    return status;
+}
+
+int main(int, char**)
+{
+    int status = 0;
+
+    std::cout << "Selected kernels: " << to_string(simd_kernels.level) << std::endl;
+    // prange & LB sized HST for n=1000, k=500 and a wide one
+    status |= bench_xor_rows(1001, 500, 200);
+    status |= bench_xor_rows(2001, 1500, 50);
+    // larger than the caches, where applying several pivots per pass saves memory bandwidth
+    status |= bench_xor_rows(8001, 4000, 4);
+    // odd word counts exercise the masked tails
+    status |= bench_xor_rows(301, 64*5 + 3, 20);
+
+    // ISD callback sized rows and long arrays
+    status |= bench_popcount(1000, 20000);
+    status |= bench_popcount(64*1024, 200);
+
+    // H of an n=1000 instance as transposed by HST_ISD_form_t::reset, partial border blocks, and a large matrix
+    status |= bench_transpose(500, 1000, 200);
+    status |= bench_transpose(301, 64*5 + 3, 100);
+    status |= bench_transpose(4096, 8192, 4);
+
+    if (status == 0)
+    {
+        LOG_CERR("All tests passed.");
+        return 0;
+    }
+    return -1;
+}
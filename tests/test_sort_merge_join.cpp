@@ -0,0 +1,95 @@
+#include <mccl/config/config.hpp>
+#include <mccl/tools/sort_merge_join.hpp>
+
+#include "test_utils.hpp"
+
+#include <iostream>
+#include <map>
+#include <random>
+
+using namespace mccl;
+
+typedef sort_merge_join<uint64_t, uint64_t> join_t;
+
+std::mt19937_64 mt;
+
+// compare the join of two random lists with the expected number of pairs and a checksum over all pairs
+// the right list is filled through 3 separate lists that are merged into it
+int test_join(size_t leftsize, size_t rightsize, unsigned keybits, thread_pool::thread_pool* threadpool)
+{
+    const uint64_t keymask = keybits >= 64 ? ~uint64_t(0) : (uint64_t(1) << keybits) - 1;
+    join_t join;
+    join.set_key_bits(keybits);
+    std::map<uint64_t, std::pair<uint64_t,uint64_t>> left, right;
+    for (size_t i = 0; i < leftsize; ++i)
+    {
+        uint64_t k = mt() & keymask, v = mt();
+        join.push_left(k, v);
+        left[k].first += 1;
+        left[k].second += v;
+    }
+    join_t::list_type parts[3];
+    for (size_t i = 0; i < rightsize; ++i)
+    {
+        uint64_t k = mt() & keymask, v = mt();
+        parts[i % 3].push_back(join_t::item_t{k, v});
+        right[k].first += 1;
+        right[k].second += v;
+    }
+    for (auto& part : parts)
+        join.right().merge_unstable(std::move(part));
+
+    // sum over pairs (l,r) of l*r is the product of the sums per key
+    uint64_t expected_count = 0, expected_checksum = 0;
+    for (auto& kv : left)
+    {
+        auto it = right.find(kv.first);
+        if (it == right.end())
+            continue;
+        expected_count += kv.second.first * it->second.first;
+        expected_checksum += kv.second.second * it->second.second;
+    }
+
+    uint64_t count = 0, checksum = 0;
+    int status = 0;
+    status |= !join.join([&](uint64_t lv, uint64_t rv) { ++count; checksum += lv * rv; return true; }, threadpool);
+    status |= (join.left().size() != leftsize) || (join.right().size() != rightsize);
+    status |= !std::is_sorted(join.left().begin(), join.left().end());
+    status |= !std::is_sorted(join.right().begin(), join.right().end());
+    status |= (count != expected_count) || (checksum != expected_checksum);
+
+    // stop after the first pair
+    if (expected_count > 1)
+    {
+        count = 0;
+        status |= join.match([&](uint64_t, uint64_t) { ++count; return false; });
+        status |= (count != 1);
+    }
+    if (status)
+        std::cerr << "test_join(" << leftsize << "," << rightsize << "," << keybits << ") failed: "
+                  << count << " " << expected_count << std::endl;
+    return status;
+}
+
+int main(int, char**)
+{
+    int status = 0;
+
+    status |= test_join(0, 100, 8, nullptr);
+    status |= test_join(1000, 1000, 8, nullptr);
+    status |= test_join(5000, 3000, 12, nullptr);
+    // multiple pages and multiple radix passes
+    status |= test_join(200000, 150000, 20, nullptr);
+    status |= test_join(100000, 100000, 64, nullptr);
+
+    thread_pool::thread_pool threadpool(2);
+    status |= test_join(1000, 1000, 8, &threadpool);
+    status |= test_join(200000, 150000, 20, &threadpool);
+
+    if (status == 0)
+    {
+        LOG_CERR("All tests passed.");
+        return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,27 @@
+#!/bin/sh
+# isdsolver derives the generator seed and the ISD seed of every trial from --genseed, --seed and the trial index:
+# the same instances must be generated and solved for every number of trial threads
+# the trial threads print their solutions in any order, so the solutions are compared sorted
+
+solutions()
+{
+    ./bin/isdsolver -g -n 80 --genseed 5 --seed 9 --trials 8 "$@" | grep -A1 "Solution found" | grep '^\[' | sort
+}
+
+status=0
+for args in "-a P" "-a LB -p 2"
+do
+    if ! sol1=$(solutions $args --trialthreads 1) || ! sol2=$(solutions $args --trialthreads 2)
+    then
+        echo "test_trials: isdsolver $args failed"
+        status=1
+    elif [ -z "$sol1" ] || [ "$sol1" != "$sol2" ]
+    then
+        echo "test_trials: isdsolver $args: --trialthreads 1 and 2 solve different instances"
+        status=1
+    fi
+done
+if [ $status -eq 0 ]; then
+    echo "All tests passed."
+fi
+exit $status
@@ -1,6 +1,7 @@
 // config
 #include <mccl/config/config.hpp>
 #include <mccl/tools/unordered_multimap.hpp>
+#include <mccl/contrib/thread_pool.hpp>
 #include <mccl/contrib/memory_usage.hpp>
 #include <mccl/contrib/program_options.hpp>
 
@@ -43,6 +44,67 @@ int test_prime(uint64_t p)
     return status;
 }
 
+// fill a concurrent multimap with all test numbers (twice) from several threads,
+// then match all test numbers from several threads and compare with the expected count
+int test_concurrent(size_t threads)
+{
+    thread_pool::thread_pool tp(threads-1);
+    concurrent_cacheline_unordered_multimap<uint64_t,uint64_t> h;
+    h.reserve(2*test_numbers.size());
+
+    std::atomic<size_t> failed(0), matched(0);
+    tp.run([&](int t, int T)
+        {
+            for (size_t i = t; i < 2*test_numbers.size(); i += T)
+                if (!h.insert(test_numbers[i % test_numbers.size()], 1))
+                    ++failed;
+        }, int(threads));
+    tp.run([&](int t, int T)
+        {
+            size_t c = 0;
+            for (size_t i = t; i < test_numbers.size(); i += T)
+                h.match(test_numbers[i], [&c](uint64_t v) { c += v; });
+            matched += c;
+        }, int(threads));
+
+    int status = 0;
+    status |= (failed != 0);
+    status |= (h.size() != 2*test_numbers.size());
+    status |= (matched != 2*test_numbers.size());
+
+    // inserts beyond the fixed capacity fail
+    concurrent_cacheline_unordered_multimap<uint64_t,uint64_t> small;
+    small._reserve(1);
+    size_t inserted = 0;
+    for (auto n : test_numbers)
+        inserted += small.insert(n, 1) ? 1 : 0;
+    status |= (inserted != small.bucket_count());
+    if (status)
+        std::cerr << "test_concurrent(" << threads << ") failed: " << failed << " " << h.size() << " " << matched << " " << inserted << std::endl;
+    return status;
+}
+
+// an unqueued match on a completely filled batch multimap must terminate
+int test_batch_full()
+{
+    batch_unordered_multimap<uint64_t,uint64_t> h;
+    h.max_load_factor(1.0f);
+    h.reserve(100);
+    const size_t n = h.capacity();
+    for (size_t i = 0; i < n; ++i)
+        h.queue_insert(test_numbers[i], i);
+    h.finalize_insert();
+    size_t found = 0;
+    // keys that are not present have to traverse all full buckets
+    h.match(~uint64_t(0), [&found](uint64_t) { ++found; });
+    for (size_t i = 0; i < n; ++i)
+        h.match(test_numbers[i], [&found](uint64_t) { ++found; });
+    int status = (h.size() != h.bucket_count()) || (found != n);
+    if (status)
+        std::cerr << "test_batch_full() failed: " << h.size() << " " << h.bucket_count() << " " << found << std::endl;
+    return status;
+}
+
 template<typename HT>
 struct ht_wrapper
 {
@@ -238,6 +300,10 @@ int main(int argc, char** argv)
     for (auto p : hash_primes)
         status |= test_prime(p);
 
+    status |= test_concurrent(1);
+    status |= test_concurrent(4);
+    status |= test_batch_full();
+
     if (vm.count("bench"))
     {
         std::cout << "\n====== Benchmark simple_hash_table vs cacheline_hash_table" << std::endl;